@@ -21,6 +21,7 @@
 #include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/mipmap.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/progressreporter.h>
@@ -196,6 +197,29 @@ static std::map<std::string, CommandUsage> commandUsage = {
       std::string(R"(
     --downsample <n>   Downsample the image by a factor of n in both dimensions
                        (using simple box filtering). Default: 1.
+)")}},
+    {"makemipmap",
+     {"makemipmap [options] <filename>",
+      "Generate all of the MIP map levels of an image texture and store them\n"
+      "    in a tiled file that pbrt can use without any preprocessing. Image\n"
+      "    textures use it if their \"filename\" has the \".mipmap\" extension.",
+      std::string(R"(
+    --encoding <name>  Color encoding of 8-bit images: "linear", "sRGB", or
+                       "gamma <value>". It is also used when other images are
+                       stored in 8-bit or block-compressed formats, which
+                       clamp values greater than one. Default: "sRGB" for PNG
+                       images and 8-bit or block-compressed output, "linear"
+                       otherwise.
+    --format <name>    Format of the stored texels: "u256", "half", "float",
+                       or one of the block-compressed formats "bc1" (RGB),
+                       "bc4" (single channel), or "bc7" (RGB or RGBA, using
+                       only BC7 mode 6 blocks), which use 2-6x less memory
+                       than 8-bit texels. Default: the image's format.
+    --outfile <name>   Filename of the tiled MIP map. Its extension must be
+                       ".mipmap".
+    --wrapmode <mode>  Wrap mode used when downsampling the image: "clamp",
+                       "repeat", "black", or "octahedralsphere". It should
+                       match the texture's "wrap" parameter. Default: "repeat"
 )")}},
     {"makesky",
      {"makesky [options] <filename>",
@@ -2220,6 +2244,59 @@ int makeequiarea(std::vector<std::string> args) {
     return 0;
 }
 
+int makemipmap(std::vector<std::string> args) {
+    std::string inFilename, outFilename, encodingName, formatName;
+    std::string wrapModeName = "repeat";
+
+    auto onError = [](const std::string &err) {
+        usage("makemipmap", "%s", err.c_str());
+        exit(1);
+    };
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        if (ParseArg(&iter, args.end(), "encoding", &encodingName, onError) ||
+            ParseArg(&iter, args.end(), "format", &formatName, onError) ||
+            ParseArg(&iter, args.end(), "outfile", &outFilename, onError) ||
+            ParseArg(&iter, args.end(), "wrapmode", &wrapModeName, onError)) {
+            // success
+        } else if ((*iter)[0] == '-')
+            usage("makemipmap", "%s: unknown command flag", iter->c_str());
+        else if (inFilename.empty()) {
+            inFilename = *iter;
+        } else
+            usage("makemipmap", "multiple input filenames provided.");
+    }
+    if (inFilename.empty())
+        usage("makemipmap", "input image filename must be provided.");
+    if (outFilename.empty())
+        usage("makemipmap", "output filename must be provided.");
+    if (!HasExtension(outFilename, "mipmap"))
+        usage("makemipmap", "%s: output filename must have \".mipmap\" extension.",
+              outFilename.c_str());
+    if (HasExtension(inFilename, "mipmap"))
+        usage("makemipmap", "%s: input is already a tiled MIP map.", inFilename.c_str());
+
+    pstd::optional<WrapMode> wrapMode = ParseWrapMode(wrapModeName.c_str());
+    if (!wrapMode)
+        usage("makemipmap", "%s: wrap mode unknown", wrapModeName.c_str());
+    pstd::optional<PixelFormat> format;
+    if (!formatName.empty()) {
+        format = ParsePixelFormat(formatName);
+        if (!format)
+            usage("makemipmap", "%s: pixel format unknown", formatName.c_str());
+    }
+    // Let _WriteTiled()_ choose the encoding of quantized texels if none was given
+    ColorEncoding tileEncoding =
+        encodingName.empty() ? nullptr : ColorEncoding::Get(encodingName, Allocator());
+    if (encodingName.empty())
+        encodingName = HasExtension(inFilename, "png") ? "sRGB" : "linear";
+    ColorEncoding encoding = ColorEncoding::Get(encodingName, Allocator());
+
+    // Read the image and generate its MIP map as an image texture would
+    MIPMap *mipmap = MIPMap::CreateFromFile(inFilename, MIPMapFilterOptions(),
+                                            *wrapMode, encoding, Allocator());
+    return mipmap->WriteTiled(outFilename, format, tileEncoding) ? 0 : 1;
+}
+
 #ifdef PBRT_BUILD_GPU_RENDERER
 int denoise_optix(std::vector<std::string> args) {
     std::string inFilename, outFilename;
@@ -2378,6 +2455,8 @@ int main(int argc, char *argv[]) {
         return makeequiarea(args);
     else if (cmd == "makeemitters")
         return makeemitters(args);
+    else if (cmd == "makemipmap")
+        return makemipmap(args);
     else if (cmd == "makesky")
         return makesky(args);
     else if (cmd == "whitebalance")
@@ -35,10 +35,16 @@ static void usage(const std::string &msg = {}) {
             R"(usage: pbrt [<options>] <filename.pbrt...>
 
 Rendering options:
+  --bvh-cache <dir>             Directory in which to cache BVHs so that later runs
+                                with the same geometry can skip BVH construction.
+  --compact-meshes              Store triangle mesh normals, tangents, uvs, and
+                                vertex indices using compact encodings.
   --cropwindow <x0,x1,y0,y1>    Specify an image crop window w.r.t. [0,1]^2.
   --debugstart <values>         Inform the Integrator where to start rendering for
                                 faster debugging. (<values> are Integrator-specific
                                 and come from error message text.)
+  --deterministic               Make results independent of the number of threads
+                                and their scheduling.
   --disable-image-textures      Always return the average value of image textures.
   --disable-pixel-jitter        Always sample pixels at their centers.
   --disable-texture-filtering   Point-sample all textures.
@@ -56,11 +62,22 @@ Rendering options:
 #endif
             R"(
   --help                        Print this help text.
+  --hugepages                   Use 2MB pages for large read-only scene data such as
+                                BVH nodes, vertex buffers, and MIP maps.
   --interactive                 Enable interactive rendering mode.
+  --memory-budget <MB>          Page triangle meshes and BVH nodes to a file on disk,
+                                keeping at most the given amount of them in memory.
+                                About 32 bytes per triangle and the memory used
+                                to build the BVH are not included in the budget.
   --mse-reference-image         Filename for reference image to use for MSE computation.
   --mse-reference-out           File to write MSE error vs spp results.
   --nthreads <num>              Use specified number of threads for rendering.
+  --numa                        Pin threads to CPUs across NUMA nodes and replicate
+                                acceleration structures on each node (Linux only).
   --outfile <filename>          Write the final image to the given filename.
+  --paging-directory <dir>      Directory for the files used by --memory-budget and
+                                --texture-cache.
+                                (Default: $TMPDIR or /tmp)
   --pixel <x,y>                 Render just the specified pixel.
   --pixelbounds <x0,x1,y0,y1>   Specify an image crop window w.r.t. pixel coordinates.
   --pixelmaterial <x,y>         Print information about the material visible in the
@@ -76,6 +93,8 @@ Rendering options:
   --stats                       Print various statistics after rendering completes.
   --spp <n>                     Override number of pixel samples specified in scene
                                 description file.
+  --texture-cache <MB>          Store image texture MIP maps in tiles in a file on disk,
+                                keeping at most the given amount of them in memory.
   --wavefront                   Use wavefront volumetric path integrator.
   --write-partial-images        Periodically write the current image to disk, rather
                                 than waiting for the end of rendering. Default: disabled.
@@ -161,7 +180,11 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "gpu", &options.useGPU, onError) ||
             ParseArg(&iter, args.end(), "gpu-device", &options.gpuDevice, onError) ||
 #endif
+            ParseArg(&iter, args.end(), "bvh-cache", &options.bvhCacheDirectory,
+                     onError) ||
             ParseArg(&iter, args.end(), "debugstart", &options.debugStart, onError) ||
+            ParseArg(&iter, args.end(), "deterministic", &options.deterministic,
+                     onError) ||
             ParseArg(&iter, args.end(), "disable-image-textures",
                      &options.disableImageTextures, onError) ||
             ParseArg(&iter, args.end(), "disable-pixel-jitter",
@@ -183,12 +206,20 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "log-file", &options.logFile, onError) ||
             ParseArg(&iter, args.end(), "interactive", &options.interactive, onError) ||
             ParseArg(&iter, args.end(), "fullscreen", &options.fullscreen, onError) ||
+            ParseArg(&iter, args.end(), "compact-meshes", &options.compactMeshes,
+                     onError) ||
+            ParseArg(&iter, args.end(), "hugepages", &options.hugePages, onError) ||
+            ParseArg(&iter, args.end(), "memory-budget", &options.memoryBudget,
+                     onError) ||
             ParseArg(&iter, args.end(), "mse-reference-image", &options.mseReferenceImage,
                      onError) ||
             ParseArg(&iter, args.end(), "mse-reference-out", &options.mseReferenceOutput,
                      onError) ||
             ParseArg(&iter, args.end(), "nthreads", &options.nThreads, onError) ||
+            ParseArg(&iter, args.end(), "numa", &options.numa, onError) ||
             ParseArg(&iter, args.end(), "outfile", &options.imageFile, onError) ||
+            ParseArg(&iter, args.end(), "paging-directory", &options.pagingDirectory,
+                     onError) ||
             ParseArg(&iter, args.end(), "pixelstats", &options.recordPixelStatistics,
                      onError) ||
             ParseArg(&iter, args.end(), "quick", &options.quickRender, onError) ||
@@ -197,6 +228,8 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "seed", &options.seed, onError) ||
             ParseArg(&iter, args.end(), "spp", &options.pixelSamples, onError) ||
             ParseArg(&iter, args.end(), "stats", &options.printStatistics, onError) ||
+            ParseArg(&iter, args.end(), "texture-cache", &options.textureCacheBudget,
+                     onError) ||
             ParseArg(&iter, args.end(), "toply", &toPly, onError) ||
             ParseArg(&iter, args.end(), "wavefront", &options.wavefront, onError) ||
             ParseArg(&iter, args.end(), "write-partial-images",
@@ -259,6 +292,11 @@ int main(int argc, char *argv[]) {
         ErrorExit("The --interactive option is only supported with the --gpu "
                   "and --wavefront integrators.");
 
+    if (options.memoryBudget < 0)
+        ErrorExit("The --memory-budget option must be non-negative.");
+    if (options.textureCacheBudget < 0)
+        ErrorExit("The --texture-cache option must be non-negative.");
+
     if (options.fullscreen && !options.interactive) {
         ErrorExit("The --fullscreen option is only supported in interactive mode");
     }
@@ -5,18 +5,36 @@
 #include <pbrt/cpu/aggregates.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
+#include <pbrt/util/paging.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <tuple>
+#include <unordered_map>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
@@ -24,7 +42,11 @@ STAT_MEMORY_COUNTER("Memory/BVH", treeBytes);
 STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
+STAT_COUNTER("BVH/Spatial splits", spatialSplits);
+STAT_COUNTER("BVH/Duplicated primitive references", duplicatedReferences);
 STAT_PIXEL_COUNTER("BVH/Nodes visited", bvhNodesVisited);
+STAT_COUNTER("BVH/Cache hits", bvhCacheHits);
+STAT_COUNTER("BVH/Cache misses", bvhCacheMisses);
 
 // MortonPrimitive Definition
 struct MortonPrimitive {
@@ -125,6 +147,91 @@ struct BVHBuildNode {
     int splitAxis, firstPrimOffset, nPrimitives;
 };
 
+// Parallel BVH Construction Helpers
+// Nodes with more than this many primitives are binned and partitioned in parallel
+static constexpr size_t parallelBuildThreshold = 256 * 1024;
+static constexpr int64_t parallelBuildChunkSize = 16 * 1024;
+
+static void ParallelComputeBounds(pstd::span<const BVHPrimitive> bvhPrimitives,
+                                  Bounds3f *bounds, Bounds3f *centroidBounds) {
+    // Compute per-chunk bounds in parallel and then reduce them
+    int64_t nChunks = (bvhPrimitives.size() + parallelBuildChunkSize - 1) /
+                      parallelBuildChunkSize;
+    std::vector<Bounds3f> chunkBounds(nChunks), chunkCentroidBounds(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        size_t start = chunk * parallelBuildChunkSize;
+        size_t end = std::min<size_t>(start + parallelBuildChunkSize, bvhPrimitives.size());
+        for (size_t i = start; i < end; ++i) {
+            chunkBounds[chunk] = Union(chunkBounds[chunk], bvhPrimitives[i].bounds);
+            chunkCentroidBounds[chunk] =
+                Union(chunkCentroidBounds[chunk], bvhPrimitives[i].Centroid());
+        }
+    });
+    for (int64_t chunk = 0; chunk < nChunks; ++chunk) {
+        *bounds = Union(*bounds, chunkBounds[chunk]);
+        *centroidBounds = Union(*centroidBounds, chunkCentroidBounds[chunk]);
+    }
+}
+
+template <int nBuckets, typename F>
+static void ParallelInitBuckets(pstd::span<const BVHPrimitive> bvhPrimitives,
+                                BVHSplitBucket buckets[nBuckets], F bucketIndex) {
+    // Fill per-chunk buckets in parallel and then reduce them
+    int64_t nChunks = (bvhPrimitives.size() + parallelBuildChunkSize - 1) /
+                      parallelBuildChunkSize;
+    std::vector<std::array<BVHSplitBucket, nBuckets>> chunkBuckets(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        size_t start = chunk * parallelBuildChunkSize;
+        size_t end = std::min<size_t>(start + parallelBuildChunkSize, bvhPrimitives.size());
+        for (size_t i = start; i < end; ++i) {
+            BVHSplitBucket &bucket = chunkBuckets[chunk][bucketIndex(bvhPrimitives[i])];
+            bucket.count++;
+            bucket.bounds = Union(bucket.bounds, bvhPrimitives[i].bounds);
+        }
+    });
+    for (int64_t chunk = 0; chunk < nChunks; ++chunk)
+        for (int b = 0; b < nBuckets; ++b) {
+            buckets[b].count += chunkBuckets[chunk][b].count;
+            buckets[b].bounds = Union(buckets[b].bounds, chunkBuckets[chunk][b].bounds);
+        }
+}
+
+template <typename Predicate>
+static size_t ParallelPartition(pstd::span<BVHPrimitive> bvhPrimitives, Predicate pred) {
+    // Count primitives satisfying _pred_ in each chunk
+    int64_t nChunks = (bvhPrimitives.size() + parallelBuildChunkSize - 1) /
+                      parallelBuildChunkSize;
+    std::vector<size_t> chunkBelow(nChunks + 1, 0);
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        size_t start = chunk * parallelBuildChunkSize;
+        size_t end = std::min<size_t>(start + parallelBuildChunkSize, bvhPrimitives.size());
+        for (size_t i = start; i < end; ++i)
+            chunkBelow[chunk + 1] += pred(bvhPrimitives[i]) ? 1 : 0;
+    });
+
+    // Compute output offsets for each chunk with a prefix sum
+    for (int64_t chunk = 0; chunk < nChunks; ++chunk)
+        chunkBelow[chunk + 1] += chunkBelow[chunk];
+    size_t mid = chunkBelow[nChunks];
+
+    // Scatter primitives to temporary buffer and copy them back
+    std::vector<BVHPrimitive> partitioned(bvhPrimitives.size());
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        size_t start = chunk * parallelBuildChunkSize;
+        size_t end = std::min<size_t>(start + parallelBuildChunkSize, bvhPrimitives.size());
+        size_t below = chunkBelow[chunk], above = mid + start - chunkBelow[chunk];
+        for (size_t i = start; i < end; ++i)
+            partitioned[pred(bvhPrimitives[i]) ? below++ : above++] = bvhPrimitives[i];
+    });
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        size_t start = chunk * parallelBuildChunkSize;
+        size_t end = std::min<size_t>(start + parallelBuildChunkSize, bvhPrimitives.size());
+        std::copy(partitioned.begin() + start, partitioned.begin() + end,
+                  bvhPrimitives.begin() + start);
+    });
+    return mid;
+}
+
 // LinearBVHNode Definition
 struct alignas(32) LinearBVHNode {
     Bounds3f bounds;
@@ -136,27 +243,295 @@ struct alignas(32) LinearBVHNode {
     uint8_t axis;          // interior node: xyz
 };
 
+// PrecomputedTriangle Definition
+// Triangles stored in _primitives_ order so that leaves can be tested without
+// first following the primitive, shape, and mesh indirections; _valid_ is
+// false for primitives that must be intersected through _Primitive_.
+struct PrecomputedTriangle {
+    Point3f p0, p1, p2;
+    bool valid;
+};
+
+// BVHClosestHit Definition
+// Tracks the closest intersection found so far; the _SurfaceInteraction_
+// for a precomputed triangle hit is only computed once traversal is done.
+struct BVHClosestHit {
+    pstd::optional<ShapeIntersection> si;
+    int triangleIndex = -1;
+    Float triangleTMax;
+};
+
+// BVHCacheHeader Definition
+// BVH cache files store this header, followed by the index of the input
+// primitive for each entry of the reordered _primitives_ array and then, at
+// the 64-byte aligned _nodesOffset_, the flattened nodes.
+struct BVHCacheHeader {
+    static constexpr char Magic[8] = {'p', 'b', 'r', 't', 'b', 'v', 'h', '\0'};
+    static constexpr uint32_t Version = 1;
+
+    char magic[8];
+    uint32_t version;
+    int32_t width, boundsBits, nodeSize;
+    uint64_t key, nInputPrimitives, nPrimitives, nNodes;
+    uint64_t nodesOffset, fileSize;
+    Bounds3f bounds;
+};
+
+// WideBVHNode Definition
+template <int N>
+struct alignas(64) WideBVHNode {
+    // WideBVHNode Public Methods
+    WideBVHNode() {
+        for (int i = 0; i < N; ++i) {
+            // Initialize _i_th child slot to be empty and never hit
+            for (int a = 0; a < 3; ++a) {
+                bounds[0][a][i] = Infinity;
+                bounds[1][a][i] = -Infinity;
+            }
+            offset[i] = -1;
+            nPrimitives[i] = 0;
+        }
+    }
+
+    // Full-precision nodes do not store bounds relative to the node's extent
+    explicit WideBVHNode(const Bounds3f &nodeBounds) : WideBVHNode() {}
+
+    void SetChildBounds(int i, const Bounds3f &b) {
+        for (int a = 0; a < 3; ++a) {
+            bounds[0][a][i] = b.pMin[a];
+            bounds[1][a][i] = b.pMax[a];
+        }
+    }
+
+    // Returns a bitmask of the children whose bounds the ray intersects and
+    // sets _tNear_ to the parametric entry point for each of them.
+    int IntersectP(Point3f o, Float raytMax, Vector3f invDir, const int dirIsNeg[3],
+                   Float tNear[N]) const {
+        // Initialize parametric ray interval for all children
+        Float t0[N], t1[N];
+        for (int i = 0; i < N; ++i) {
+            t0[i] = 0;
+            t1[i] = raytMax;
+        }
+
+        // Intersect ray with each axis' slabs for all children at once
+        for (int a = 0; a < 3; ++a) {
+            const Float *pNear = bounds[dirIsNeg[a]][a];
+            const Float *pFar = bounds[1 - dirIsNeg[a]][a];
+            for (int i = 0; i < N; ++i) {
+                Float tSlabNear = (pNear[i] - o[a]) * invDir[a];
+                Float tSlabFar = (pFar[i] - o[a]) * invDir[a];
+                // Update _tSlabFar_ to ensure robust ray--bounds intersection
+                tSlabFar *= 1 + 2 * gamma(3);
+                t0[i] = tSlabNear > t0[i] ? tSlabNear : t0[i];
+                t1[i] = tSlabFar < t1[i] ? tSlabFar : t1[i];
+            }
+        }
+
+        int hitMask = 0;
+        for (int i = 0; i < N; ++i) {
+            tNear[i] = t0[i];
+            hitMask |= int(t0[i] <= t1[i]) << i;
+        }
+        return hitMask;
+    }
+
+    static constexpr int Width = N;
+    // Child bounds, stored as [pMin/pMax][axis][child] so that the slab
+    // tests for all children are computed with SIMD-friendly loops
+    Float bounds[2][3][N];
+    int offset[N];            // leaf: primitives offset, interior: node index
+    uint16_t nPrimitives[N];  // 0 -> interior child
+};
+
+// QuantizedBVHNode Definition
+// Per child, 8- and 16-bit nodes take 24 and 30 bytes at width 2 (48- and
+// 60-byte nodes), 18 and 24 at width 4 (72, 96), and 15 and 21 at width 8
+// (120, 168). Full-precision nodes take 32 bytes per child at every width
+// (_LinearBVHNode_ and the 128- and 256-byte _WideBVHNode_s).
+template <int N, typename QuantizedType>
+struct QuantizedBVHNode {
+    // QuantizedBVHNode Public Methods
+    QuantizedBVHNode() : QuantizedBVHNode(Bounds3f(Point3f(0, 0, 0))) {}
+
+    explicit QuantizedBVHNode(const Bounds3f &nodeBounds) {
+        for (int a = 0; a < 3; ++a) {
+            origin[a] = nodeBounds.pMin[a];
+            // Choose power-of-two _scale_ so that quantized offsets dequantize exactly
+            Float extent = nodeBounds.pMax[a] - nodeBounds.pMin[a];
+            scale[a] = 0;
+            if (extent > 0) {
+                int exponent;
+                std::frexp(extent / QMax, &exponent);
+                scale[a] = std::ldexp(Float(1), exponent);
+                while (Dequantize(a, QMax) < nodeBounds.pMax[a])
+                    scale[a] *= 2;
+            }
+        }
+        for (int i = 0; i < N; ++i) {
+            // Initialize _i_th child slot to be empty
+            for (int a = 0; a < 3; ++a) {
+                qBounds[0][a][i] = QMax;
+                qBounds[1][a][i] = 0;
+            }
+            offset[i] = -1;
+            nPrimitives[i] = 0;
+        }
+    }
+
+    Float Dequantize(int axis, int q) const { return origin[axis] + q * scale[axis]; }
+
+    void SetChildBounds(int i, const Bounds3f &b) {
+        for (int a = 0; a < 3; ++a) {
+            // Quantize child bounds conservatively, rounding _pMin_ down and _pMax_ up
+            int qMin = 0, qMax = 0;
+            if (scale[a] > 0) {
+                qMin = Clamp(int(std::floor((b.pMin[a] - origin[a]) / scale[a])), 0, QMax);
+                qMax = Clamp(int(std::ceil((b.pMax[a] - origin[a]) / scale[a])), 0, QMax);
+            }
+            while (qMin > 0 && Dequantize(a, qMin) > b.pMin[a])
+                --qMin;
+            while (qMax < QMax && Dequantize(a, qMax) < b.pMax[a])
+                ++qMax;
+            DCHECK_LE(Dequantize(a, qMin), b.pMin[a]);
+            DCHECK_GE(Dequantize(a, qMax), b.pMax[a]);
+            qBounds[0][a][i] = qMin;
+            qBounds[1][a][i] = qMax;
+        }
+    }
+
+    int IntersectP(Point3f o, Float raytMax, Vector3f invDir, const int dirIsNeg[3],
+                   Float tNear[N]) const {
+        // Initialize parametric ray interval for all children
+        Float t0[N], t1[N];
+        for (int i = 0; i < N; ++i) {
+            t0[i] = 0;
+            t1[i] = raytMax;
+        }
+
+        // Dequantize child bounds and intersect ray with each axis' slabs
+        for (int a = 0; a < 3; ++a) {
+            const QuantizedType *qNear = qBounds[dirIsNeg[a]][a];
+            const QuantizedType *qFar = qBounds[1 - dirIsNeg[a]][a];
+            for (int i = 0; i < N; ++i) {
+                Float tSlabNear = (origin[a] + qNear[i] * scale[a] - o[a]) * invDir[a];
+                Float tSlabFar = (origin[a] + qFar[i] * scale[a] - o[a]) * invDir[a];
+                // Update _tSlabFar_ to ensure robust ray--bounds intersection
+                tSlabFar *= 1 + 2 * gamma(3);
+                t0[i] = tSlabNear > t0[i] ? tSlabNear : t0[i];
+                t1[i] = tSlabFar < t1[i] ? tSlabFar : t1[i];
+            }
+        }
+
+        // Empty slots may still dequantize to a valid box, so mask them out
+        int hitMask = 0;
+        for (int i = 0; i < N; ++i) {
+            tNear[i] = t0[i];
+            hitMask |= int(t0[i] <= t1[i] && offset[i] >= 0) << i;
+        }
+        return hitMask;
+    }
+
+    static constexpr int Width = N;
+    static constexpr int QMax = std::numeric_limits<QuantizedType>::max();
+    // Node bounds are _origin_ + _scale_ * [0, QMax]; child bounds are stored
+    // as [pMin/pMax][axis][child] offsets from _origin_ in units of _scale_.
+    Float origin[3], scale[3];
+    QuantizedType qBounds[2][3][N];
+    int offset[N];            // leaf: primitives offset, interior: node index
+    uint16_t nPrimitives[N];  // 0 -> interior child
+};
+
+// BVH Node Allocation Functions
+// Node arrays are large and traversal accesses them incoherently, so they
+// are allocated with huge pages if those are enabled. If geometry paging is
+// enabled, they are allocated from the pager instead; paged memory isn't
+// tracked since it isn't necessarily resident.
+static Allocator NodeAllocator(size_t bytes) {
+    if (PagedMemoryResource *pager = GeometryPager())
+        return Allocator(pager);
+    static MemoryTag *tag = MemoryTag::Get("Accelerators/BVH nodes and triangles");
+    return TrackedAllocator(tag, HugePageAllocator(Allocator(), bytes));
+}
+
+static Allocator ReplicaAllocator(size_t bytes) {
+    static MemoryTag *tag = MemoryTag::Get("Accelerators/BVH node replicas");
+    return TrackedAllocator(tag, HugePageAllocator(Allocator(), bytes));
+}
+
+// Returns the upstream resource for temporary allocations during BVH
+// construction.
+static pstd::pmr::memory_resource *BuildResource() {
+    static MemoryTag *tag = MemoryTag::Get("Accelerators/BVH construction");
+    return TrackedAllocator(tag).resource();
+}
+
+template <typename Node>
+static Node *AllocateNodes(size_t count) {
+    Node *nodes = NodeAllocator(count * sizeof(Node)).allocate_object<Node>(count);
+    std::uninitialized_default_construct_n(nodes, count);
+    return nodes;
+}
+
+// Each BVH paging region holds about this many bytes of nodes or triangles.
+static constexpr size_t bvhPagingRegionBytes = 64 * 1024;
+
 // BVHAggregate Method Definitions
 BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
-                           SplitMethod splitMethod)
+                           SplitMethod splitMethod, int width, int boundsBits,
+                           Float splitBudget, bool precomputeTriangles,
+                           NodeLayout nodeLayout)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       primitives(std::move(prims)),
-      splitMethod(splitMethod) {
+      splitMethod(splitMethod),
+      nodeLayout(nodeLayout),
+      width(width) {
     CHECK(!primitives.empty());
+    CHECK(width == 2 || width == 4 || width == 8);
+    CHECK(boundsBits == 8 || boundsBits == 16 || boundsBits == 32);
+    // When geometry is paged, intersect triangles using copies of their
+    // vertices that are paged along with the treelets that reference them,
+    // so that meshes are only accessed for the closest intersections.
+    if (GeometryPager())
+        precomputeTriangles = true;
     // Build BVH from _primitives_
     // Initialize _bvhPrimitives_ array for primitives
     std::vector<BVHPrimitive> bvhPrimitives(primitives.size());
     for (size_t i = 0; i < primitives.size(); ++i)
         bvhPrimitives[i] = BVHPrimitive(i, primitives[i].Bounds());
 
+    // Look for BVH in the cache if enabled
+    // BVH construction only depends on the primitive bounds and the build
+    // parameters, so together they identify the resulting tree.
+    std::string cacheFilename;
+    uint64_t cacheKey = 0;
+    if (!Options->bvhCacheDirectory.empty()) {
+        uint64_t boundsHash = HashBuffer(bvhPrimitives.data(),
+                                         bvhPrimitives.size() * sizeof(BVHPrimitive));
+        cacheKey = Hash(boundsHash, this->maxPrimsInNode, splitMethod, width, boundsBits,
+                        splitBudget, nodeLayout, BVHCacheHeader::Version);
+        cacheFilename = StringPrintf("%s/bvh-%016llx.bvhcache",
+                                     Options->bvhCacheDirectory,
+                                     (unsigned long long)cacheKey);
+        if (readCache(cacheFilename, cacheKey, boundsBits)) {
+            ++bvhCacheHits;
+            if (precomputeTriangles)
+                initTriangles();
+            replicateNodes();
+            initPaging();
+            return;
+        }
+        ++bvhCacheMisses;
+    }
+
     // Build BVH for primitives using _bvhPrimitives_
     // Declare _Allocator_s used for BVH construction
-    pstd::pmr::monotonic_buffer_resource resource;
+    pstd::pmr::monotonic_buffer_resource resource(BuildResource());
     Allocator alloc(&resource);
     using Resource = pstd::pmr::monotonic_buffer_resource;
     std::vector<std::unique_ptr<Resource>> threadBufferResources;
     ThreadLocal<Allocator> threadAllocators([&threadBufferResources]() {
-        threadBufferResources.push_back(std::make_unique<Resource>());
+        threadBufferResources.push_back(std::make_unique<Resource>(BuildResource()));
         auto ptr = threadBufferResources.back().get();
         return Allocator(ptr);
     });
@@ -167,26 +542,341 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
     std::atomic<int> totalNodes{0};
     if (splitMethod == SplitMethod::HLBVH) {
         root = buildHLBVH(alloc, bvhPrimitives, &totalNodes, orderedPrims);
+    } else if (splitMethod == SplitMethod::SBVH) {
+        // Allow spatial splits to add up to _splitBudget_ extra references
+        std::atomic<int64_t> referenceBudget{int64_t(splitBudget * primitives.size())};
+        orderedPrims.resize(primitives.size() + referenceBudget.load());
+        Bounds3f rootBounds;
+        for (const BVHPrimitive &prim : bvhPrimitives)
+            rootBounds = Union(rootBounds, prim.bounds);
+
+        std::atomic<int> orderedPrimsOffset{0};
+        root = buildSBVH(threadAllocators, std::move(bvhPrimitives),
+                         rootBounds.SurfaceArea(), 0, &totalNodes, &orderedPrimsOffset,
+                         &referenceBudget, orderedPrims);
+        orderedPrims.resize(orderedPrimsOffset.load());
+        orderedPrims.shrink_to_fit();
     } else {
         std::atomic<int> orderedPrimsOffset{0};
         root = buildRecursive(threadAllocators, pstd::span<BVHPrimitive>(bvhPrimitives),
                               &totalNodes, &orderedPrimsOffset, orderedPrims);
         CHECK_EQ(orderedPrimsOffset.load(), orderedPrims.size());
     }
+    // Record input primitive indices of reordered primitives for the cache
+    std::vector<uint32_t> primitiveIndices;
+    if (!cacheFilename.empty()) {
+        std::unordered_map<const void *, uint32_t> inputIndex;
+        for (size_t i = 0; i < primitives.size(); ++i)
+            inputIndex.insert({primitives[i].ptr(), uint32_t(i)});
+        primitiveIndices.resize(orderedPrims.size());
+        for (size_t i = 0; i < orderedPrims.size(); ++i)
+            primitiveIndices[i] = inputIndex[orderedPrims[i].ptr()];
+    }
+    size_t nInputPrimitives = primitives.size();
     primitives.swap(orderedPrims);
 
-    // Convert BVH into compact representation in _nodes_ array
+    bounds = root->bounds;
     bvhPrimitives.resize(0);
     bvhPrimitives.shrink_to_fit();
-    LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
-                totalNodes.load(), (int)primitives.size(),
-                float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
-    treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
-                 primitives.size() * sizeof(primitives[0]);
-    nodes = new LinearBVHNode[totalNodes];
-    int offset = 0;
-    flattenBVH(root, &offset);
-    CHECK_EQ(totalNodes.load(), offset);
+    if (boundsBits == 8) {
+        // Collapse BVH into nodes with 8-bit quantized child bounds
+        if (width == 2)
+            wideNodes = collapseBVH<QuantizedBVHNode<2, uint8_t>>(root);
+        else if (width == 4)
+            wideNodes = collapseBVH<QuantizedBVHNode<4, uint8_t>>(root);
+        else
+            wideNodes = collapseBVH<QuantizedBVHNode<8, uint8_t>>(root);
+    } else if (boundsBits == 16) {
+        // Collapse BVH into nodes with 16-bit quantized child bounds
+        if (width == 2)
+            wideNodes = collapseBVH<QuantizedBVHNode<2, uint16_t>>(root);
+        else if (width == 4)
+            wideNodes = collapseBVH<QuantizedBVHNode<4, uint16_t>>(root);
+        else
+            wideNodes = collapseBVH<QuantizedBVHNode<8, uint16_t>>(root);
+    } else if (width == 2) {
+        // Convert BVH into compact representation in _nodes_ array
+        LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
+                    totalNodes.load(), (int)primitives.size(),
+                    float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
+        treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+                     primitives.size() * sizeof(primitives[0]);
+        nodes = AllocateNodes<LinearBVHNode>(totalNodes);
+        nNodes = totalNodes;
+        int offset = 0;
+        flattenBVH(root, &offset);
+        CHECK_EQ(totalNodes.load(), offset);
+    } else if (width == 4)
+        wideNodes = collapseBVH<WideBVHNode<4>>(root);
+    else
+        wideNodes = collapseBVH<WideBVHNode<8>>(root);
+
+    if (!cacheFilename.empty())
+        writeCache(cacheFilename, cacheKey, boundsBits, nInputPrimitives,
+                   primitiveIndices);
+    if (precomputeTriangles)
+        initTriangles();
+    replicateNodes();
+    initPaging();
+}
+
+void BVHAggregate::initTriangles() {
+    // Copy vertices of unmasked triangles into _triangles_ in leaf order
+    triangles = AllocateNodes<PrecomputedTriangle>(primitives.size());
+    treeBytes += primitives.size() * sizeof(PrecomputedTriangle);
+    ParallelFor(0, primitives.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i) {
+            // Find _Triangle_ shape of primitive, if it has one
+            Shape shape;
+            if (const GeometricPrimitive *gp =
+                    primitives[i].CastOrNullptr<GeometricPrimitive>()) {
+                // Alpha-masked triangles require the full interaction
+                if (!gp->GetAlpha())
+                    shape = gp->GetShape();
+            } else if (const SimplePrimitive *sp =
+                           primitives[i].CastOrNullptr<SimplePrimitive>())
+                shape = sp->GetShape();
+
+            const Triangle *tri = shape ? shape.CastOrNullptr<Triangle>() : nullptr;
+            triangles[i].valid = tri != nullptr;
+            if (tri) {
+                pstd::array<Point3f, 3> p = tri->Vertices();
+                triangles[i].p0 = p[0];
+                triangles[i].p1 = p[1];
+                triangles[i].p2 = p[2];
+            }
+        }
+    });
+}
+
+void BVHAggregate::intersectLeaf(int offset, int nPrimitives, const Ray &ray,
+                                 Float *tMax, BVHClosestHit *hit) const {
+    if (pager && triangles)
+        touchTriangles(offset, nPrimitives);
+    for (int i = offset; i < offset + nPrimitives; ++i) {
+        if (triangles && triangles[i].valid) {
+            // Intersect ray with precomputed triangle and defer interaction
+            const PrecomputedTriangle &tri = triangles[i];
+            pstd::optional<TriangleIntersection> triIsect =
+                IntersectTriangle(ray, *tMax, tri.p0, tri.p1, tri.p2);
+            if (triIsect) {
+                hit->triangleIndex = i;
+                hit->triangleTMax = *tMax;
+                *tMax = triIsect->t;
+            }
+        } else {
+            // Check for intersection with primitive in BVH leaf
+            pstd::optional<ShapeIntersection> primSi = primitives[i].Intersect(ray, *tMax);
+            if (primSi) {
+                hit->si = primSi;
+                hit->triangleIndex = -1;
+                *tMax = primSi->tHit;
+            }
+        }
+    }
+}
+
+pstd::optional<ShapeIntersection> BVHAggregate::closestIntersection(
+    const Ray &ray, const BVHClosestHit &hit) const {
+    if (hit.triangleIndex == -1)
+        return hit.si;
+    // Compute interaction for closest precomputed triangle intersection
+    // Intersecting with the same _tMax_ as during traversal gives the
+    // same intersection, now with the full _SurfaceInteraction_.
+    pstd::optional<ShapeIntersection> si =
+        primitives[hit.triangleIndex].Intersect(ray, hit.triangleTMax);
+    DCHECK(si.has_value());
+    return si;
+}
+
+bool BVHAggregate::intersectPLeaf(int offset, int nPrimitives, const Ray &ray,
+                                  Float tMax) const {
+    if (pager && triangles)
+        touchTriangles(offset, nPrimitives);
+    for (int i = offset; i < offset + nPrimitives; ++i) {
+        if (triangles && triangles[i].valid) {
+            const PrecomputedTriangle &tri = triangles[i];
+            if (IntersectTriangle(ray, tMax, tri.p0, tri.p1, tri.p2))
+                return true;
+        } else if (primitives[i].IntersectP(ray, tMax))
+            return true;
+    }
+    return false;
+}
+
+bool BVHAggregate::readCache(const std::string &filename, uint64_t key,
+                             int boundsBits) {
+    if (!FileExists(filename))
+        return false;
+    // Map cache file into memory
+    const char *contents = nullptr;
+    size_t length = 0;
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || stat.st_size < (off_t)sizeof(BVHCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    length = stat.st_size;
+    void *ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        Warning("%s: %s", filename, ErrorString());
+        return false;
+    }
+    contents = (const char *)ptr;
+    auto release = [&]() { munmap(ptr, length); };
+#else
+    // Read the file into memory that is aligned for the wide node types
+    FILE *f = FOpenRead(filename);
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    Allocator alloc;
+    char *buf = (char *)alloc.allocate_bytes(std::max(length, sizeof(BVHCacheHeader)), 64);
+    bool readOk = fread(buf, 1, length, f) == length;
+    fclose(f);
+    contents = buf;
+    auto release = [&]() {
+        alloc.deallocate_bytes(buf, std::max(length, sizeof(BVHCacheHeader)), 64);
+    };
+    if (!readOk || length < sizeof(BVHCacheHeader)) {
+        release();
+        return false;
+    }
+#endif
+
+    // Validate cache file header
+    BVHCacheHeader header;
+    std::memcpy(&header, contents, sizeof(header));
+    if (std::memcmp(header.magic, BVHCacheHeader::Magic, sizeof(header.magic)) != 0 ||
+        header.version != BVHCacheHeader::Version || header.key != key ||
+        header.width != width || header.boundsBits != boundsBits ||
+        header.nInputPrimitives != primitives.size() || header.fileSize != length ||
+        header.nodesOffset % 64 != 0 ||
+        header.nodesOffset < sizeof(header) + header.nPrimitives * sizeof(uint32_t) ||
+        header.nodesOffset + header.nNodes * header.nodeSize != length) {
+        Warning("%s: ignoring invalid or stale BVH cache file.", filename);
+        release();
+        return false;
+    }
+
+    // Reorder _primitives_ using cached primitive indices
+    const uint32_t *primitiveIndices =
+        (const uint32_t *)(contents + sizeof(BVHCacheHeader));
+    std::vector<Primitive> orderedPrims(header.nPrimitives);
+    for (size_t i = 0; i < orderedPrims.size(); ++i) {
+        if (primitiveIndices[i] >= primitives.size()) {
+            Warning("%s: ignoring corrupt BVH cache file.", filename);
+            release();
+            return false;
+        }
+        orderedPrims[i] = primitives[primitiveIndices[i]];
+    }
+
+    // Use cached nodes in place
+    // The nodes are never written, so it is safe to cast away the constness
+    // of the read-only mapping.
+    void *nodePtr = const_cast<char *>(contents) + header.nodesOffset;
+    int nodeSize = 0;
+    if (boundsBits == 8) {
+        if (width == 2)
+            wideNodes = (QuantizedBVHNode<2, uint8_t> *)nodePtr;
+        else if (width == 4)
+            wideNodes = (QuantizedBVHNode<4, uint8_t> *)nodePtr;
+        else
+            wideNodes = (QuantizedBVHNode<8, uint8_t> *)nodePtr;
+    } else if (boundsBits == 16) {
+        if (width == 2)
+            wideNodes = (QuantizedBVHNode<2, uint16_t> *)nodePtr;
+        else if (width == 4)
+            wideNodes = (QuantizedBVHNode<4, uint16_t> *)nodePtr;
+        else
+            wideNodes = (QuantizedBVHNode<8, uint16_t> *)nodePtr;
+    } else if (width == 2) {
+        nodes = (LinearBVHNode *)nodePtr;
+        nodeSize = sizeof(LinearBVHNode);
+    } else if (width == 4)
+        wideNodes = (WideBVHNode<4> *)nodePtr;
+    else
+        wideNodes = (WideBVHNode<8> *)nodePtr;
+    if (wideNodes) {
+        auto size = [](auto ptr) { return int(sizeof(*ptr)); };
+        nodeSize = wideNodes.Dispatch(size);
+    }
+    if (header.nodeSize != nodeSize) {
+        Warning("%s: ignoring BVH cache file with mismatched node size.", filename);
+        nodes = nullptr;
+        wideNodes = nullptr;
+        release();
+        return false;
+    }
+
+    primitives.swap(orderedPrims);
+    bounds = header.bounds;
+    nNodes = header.nNodes;
+    LOG_VERBOSE("Loaded BVH with %d nodes for %d primitives from %s", nNodes,
+                (int)primitives.size(), filename);
+    treeBytes += sizeof(*this) + primitives.size() * sizeof(primitives[0]);
+    return true;
+}
+
+void BVHAggregate::writeCache(const std::string &filename, uint64_t key,
+                              int boundsBits, size_t nInputPrimitives,
+                              const std::vector<uint32_t> &primitiveIndices) const {
+    // Initialize _BVHCacheHeader_ for BVH
+    BVHCacheHeader header;
+    std::memcpy(header.magic, BVHCacheHeader::Magic, sizeof(header.magic));
+    header.version = BVHCacheHeader::Version;
+    header.width = width;
+    header.boundsBits = boundsBits;
+    const void *nodePtr = nodes;
+    header.nodeSize = sizeof(LinearBVHNode);
+    if (wideNodes) {
+        auto size = [](auto ptr) { return int(sizeof(*ptr)); };
+        header.nodeSize = wideNodes.Dispatch(size);
+        nodePtr = wideNodes.ptr();
+    }
+    header.key = key;
+    header.nInputPrimitives = nInputPrimitives;
+    header.nPrimitives = primitiveIndices.size();
+    header.nNodes = nNodes;
+    size_t indicesEnd = sizeof(header) + primitiveIndices.size() * sizeof(uint32_t);
+    header.nodesOffset = (indicesEnd + 63) & ~size_t(63);
+    header.fileSize = header.nodesOffset + header.nNodes * header.nodeSize;
+    header.bounds = bounds;
+
+    // Write cache to a temporary file and then move it into place
+    // Renaming makes the update atomic with respect to concurrent runs
+    // that may be reading the same cache file.
+    std::string tempFilename =
+        StringPrintf("%s.%d.tmp", filename,
+                     int64_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+    FILE *f = FOpenWrite(tempFilename);
+    if (!f) {
+        Warning("%s: %s", tempFilename, ErrorString());
+        return;
+    }
+    const char padding[64] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(primitiveIndices.data(), sizeof(uint32_t), primitiveIndices.size(),
+                     f) == primitiveIndices.size() &&
+              fwrite(padding, 1, header.nodesOffset - indicesEnd, f) ==
+                  header.nodesOffset - indicesEnd &&
+              fwrite(nodePtr, header.nodeSize, header.nNodes, f) == header.nNodes;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write BVH cache file: %s", filename, ErrorString());
+        RemoveFile(tempFilename);
+        return;
+    }
+    LOG_VERBOSE("Wrote BVH cache file %s (%.2f MB)", filename,
+                float(header.fileSize) / (1024.f * 1024.f));
 }
 
 BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocators,
@@ -200,9 +890,13 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
     // Initialize _BVHBuildNode_ for primitive range
     ++*totalNodes;
     // Compute bounds of all primitives in BVH node
-    Bounds3f bounds;
-    for (const auto &prim : bvhPrimitives)
-        bounds = Union(bounds, prim.bounds);
+    Bounds3f bounds, centroidBounds;
+    bool parallelBuild = bvhPrimitives.size() > parallelBuildThreshold;
+    if (parallelBuild)
+        ParallelComputeBounds(bvhPrimitives, &bounds, &centroidBounds);
+    else
+        for (const auto &prim : bvhPrimitives)
+            bounds = Union(bounds, prim.bounds);
 
     if (bounds.SurfaceArea() == 0 || bvhPrimitives.size() == 1) {
         // Create leaf _BVHBuildNode_
@@ -216,9 +910,9 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
 
     } else {
         // Compute bound of primitive centroids and choose split dimension _dim_
-        Bounds3f centroidBounds;
-        for (const auto &prim : bvhPrimitives)
-            centroidBounds = Union(centroidBounds, prim.Centroid());
+        if (!parallelBuild)
+            for (const auto &prim : bvhPrimitives)
+                centroidBounds = Union(centroidBounds, prim.Centroid());
         int dim = centroidBounds.MaxDimension();
 
         // Partition primitives into two sets and build children
@@ -239,15 +933,19 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
             case SplitMethod::Middle: {
                 // Partition primitives through node's midpoint
                 Float pmid = (centroidBounds.pMin[dim] + centroidBounds.pMax[dim]) / 2;
-                auto midIter = std::partition(bvhPrimitives.begin(), bvhPrimitives.end(),
-                                              [dim, pmid](const BVHPrimitive &pi) {
-                                                  return pi.Centroid()[dim] < pmid;
-                                              });
-                mid = midIter - bvhPrimitives.begin();
+                auto isBelow = [dim, pmid](const BVHPrimitive &pi) {
+                    return pi.Centroid()[dim] < pmid;
+                };
+                if (parallelBuild)
+                    mid = ParallelPartition(bvhPrimitives, isBelow);
+                else
+                    mid = std::partition(bvhPrimitives.begin(), bvhPrimitives.end(),
+                                         isBelow) -
+                          bvhPrimitives.begin();
                 // For lots of prims with large overlapping bounding boxes, this
                 // may fail to partition; in that case do not break and fall through
                 // to EqualCounts.
-                if (midIter != bvhPrimitives.begin() && midIter != bvhPrimitives.end())
+                if (mid != 0 && mid != bvhPrimitives.size())
                     break;
             }
             case SplitMethod::EqualCounts: {
@@ -279,15 +977,22 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
                     BVHSplitBucket buckets[nBuckets];
 
                     // Initialize _BVHSplitBucket_ for SAH partition buckets
-                    for (const auto &prim : bvhPrimitives) {
+                    auto bucketIndex = [=](const BVHPrimitive &prim) {
                         int b = nBuckets * centroidBounds.Offset(prim.Centroid())[dim];
                         if (b == nBuckets)
                             b = nBuckets - 1;
                         DCHECK_GE(b, 0);
                         DCHECK_LT(b, nBuckets);
-                        buckets[b].count++;
-                        buckets[b].bounds = Union(buckets[b].bounds, prim.bounds);
-                    }
+                        return b;
+                    };
+                    if (parallelBuild)
+                        ParallelInitBuckets<nBuckets>(bvhPrimitives, buckets, bucketIndex);
+                    else
+                        for (const auto &prim : bvhPrimitives) {
+                            int b = bucketIndex(prim);
+                            buckets[b].count++;
+                            buckets[b].bounds = Union(buckets[b].bounds, prim.bounds);
+                        }
 
                     // Compute costs for splitting after each bucket
                     constexpr int nSplits = nBuckets - 1;
@@ -327,16 +1032,15 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
 
                     // Either create leaf or split primitives at selected SAH bucket
                     if (bvhPrimitives.size() > maxPrimsInNode || minCost < leafCost) {
-                        auto midIter = std::partition(
-                            bvhPrimitives.begin(), bvhPrimitives.end(),
-                            [=](const BVHPrimitive &bp) {
-                                int b =
-                                    nBuckets * centroidBounds.Offset(bp.Centroid())[dim];
-                                if (b == nBuckets)
-                                    b = nBuckets - 1;
-                                return b <= minCostSplitBucket;
-                            });
-                        mid = midIter - bvhPrimitives.begin();
+                        auto isBelow = [=](const BVHPrimitive &bp) {
+                            return bucketIndex(bp) <= minCostSplitBucket;
+                        };
+                        if (parallelBuild)
+                            mid = ParallelPartition(bvhPrimitives, isBelow);
+                        else
+                            mid = std::partition(bvhPrimitives.begin(),
+                                                 bvhPrimitives.end(), isBelow) -
+                                  bvhPrimitives.begin();
                     } else {
                         // Create leaf _BVHBuildNode_
                         int firstPrimOffset =
@@ -386,6 +1090,250 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
     return node;
 }
 
+BVHBuildNode *BVHAggregate::buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                                      std::vector<BVHPrimitive> references,
+                                      Float rootSurfaceArea, int depth,
+                                      std::atomic<int> *totalNodes,
+                                      std::atomic<int> *orderedPrimsOffset,
+                                      std::atomic<int64_t> *referenceBudget,
+                                      std::vector<Primitive> &orderedPrims) {
+    DCHECK(!references.empty());
+    Allocator alloc = threadAllocators.Get();
+    BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
+    ++*totalNodes;
+    // Compute bounds of references and their centroids
+    Bounds3f bounds, centroidBounds;
+    for (const BVHPrimitive &ref : references) {
+        bounds = Union(bounds, ref.bounds);
+        centroidBounds = Union(centroidBounds, ref.Centroid());
+    }
+
+    auto createLeaf = [&]() {
+        int firstPrimOffset = orderedPrimsOffset->fetch_add(references.size());
+        for (size_t i = 0; i < references.size(); ++i)
+            orderedPrims[firstPrimOffset + i] = primitives[references[i].primitiveIndex];
+        node->InitLeaf(firstPrimOffset, references.size(), bounds);
+        return node;
+    };
+    // Limit depth so that the traversal stacks cannot overflow
+    constexpr int maxDepth = 48;
+    if (references.size() == 1 || bounds.SurfaceArea() == 0 || depth == maxDepth)
+        return createLeaf();
+
+    // Find best object split along the largest centroid dimension
+    constexpr int nBuckets = 12, nSplits = nBuckets - 1;
+    int objectDim = centroidBounds.MaxDimension();
+    Float objectCost = Infinity;
+    int objectSplitBucket = -1;
+    Bounds3f objectBounds[2];
+    auto objectBucket = [&](const BVHPrimitive &ref) {
+        int b = nBuckets * centroidBounds.Offset(ref.Centroid())[objectDim];
+        return std::min(b, nBuckets - 1);
+    };
+    if (centroidBounds.pMax[objectDim] > centroidBounds.pMin[objectDim]) {
+        BVHSplitBucket buckets[nBuckets];
+        for (const BVHPrimitive &ref : references) {
+            int b = objectBucket(ref);
+            buckets[b].count++;
+            buckets[b].bounds = Union(buckets[b].bounds, ref.bounds);
+        }
+        // Compute bounds below each split with a forward scan
+        Bounds3f boundsBelow[nSplits];
+        int countsBelow[nSplits];
+        for (int i = 0; i < nSplits; ++i) {
+            boundsBelow[i] = Union(i > 0 ? boundsBelow[i - 1] : Bounds3f(), buckets[i].bounds);
+            countsBelow[i] = (i > 0 ? countsBelow[i - 1] : 0) + buckets[i].count;
+        }
+        // Evaluate SAH costs with a backward scan and record the cheapest split
+        int countAbove = 0;
+        Bounds3f boundAbove;
+        for (int i = nSplits; i >= 1; --i) {
+            boundAbove = Union(boundAbove, buckets[i].bounds);
+            countAbove += buckets[i].count;
+            if (countsBelow[i - 1] == 0 || countAbove == 0)
+                continue;
+            Float cost = countsBelow[i - 1] * boundsBelow[i - 1].SurfaceArea() +
+                         countAbove * boundAbove.SurfaceArea();
+            if (cost < objectCost) {
+                objectCost = cost;
+                objectSplitBucket = i - 1;
+                objectBounds[0] = boundsBelow[i - 1];
+                objectBounds[1] = boundAbove;
+            }
+        }
+    }
+
+    // Find best spatial split if object split children overlap substantially
+    constexpr Float spatialSplitAlpha = 1e-5f;
+    Float spatialCost = Infinity;
+    int spatialDim = bounds.MaxDimension(), spatialSplitBin = -1;
+    Float binWidth = (bounds.pMax[spatialDim] - bounds.pMin[spatialDim]) / nBuckets;
+    auto binPlane = [&](int b) {
+        return b == nBuckets ? bounds.pMax[spatialDim]
+                             : bounds.pMin[spatialDim] + b * binWidth;
+    };
+    auto spatialBin = [&](Float v) {
+        int b = (v - bounds.pMin[spatialDim]) / binWidth;
+        return Clamp(b, 0, nBuckets - 1);
+    };
+    Bounds3f overlap = pbrt::Intersect(objectBounds[0], objectBounds[1]);
+    Float overlapArea = overlap.IsDegenerate() ? 0 : overlap.SurfaceArea();
+    if (referenceBudget->load(std::memory_order_relaxed) > 0 && binWidth > 0 &&
+        (objectSplitBucket == -1 || overlapArea > spatialSplitAlpha * rootSurfaceArea)) {
+        // Chop reference bounds into spatial bins along _spatialDim_
+        struct SpatialBin {
+            Bounds3f bounds;
+            int entries = 0, exits = 0;
+        };
+        SpatialBin bins[nBuckets];
+        for (const BVHPrimitive &ref : references) {
+            int firstBin = spatialBin(ref.bounds.pMin[spatialDim]);
+            int lastBin = spatialBin(ref.bounds.pMax[spatialDim]);
+            for (int b = firstBin; b <= lastBin; ++b) {
+                Bounds3f clipped = ref.bounds;
+                clipped.pMin[spatialDim] = std::max(clipped.pMin[spatialDim], binPlane(b));
+                clipped.pMax[spatialDim] =
+                    std::min(clipped.pMax[spatialDim], binPlane(b + 1));
+                bins[b].bounds = Union(bins[b].bounds, clipped);
+            }
+            ++bins[firstBin].entries;
+            ++bins[lastBin].exits;
+        }
+
+        // Evaluate SAH cost of splitting at each bin boundary
+        Bounds3f boundsBelow[nSplits];
+        int countsBelow[nSplits];
+        for (int i = 0; i < nSplits; ++i) {
+            boundsBelow[i] = Union(i > 0 ? boundsBelow[i - 1] : Bounds3f(), bins[i].bounds);
+            countsBelow[i] = (i > 0 ? countsBelow[i - 1] : 0) + bins[i].entries;
+        }
+        int countAbove = 0;
+        Bounds3f boundAbove;
+        for (int i = nSplits; i >= 1; --i) {
+            boundAbove = Union(boundAbove, bins[i].bounds);
+            countAbove += bins[i].exits;
+            if (countsBelow[i - 1] == 0 || countAbove == 0)
+                continue;
+            Float cost = countsBelow[i - 1] * boundsBelow[i - 1].SurfaceArea() +
+                         countAbove * boundAbove.SurfaceArea();
+            if (cost < spatialCost) {
+                spatialCost = cost;
+                spatialSplitBin = i - 1;
+            }
+        }
+    }
+
+    // Create leaf if splitting is not worthwhile
+    Float minCost = std::min(objectCost, spatialCost);
+    Float leafCost = references.size();
+    Float splitCost = 1.f / 2.f + minCost / bounds.SurfaceArea();
+    if (minCost == Infinity ||
+        (references.size() <= maxPrimsInNode && splitCost >= leafCost))
+        return createLeaf();
+
+    std::vector<BVHPrimitive> childReferences[2];
+    int dim = objectDim;
+    if (spatialCost < objectCost) {
+        // Partition references at spatial split plane, duplicating straddlers
+        Float plane = binPlane(spatialSplitBin + 1);
+        Bounds3f childBounds[2];
+        int childCounts[2] = {0, 0};
+        for (const BVHPrimitive &ref : references) {
+            if (ref.bounds.pMax[spatialDim] <= plane) {
+                childBounds[0] = Union(childBounds[0], ref.bounds);
+                ++childCounts[0];
+            } else if (ref.bounds.pMin[spatialDim] >= plane) {
+                childBounds[1] = Union(childBounds[1], ref.bounds);
+                ++childCounts[1];
+            }
+        }
+        for (const BVHPrimitive &ref : references) {
+            if (ref.bounds.pMax[spatialDim] <= plane)
+                childReferences[0].push_back(ref);
+            else if (ref.bounds.pMin[spatialDim] >= plane)
+                childReferences[1].push_back(ref);
+            else {
+                // Either unsplit straddling reference or split it at _plane_
+                BVHPrimitive below = ref, above = ref;
+                below.bounds.pMax[spatialDim] = above.bounds.pMin[spatialDim] = plane;
+                Float costSplit =
+                    Union(childBounds[0], below.bounds).SurfaceArea() *
+                        (childCounts[0] + 1) +
+                    Union(childBounds[1], above.bounds).SurfaceArea() * (childCounts[1] + 1);
+                Float costBelow =
+                    Union(childBounds[0], ref.bounds).SurfaceArea() * (childCounts[0] + 1) +
+                    childBounds[1].SurfaceArea() * childCounts[1];
+                Float costAbove =
+                    childBounds[0].SurfaceArea() * childCounts[0] +
+                    Union(childBounds[1], ref.bounds).SurfaceArea() * (childCounts[1] + 1);
+                if (costBelow <= costSplit && costBelow <= costAbove) {
+                    childReferences[0].push_back(ref);
+                    childBounds[0] = Union(childBounds[0], ref.bounds);
+                    ++childCounts[0];
+                } else if (costAbove <= costSplit) {
+                    childReferences[1].push_back(ref);
+                    childBounds[1] = Union(childBounds[1], ref.bounds);
+                    ++childCounts[1];
+                } else {
+                    childReferences[0].push_back(below);
+                    childReferences[1].push_back(above);
+                    childBounds[0] = Union(childBounds[0], below.bounds);
+                    childBounds[1] = Union(childBounds[1], above.bounds);
+                    ++childCounts[0];
+                    ++childCounts[1];
+                }
+            }
+        }
+
+        // Accept spatial split if it makes progress and fits in the budget
+        int64_t nDuplicated = int64_t(childReferences[0].size() +
+                                      childReferences[1].size()) - references.size();
+        bool accepted = !childReferences[0].empty() && !childReferences[1].empty() &&
+                        childReferences[0].size() < references.size() &&
+                        childReferences[1].size() < references.size();
+        if (accepted && nDuplicated > 0) {
+            if (referenceBudget->fetch_sub(nDuplicated) < nDuplicated) {
+                *referenceBudget += nDuplicated;
+                accepted = false;
+            }
+        }
+        if (accepted) {
+            ++spatialSplits;
+            duplicatedReferences += nDuplicated;
+            dim = spatialDim;
+        } else {
+            childReferences[0].clear();
+            childReferences[1].clear();
+            if (objectSplitBucket == -1)
+                return createLeaf();
+        }
+    }
+
+    if (childReferences[0].empty()) {
+        // Partition references using object split
+        for (const BVHPrimitive &ref : references)
+            childReferences[objectBucket(ref) <= objectSplitBucket ? 0 : 1].push_back(ref);
+    }
+    references.clear();
+    references.shrink_to_fit();
+
+    // Recursively build children
+    BVHBuildNode *children[2];
+    auto buildChild = [&](int i) {
+        children[i] = buildSBVH(threadAllocators, std::move(childReferences[i]),
+                                rootSurfaceArea, depth + 1, totalNodes,
+                                orderedPrimsOffset, referenceBudget, orderedPrims);
+    };
+    if (childReferences[0].size() + childReferences[1].size() > 128 * 1024)
+        ParallelFor(0, 2, buildChild);
+    else {
+        buildChild(0);
+        buildChild(1);
+    }
+    node->InitInterior(dim, children[0], children[1]);
+    return node;
+}
+
 BVHBuildNode *BVHAggregate::buildHLBVH(Allocator alloc,
                                        const std::vector<BVHPrimitive> &bvhPrimitives,
                                        std::atomic<int> *totalNodes,
@@ -521,38 +1469,313 @@ int BVHAggregate::flattenBVH(BVHBuildNode *node, int *offset) {
     return nodeOffset;
 }
 
+// Returns _nodes_ reordered so that each page-sized block of nodes holds a
+// treelet: a node and its nearest descendants in breadth-first order.
+// Child offsets are updated to refer to the new node positions.
+template <typename Node>
+static std::vector<Node> TreeletOrder(const std::vector<Node> &nodes) {
+    constexpr int N = Node::Width;
+    constexpr size_t nodesPerTreelet = std::max<size_t>(1, 4096 / sizeof(Node));
+    std::vector<Node> ordered;
+    ordered.reserve(nodes.size());
+    std::vector<int> newOffset(nodes.size(), -1);
+    std::vector<int> treeletRoots = {0};
+    std::vector<int> treelet;
+    while (!treeletRoots.empty()) {
+        // Gather nodes of treelet rooted at next treelet root
+        treelet.clear();
+        treelet.push_back(treeletRoots.back());
+        treeletRoots.pop_back();
+        size_t firstRoot = treeletRoots.size();
+        for (size_t i = 0; i < treelet.size(); ++i) {
+            const Node &node = nodes[treelet[i]];
+            for (int c = 0; c < N; ++c) {
+                if (node.offset[c] < 0 || node.nPrimitives[c] > 0)
+                    continue;
+                // Add interior child to treelet or start a new treelet there
+                if (treelet.size() < nodesPerTreelet)
+                    treelet.push_back(node.offset[c]);
+                else
+                    treeletRoots.push_back(node.offset[c]);
+            }
+        }
+        // Visit child treelets in depth-first order
+        std::reverse(treeletRoots.begin() + firstRoot, treeletRoots.end());
+
+        for (int nodeIndex : treelet) {
+            newOffset[nodeIndex] = ordered.size();
+            ordered.push_back(nodes[nodeIndex]);
+        }
+    }
+    CHECK_EQ(ordered.size(), nodes.size());
+
+    // Update interior child offsets for new node order
+    for (Node &node : ordered)
+        for (int c = 0; c < N; ++c)
+            if (node.offset[c] >= 0 && node.nPrimitives[c] == 0)
+                node.offset[c] = newOffset[node.offset[c]];
+    return ordered;
+}
+
+template <typename Node>
+Node *BVHAggregate::collapseBVH(BVHBuildNode *root) {
+    // Collapse binary BVH into _Node::Width_-wide nodes
+    std::vector<Node> wide;
+    flattenWideBVH(root, wide);
+    if (nodeLayout == NodeLayout::Treelet)
+        wide = TreeletOrder(wide);
+    LOG_VERBOSE("%d-wide BVH created with %d nodes for %d primitives (%.2f MB)",
+                Node::Width, (int)wide.size(), (int)primitives.size(),
+                float(wide.size() * sizeof(Node)) / (1024.f * 1024.f));
+    treeBytes += wide.size() * sizeof(Node) + sizeof(*this) +
+                 primitives.size() * sizeof(primitives[0]);
+    nNodes = wide.size();
+    Node *wideNodes = AllocateNodes<Node>(wide.size());
+    std::copy(wide.begin(), wide.end(), wideNodes);
+    return wideNodes;
+}
+
+template <typename Node>
+int BVHAggregate::flattenWideBVH(BVHBuildNode *node, std::vector<Node> &wideNodes) {
+    // Collapse binary subtree at _node_ into at most _Node::Width_ children
+    constexpr int N = Node::Width;
+    BVHBuildNode *children[N];
+    int nChildren = 0;
+    if (node->nPrimitives > 0)
+        children[nChildren++] = node;
+    else {
+        children[nChildren++] = node->children[0];
+        children[nChildren++] = node->children[1];
+    }
+    while (nChildren < N) {
+        // Replace the interior child with the largest surface area by its children
+        int openChild = -1;
+        Float maxArea = -1;
+        for (int i = 0; i < nChildren; ++i)
+            if (children[i]->nPrimitives == 0 &&
+                children[i]->bounds.SurfaceArea() > maxArea) {
+                openChild = i;
+                maxArea = children[i]->bounds.SurfaceArea();
+            }
+        if (openChild == -1)
+            break;
+        BVHBuildNode *open = children[openChild];
+        children[openChild] = open->children[0];
+        children[nChildren++] = open->children[1];
+    }
+
+    // Initialize wide node for collapsed children and flatten interior children
+    int nodeOffset = wideNodes.size();
+    wideNodes.push_back(Node(node->bounds));
+    for (int i = 0; i < nChildren; ++i) {
+        wideNodes[nodeOffset].SetChildBounds(i, children[i]->bounds);
+        if (children[i]->nPrimitives > 0) {
+            CHECK_LT(children[i]->nPrimitives, 65536);
+            wideNodes[nodeOffset].offset[i] = children[i]->firstPrimOffset;
+            wideNodes[nodeOffset].nPrimitives[i] = children[i]->nPrimitives;
+        } else {
+            // Note that _wideNodes_ may be reallocated by the recursive call
+            int childOffset = flattenWideBVH(children[i], wideNodes);
+            wideNodes[nodeOffset].offset[i] = childOffset;
+        }
+    }
+    return nodeOffset;
+}
+
+void BVHAggregate::replicateNodes() {
+    // Replicas would always be resident, so don't make them if paging
+    if (GeometryPager())
+        return;
+    // Copy BVH nodes to each NUMA node's memory
+    if (wideNodes) {
+        auto replicate = [&](auto wide) {
+            using Node = typename std::remove_pointer_t<decltype(wide)>;
+            Allocator alloc = ReplicaAllocator(nNodes * sizeof(Node));
+            for (auto replica : NUMAReplicate(wide, nNodes, alloc))
+                wideNodeReplicas.push_back(replica);
+            return wideNodeReplicas.size() * nNodes * sizeof(*wide);
+        };
+        treeBytes += wideNodes.Dispatch(replicate);
+    } else {
+        Allocator alloc = ReplicaAllocator(nNodes * sizeof(LinearBVHNode));
+        nodeReplicas = NUMAReplicate(nodes, nNodes, alloc);
+        treeBytes += nodeReplicas.size() * nNodes * sizeof(LinearBVHNode);
+    }
+}
+
+void BVHAggregate::initPaging() {
+    pager = GeometryPager();
+    if (!pager)
+        return;
+    // Divide nodes and precomputed triangles into paging regions
+    // Both node layouts mostly store the nodes of subtrees and treelets
+    // contiguously, so each region holds a group of nearby treelets; the
+    // triangles are stored in the same order as the leaves that use them.
+    auto addRegions = [&](const void *ptr, size_t count, size_t size,
+                          std::vector<int> *regions) {
+        size_t perRegion = std::max<size_t>(1, bvhPagingRegionBytes / size);
+        for (size_t i = 0; i < count; i += perRegion) {
+            regions->push_back(pager->AddRegion());
+            pager->AddToRegion(regions->back(), (const char *)ptr + i * size,
+                               std::min(perRegion, count - i) * size);
+        }
+        return int(perRegion);
+    };
+    if (wideNodes) {
+        auto add = [&](auto wide) {
+            return addRegions(wide, nNodes, sizeof(*wide), &nodeRegions);
+        };
+        nodesPerRegion = wideNodes.Dispatch(add);
+    } else
+        nodesPerRegion = addRegions(nodes, nNodes, sizeof(LinearBVHNode), &nodeRegions);
+    if (triangles)
+        trianglesPerRegion = addRegions(triangles, primitives.size(),
+                                        sizeof(PrecomputedTriangle), &triangleRegions);
+}
+
+// Ray traffic to nodes is recorded when traversal moves into a different
+// paging region; _region_ holds the region of the previously-visited node.
+void BVHAggregate::touchNode(int nodeIndex, int *region) const {
+    int r = nodeIndex / nodesPerRegion;
+    if (r != *region) {
+        pager->Touch(nodeRegions[r]);
+        *region = r;
+    }
+}
+
+void BVHAggregate::touchTriangles(int offset, int nPrimitives) const {
+    int first = offset / trianglesPerRegion;
+    int last = (offset + nPrimitives - 1) / trianglesPerRegion;
+    for (int r = first; r <= last; ++r)
+        pager->Touch(triangleRegions[r]);
+}
+
 Bounds3f BVHAggregate::Bounds() const {
-    CHECK(nodes);
-    return nodes[0].bounds;
+    CHECK(nodes || wideNodes);
+    return bounds;
+}
+
+template <typename Node>
+pstd::optional<ShapeIntersection> BVHAggregate::intersectWide(const Node *wideNodes,
+                                                              const Ray &ray,
+                                                              Float tMax) const {
+    constexpr int N = Node::Width;
+    BVHClosestHit hit;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    // Follow ray through wide BVH nodes to find primitive intersections
+    struct ChildToVisit {
+        int offset, nPrimitives;
+        Float tNear;
+    };
+    ChildToVisit toVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = ChildToVisit{0, 0, 0};
+    int nodesVisited = 0, nodeRegion = -1;
+    while (toVisitOffset > 0) {
+        ChildToVisit child = toVisit[--toVisitOffset];
+        // Skip child if a closer intersection has already been found
+        if (child.tNear > tMax)
+            continue;
+
+        if (child.nPrimitives > 0)
+            // Intersect ray with primitives in leaf BVH child
+            intersectLeaf(child.offset, child.nPrimitives, ray, &tMax, &hit);
+        else {
+            // Check ray against all of the interior node's children
+            ++nodesVisited;
+            if (pager)
+                touchNode(child.offset, &nodeRegion);
+            const Node &node = wideNodes[child.offset];
+            Float tNear[N];
+            int hitMask = node.IntersectP(ray.o, tMax, invDir, dirIsNeg, tNear);
+
+            // Push hit children so that the nearest one is visited first
+            int first = toVisitOffset;
+            for (int i = 0; i < N; ++i) {
+                if (!(hitMask & (1 << i)))
+                    continue;
+                ChildToVisit c{node.offset[i], node.nPrimitives[i], tNear[i]};
+                int j = toVisitOffset++;
+                for (; j > first && toVisit[j - 1].tNear < c.tNear; --j)
+                    toVisit[j] = toVisit[j - 1];
+                toVisit[j] = c;
+            }
+        }
+    }
+
+    bvhNodesVisited += nodesVisited;
+    return closestIntersection(ray, hit);
+}
+
+template <typename Node>
+bool BVHAggregate::intersectPWide(const Node *wideNodes, const Ray &ray,
+                                  Float tMax) const {
+    constexpr int N = Node::Width;
+    Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
+                       static_cast<int>(invDir.z < 0)};
+    int nodesToVisit[64 * (N - 1)];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesVisited = 0, nodeRegion = -1;
+
+    while (true) {
+        ++nodesVisited;
+        if (pager)
+            touchNode(currentNodeIndex, &nodeRegion);
+        const Node &node = wideNodes[currentNodeIndex];
+        Float tNear[N];
+        int hitMask = node.IntersectP(ray.o, tMax, invDir, dirIsNeg, tNear);
+        for (int i = 0; i < N; ++i) {
+            if (!(hitMask & (1 << i)))
+                continue;
+            if (node.nPrimitives[i] > 0) {
+                if (intersectPLeaf(node.offset[i], node.nPrimitives[i], ray, tMax)) {
+                    bvhNodesVisited += nodesVisited;
+                    return true;
+                }
+            } else
+                nodesToVisit[toVisitOffset++] = node.offset[i];
+        }
+        if (toVisitOffset == 0)
+            break;
+        currentNodeIndex = nodesToVisit[--toVisitOffset];
+    }
+    bvhNodesVisited += nodesVisited;
+    return false;
 }
 
 pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
                                                           Float tMax) const {
+    // Use this thread's NUMA node's replica of the BVH nodes if there is one
+    if (wideNodes) {
+        auto intersect = [&](auto wide) { return intersectWide(wide, ray, tMax); };
+        if (!wideNodeReplicas.empty())
+            return wideNodeReplicas[CurrentNUMANode()].Dispatch(intersect);
+        return wideNodes.Dispatch(intersect);
+    }
     if (!nodes)
         return {};
-    pstd::optional<ShapeIntersection> si;
+    const LinearBVHNode *bvhNodes =
+        nodeReplicas.empty() ? nodes : nodeReplicas[CurrentNUMANode()];
+    BVHClosestHit hit;
     Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
     int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
     // Follow ray through BVH nodes to find primitive intersections
     int toVisitOffset = 0, currentNodeIndex = 0;
     int nodesToVisit[64];
-    int nodesVisited = 0;
+    int nodesVisited = 0, nodeRegion = -1;
     while (true) {
         ++nodesVisited;
-        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (pager)
+            touchNode(currentNodeIndex, &nodeRegion);
+        const LinearBVHNode *node = &bvhNodes[currentNodeIndex];
         // Check ray against BVH node
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
                 // Intersect ray with primitives in leaf BVH node
-                for (int i = 0; i < node->nPrimitives; ++i) {
-                    // Check for intersection with primitive in BVH node
-                    pstd::optional<ShapeIntersection> primSi =
-                        primitives[node->primitivesOffset + i].Intersect(ray, tMax);
-                    if (primSi) {
-                        si = primSi;
-                        tMax = si->tHit;
-                    }
-                }
+                intersectLeaf(node->primitivesOffset, node->nPrimitives, ray, &tMax,
+                              &hit);
                 if (toVisitOffset == 0)
                     break;
                 currentNodeIndex = nodesToVisit[--toVisitOffset];
@@ -575,30 +1798,38 @@ pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
     }
 
     bvhNodesVisited += nodesVisited;
-    return si;
+    return closestIntersection(ray, hit);
 }
 
 bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
+    if (wideNodes) {
+        auto intersectP = [&](auto wide) { return intersectPWide(wide, ray, tMax); };
+        if (!wideNodeReplicas.empty())
+            return wideNodeReplicas[CurrentNUMANode()].Dispatch(intersectP);
+        return wideNodes.Dispatch(intersectP);
+    }
     if (!nodes)
         return false;
+    const LinearBVHNode *bvhNodes =
+        nodeReplicas.empty() ? nodes : nodeReplicas[CurrentNUMANode()];
     Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
     int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
                        static_cast<int>(invDir.z < 0)};
     int nodesToVisit[64];
     int toVisitOffset = 0, currentNodeIndex = 0;
-    int nodesVisited = 0;
+    int nodesVisited = 0, nodeRegion = -1;
 
     while (true) {
         ++nodesVisited;
-        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (pager)
+            touchNode(currentNodeIndex, &nodeRegion);
+        const LinearBVHNode *node = &bvhNodes[currentNodeIndex];
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             // Process BVH node _node_ for traversal
             if (node->nPrimitives > 0) {
-                for (int i = 0; i < node->nPrimitives; ++i) {
-                    if (primitives[node->primitivesOffset + i].IntersectP(ray, tMax)) {
-                        bvhNodesVisited += nodesVisited;
-                        return true;
-                    }
+                if (intersectPLeaf(node->primitivesOffset, node->nPrimitives, ray, tMax)) {
+                    bvhNodesVisited += nodesVisited;
+                    return true;
                 }
                 if (toVisitOffset == 0)
                     break;
@@ -734,13 +1965,47 @@ BVHAggregate *BVHAggregate::Create(std::vector<Primitive> prims,
         splitMethod = BVHAggregate::SplitMethod::Middle;
     else if (splitMethodName == "equal")
         splitMethod = BVHAggregate::SplitMethod::EqualCounts;
+    else if (splitMethodName == "sbvh")
+        splitMethod = BVHAggregate::SplitMethod::SBVH;
     else {
         Warning(R"(BVH split method "%s" unknown.  Using "sah".)", splitMethodName);
         splitMethod = BVHAggregate::SplitMethod::SAH;
     }
 
     int maxPrimsInNode = parameters.GetOneInt("maxnodeprims", 4);
-    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod);
+    int width = parameters.GetOneInt("width", 2);
+    if (width != 2 && width != 4 && width != 8) {
+        Warning("BVH width %d unsupported; must be 2, 4, or 8. Using 2.", width);
+        width = 2;
+    }
+    int boundsBits = parameters.GetOneInt("boundsbits", 32);
+    if (boundsBits != 8 && boundsBits != 16 && boundsBits != 32) {
+        Warning("BVH boundsbits %d unsupported; must be 8, 16, or 32. Using 32.",
+                boundsBits);
+        boundsBits = 32;
+    }
+    Float splitBudget = parameters.GetOneFloat("splitbudget", 0.3f);
+    if (splitBudget < 0) {
+        Warning("BVH splitbudget %f must be non-negative. Using 0.", splitBudget);
+        splitBudget = 0;
+    }
+    bool precomputeTriangles = parameters.GetOneBool("precomputetriangles", false);
+
+    std::string nodeLayoutName = parameters.GetOneString("nodelayout", "depthfirst");
+    BVHAggregate::NodeLayout nodeLayout = BVHAggregate::NodeLayout::DepthFirst;
+    if (nodeLayoutName == "treelet") {
+        // The binary node format implicitly stores the first child after its
+        // parent, so only the formats with explicit child offsets can be reordered
+        if (width == 2 && boundsBits == 32)
+            Warning(R"(BVH node layout "treelet" requires "width" 4 or 8 or )"
+                    R"("boundsbits" 8 or 16. Using "depthfirst".)");
+        else
+            nodeLayout = BVHAggregate::NodeLayout::Treelet;
+    } else if (nodeLayoutName != "depthfirst")
+        Warning(R"(BVH node layout "%s" unknown.  Using "depthfirst".)", nodeLayoutName);
+
+    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod, width,
+                            boundsBits, splitBudget, precomputeTriangles, nodeLayout);
 }
 
 // KdNodeToVisit Definition
@@ -794,6 +2059,64 @@ struct BoundEdge {
 
 STAT_PIXEL_COUNTER("Kd-Tree/Nodes visited", kdNodesVisited);
 
+// KdSubtree Definition
+// Nodes and leaf primitive indices of a kd-tree or a subtree under
+// construction; node indices are relative to the subtree's root.
+struct KdSubtree {
+    std::vector<KdTreeNode> nodes;
+    std::vector<int> primitiveIndices;
+};
+
+// Kd-tree nodes with more primitives than this are built in parallel
+static constexpr size_t kdParallelBuildThreshold = 64 * 1024;
+
+// Appends _subtree_ to the end of _tree_, updating its node and primitive
+// index offsets
+static void AppendKdSubtree(KdSubtree *tree, const KdSubtree &subtree) {
+    int nodeOffset = tree->nodes.size();
+    int indexOffset = tree->primitiveIndices.size();
+    for (KdTreeNode node : subtree.nodes) {
+        if (!node.IsLeaf())
+            node.InitInterior(node.SplitAxis(), node.AboveChild() + nodeOffset,
+                              node.SplitPos());
+        else if (node.nPrimitives() > 1)
+            node.primitiveIndicesOffset += indexOffset;
+        tree->nodes.push_back(node);
+    }
+    tree->primitiveIndices.insert(tree->primitiveIndices.end(),
+                                  subtree.primitiveIndices.begin(),
+                                  subtree.primitiveIndices.end());
+}
+
+// Sorts _edges_ by sorting chunks in parallel and then merging them pairwise
+template <typename Compare>
+static void ParallelSort(pstd::span<BoundEdge> edges, Compare comp) {
+    int64_t nChunks = std::min<int64_t>(RoundUpPow2(RunningThreads()) * 4, 256);
+    int64_t chunkSize = (edges.size() + nChunks - 1) / nChunks;
+    auto chunkStart = [&](int64_t chunk) {
+        return std::min<int64_t>(chunk * chunkSize, edges.size());
+    };
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        std::sort(edges.begin() + chunkStart(chunk), edges.begin() + chunkStart(chunk + 1),
+                  comp);
+    });
+
+    std::vector<BoundEdge> buffer(edges.size());
+    BoundEdge *src = edges.data(), *dst = buffer.data();
+    for (int64_t width = 1; width < nChunks; width *= 2) {
+        // Merge pairs of sorted runs of _width_ chunks from _src_ into _dst_
+        ParallelFor(0, nChunks / (2 * width), [&](int64_t pair) {
+            int64_t start = chunkStart(2 * pair * width);
+            int64_t mid = chunkStart((2 * pair + 1) * width);
+            int64_t end = chunkStart((2 * pair + 2) * width);
+            std::merge(src + start, src + mid, src + mid, src + end, dst + start, comp);
+        });
+        std::swap(src, dst);
+    }
+    if (src != edges.data())
+        std::copy(src, src + edges.size(), edges.data());
+}
+
 // KdTreeAggregate Method Definitions
 KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
                                  int traversalCost, Float emptyBonus, int maxPrims,
@@ -804,7 +2127,6 @@ KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
       emptyBonus(emptyBonus),
       primitives(std::move(p)) {
     // Build kd-tree aggregate
-    nextFreeNode = nAllocedNodes = 0;
     if (maxDepth <= 0)
         maxDepth = std::round(8 + 1.3f * Log2Int(int64_t(primitives.size())));
     // Compute bounds for kd-tree construction
@@ -816,22 +2138,17 @@ KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
         primBounds.push_back(b);
     }
 
-    // Allocate working memory for kd-tree construction
-    std::vector<BoundEdge> edges[3];
-    for (int i = 0; i < 3; ++i)
-        edges[i].resize(2 * primitives.size());
-
-    std::vector<int> prims0(primitives.size());
-    std::vector<int> prims1((maxDepth + 1) * primitives.size());
-
     // Initialize _primNums_ for kd-tree construction
     std::vector<int> primNums(primitives.size());
     for (size_t i = 0; i < primitives.size(); ++i)
         primNums[i] = i;
 
     // Start recursive construction of kd-tree
-    buildTree(0, bounds, primBounds, primNums, maxDepth, edges, pstd::span<int>(prims0),
-              pstd::span<int>(prims1), 0);
+    KdSubtree tree;
+    buildTreeParallel(&tree, bounds, primBounds, std::move(primNums), maxDepth, 0);
+    nodes = new KdTreeNode[tree.nodes.size()];
+    std::copy(tree.nodes.begin(), tree.nodes.end(), nodes);
+    primitiveIndices = std::move(tree.primitiveIndices);
 }
 
 void KdTreeNode::InitLeaf(pstd::span<const int> primNums,
@@ -849,35 +2166,77 @@ void KdTreeNode::InitLeaf(pstd::span<const int> primNums,
     }
 }
 
-void KdTreeAggregate::buildTree(int nodeNum, const Bounds3f &nodeBounds,
-                                const std::vector<Bounds3f> &allPrimBounds,
-                                pstd::span<const int> primNums, int depth,
-                                std::vector<BoundEdge> edges[3], pstd::span<int> prims0,
-                                pstd::span<int> prims1, int badRefines) {
-    CHECK_EQ(nodeNum, nextFreeNode);
-    // Get next free node from _nodes_ array
-    if (nextFreeNode == nAllocedNodes) {
-        int nNewAllocNodes = std::max(2 * nAllocedNodes, 512);
-        KdTreeNode *n = new KdTreeNode[nNewAllocNodes];
-        if (nAllocedNodes > 0) {
-            std::memcpy(n, nodes, nAllocedNodes * sizeof(KdTreeNode));
-            delete[] nodes;
-        }
-        nodes = n;
-        nAllocedNodes = nNewAllocNodes;
+void KdTreeAggregate::buildTreeParallel(KdSubtree *tree, const Bounds3f &nodeBounds,
+                                        const std::vector<Bounds3f> &allPrimBounds,
+                                        std::vector<int> primNums, int depth,
+                                        int badRefines) const {
+    size_t nPrimitives = primNums.size();
+    if (nPrimitives <= kdParallelBuildThreshold || depth == 0) {
+        // Allocate working memory and build kd-tree for node serially
+        std::vector<BoundEdge> edges[3];
+        for (int i = 0; i < 3; ++i)
+            edges[i].resize(2 * nPrimitives);
+        std::vector<int> prims0(nPrimitives);
+        std::vector<int> prims1((depth + 1) * nPrimitives);
+        buildTree(tree, nodeBounds, allPrimBounds, primNums, depth, edges,
+                  pstd::span<int>(prims0), pstd::span<int>(prims1), badRefines);
+        return;
     }
-    ++nextFreeNode;
 
-    // Initialize leaf node if termination criteria met
-    if (primNums.size() <= maxPrims || depth == 0) {
-        nodes[nodeNum].InitLeaf(primNums, &primitiveIndices);
+    // Choose split for node, sorting edges in parallel
+    std::vector<BoundEdge> edges[3];
+    int bestAxis, bestOffset;
+    Float bestCost;
+    chooseSplit(nodeBounds, allPrimBounds, primNums, edges, true, &bestAxis,
+                &bestOffset, &bestCost);
+
+    // Create leaf if no good splits were found
+    Float leafCost = isectCost * nPrimitives;
+    if (bestCost > leafCost)
+        ++badRefines;
+    if (bestAxis == -1 || badRefines == 3) {
+        tree->nodes.push_back(KdTreeNode());
+        tree->nodes.back().InitLeaf(primNums, &tree->primitiveIndices);
         return;
     }
 
-    // Initialize interior node and continue recursion
-    // Choose split axis position for interior node
-    int bestAxis = -1, bestOffset = -1;
-    Float bestCost = Infinity, leafCost = isectCost * primNums.size();
+    // Classify primitives with respect to split
+    std::vector<int> childPrims[2];
+    const std::vector<BoundEdge> &splitEdges = edges[bestAxis];
+    for (int i = 0; i < bestOffset; ++i)
+        if (splitEdges[i].type == EdgeType::Start)
+            childPrims[0].push_back(splitEdges[i].primNum);
+    for (int i = bestOffset + 1; i < 2 * nPrimitives; ++i)
+        if (splitEdges[i].type == EdgeType::End)
+            childPrims[1].push_back(splitEdges[i].primNum);
+    Float tSplit = splitEdges[bestOffset].t;
+    for (int i = 0; i < 3; ++i)
+        edges[i] = std::vector<BoundEdge>();
+    primNums = std::vector<int>();
+
+    // Build child subtrees in parallel and append them after the interior node
+    Bounds3f childBounds[2] = {nodeBounds, nodeBounds};
+    childBounds[0].pMax[bestAxis] = childBounds[1].pMin[bestAxis] = tSplit;
+    KdSubtree children[2];
+    ParallelFor(0, 2, [&](int64_t c) {
+        buildTreeParallel(&children[c], childBounds[c], allPrimBounds,
+                          std::move(childPrims[c]), depth - 1, badRefines);
+    });
+    int nodeNum = tree->nodes.size();
+    tree->nodes.push_back(KdTreeNode());
+    AppendKdSubtree(tree, children[0]);
+    tree->nodes[nodeNum].InitInterior(bestAxis, tree->nodes.size(), tSplit);
+    AppendKdSubtree(tree, children[1]);
+}
+
+void KdTreeAggregate::chooseSplit(const Bounds3f &nodeBounds,
+                                  const std::vector<Bounds3f> &allPrimBounds,
+                                  pstd::span<const int> primNums,
+                                  std::vector<BoundEdge> edges[3], bool parallelSort,
+                                  int *bestAxis, int *bestOffset, Float *bestCost) const {
+    *bestAxis = -1;
+    *bestOffset = -1;
+    *bestCost = Infinity;
     Float invTotalSA = 1 / nodeBounds.SurfaceArea();
     // Choose which axis to split along
     int axis = nodeBounds.MaxDimension();
@@ -887,6 +2246,8 @@ void KdTreeAggregate::buildTree(int nodeNum, const Bounds3f &nodeBounds,
     size_t nPrimitives = primNums.size();
 retrySplit:
     // Initialize edges for _axis_
+    if (edges[axis].size() < 2 * nPrimitives)
+        edges[axis].resize(2 * nPrimitives);
     for (size_t i = 0; i < nPrimitives; ++i) {
         int pn = primNums[i];
         const Bounds3f &bounds = allPrimBounds[pn];
@@ -894,10 +2255,14 @@ retrySplit:
         edges[axis][2 * i + 1] = BoundEdge(bounds.pMax[axis], pn, false);
     }
     // Sort _edges_ for _axis_
-    std::sort(edges[axis].begin(), edges[axis].begin() + 2 * nPrimitives,
-              [](const BoundEdge &e0, const BoundEdge &e1) -> bool {
-                  return std::tie(e0.t, e0.type) < std::tie(e1.t, e1.type);
-              });
+    auto edgeLess = [](const BoundEdge &e0, const BoundEdge &e1) -> bool {
+        return std::tie(e0.t, e0.type) < std::tie(e1.t, e1.type);
+    };
+    if (parallelSort)
+        ParallelSort(pstd::span<BoundEdge>(edges[axis].data(), 2 * nPrimitives),
+                     edgeLess);
+    else
+        std::sort(edges[axis].begin(), edges[axis].begin() + 2 * nPrimitives, edgeLess);
 
     // Compute cost of all splits for _axis_ to find best
     int nBelow = 0, nAbove = primNums.size();
@@ -922,10 +2287,10 @@ retrySplit:
             Float cost = traversalCost +
                          isectCost * (1 - eb) * (pBelow * nBelow + pAbove * nAbove);
             // Update best split if this is lowest cost so far
-            if (cost < bestCost) {
-                bestCost = cost;
-                bestAxis = axis;
-                bestOffset = i;
+            if (cost < *bestCost) {
+                *bestCost = cost;
+                *bestAxis = axis;
+                *bestOffset = i;
             }
         }
         if (edges[axis][i].type == EdgeType::Start)
@@ -934,18 +2299,42 @@ retrySplit:
     CHECK(nBelow == nPrimitives && nAbove == 0);
 
     // Try to split along another axis if no good splits were found
-    if (bestAxis == -1 && retries < 2) {
+    if (*bestAxis == -1 && retries < 2) {
         ++retries;
         axis = (axis + 1) % 3;
         goto retrySplit;
     }
+}
+
+void KdTreeAggregate::buildTree(KdSubtree *tree, const Bounds3f &nodeBounds,
+                                const std::vector<Bounds3f> &allPrimBounds,
+                                pstd::span<const int> primNums, int depth,
+                                std::vector<BoundEdge> edges[3], pstd::span<int> prims0,
+                                pstd::span<int> prims1, int badRefines) const {
+    // Get next free node from _tree_'s nodes
+    int nodeNum = tree->nodes.size();
+    tree->nodes.push_back(KdTreeNode());
+
+    // Initialize leaf node if termination criteria met
+    if (primNums.size() <= maxPrims || depth == 0) {
+        tree->nodes[nodeNum].InitLeaf(primNums, &tree->primitiveIndices);
+        return;
+    }
+
+    // Initialize interior node and continue recursion
+    // Choose split axis position for interior node
+    int bestAxis, bestOffset;
+    Float bestCost, leafCost = isectCost * primNums.size();
+    size_t nPrimitives = primNums.size();
+    chooseSplit(nodeBounds, allPrimBounds, primNums, edges, false, &bestAxis,
+                &bestOffset, &bestCost);
 
     // Create leaf if no good splits were found
     if (bestCost > leafCost)
         ++badRefines;
     if ((bestCost > 4 * leafCost && nPrimitives < 16) || bestAxis == -1 ||
         badRefines == 3) {
-        nodes[nodeNum].InitLeaf(primNums, &primitiveIndices);
+        tree->nodes[nodeNum].InitLeaf(primNums, &tree->primitiveIndices);
         return;
     }
 
@@ -962,11 +2351,11 @@ retrySplit:
     Float tSplit = edges[bestAxis][bestOffset].t;
     Bounds3f bounds0 = nodeBounds, bounds1 = nodeBounds;
     bounds0.pMax[bestAxis] = bounds1.pMin[bestAxis] = tSplit;
-    buildTree(nodeNum + 1, bounds0, allPrimBounds, prims0.subspan(0, n0), depth - 1,
-              edges, prims0, prims1.subspan(n1), badRefines);
-    int aboveChild = nextFreeNode;
-    nodes[nodeNum].InitInterior(bestAxis, aboveChild, tSplit);
-    buildTree(aboveChild, bounds1, allPrimBounds, prims1.subspan(0, n1), depth - 1, edges,
+    buildTree(tree, bounds0, allPrimBounds, prims0.subspan(0, n0), depth - 1, edges,
+              prims0, prims1.subspan(n1), badRefines);
+    int aboveChild = tree->nodes.size();
+    tree->nodes[nodeNum].InitInterior(bestAxis, aboveChild, tSplit);
+    buildTree(tree, bounds1, allPrimBounds, prims1.subspan(0, n1), depth - 1, edges,
               prims0, prims1.subspan(n1), badRefines);
 }
 
@@ -19,20 +19,37 @@ namespace pbrt {
 Primitive CreateAccelerator(const std::string &name, std::vector<Primitive> prims,
                             const ParameterDictionary &parameters);
 
+class PagedMemoryResource;
+
 struct BVHBuildNode;
+struct BVHClosestHit;
 struct BVHPrimitive;
 struct LinearBVHNode;
 struct MortonPrimitive;
+struct PrecomputedTriangle;
+template <int N>
+struct WideBVHNode;
+template <int N, typename QuantizedType>
+struct QuantizedBVHNode;
 
 // BVHAggregate Definition
 class BVHAggregate {
   public:
     // BVHAggregate Public Types
-    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts };
+    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts, SBVH };
+    enum class NodeLayout { DepthFirst, Treelet };
+    using WideNodePointer =
+        TaggedPointer<WideBVHNode<4>, WideBVHNode<8>, QuantizedBVHNode<2, uint8_t>,
+                      QuantizedBVHNode<4, uint8_t>, QuantizedBVHNode<8, uint8_t>,
+                      QuantizedBVHNode<2, uint16_t>, QuantizedBVHNode<4, uint16_t>,
+                      QuantizedBVHNode<8, uint16_t>>;
 
     // BVHAggregate Public Methods
     BVHAggregate(std::vector<Primitive> p, int maxPrimsInNode = 1,
-                 SplitMethod splitMethod = SplitMethod::SAH);
+                 SplitMethod splitMethod = SplitMethod::SAH, int width = 2,
+                 int boundsBits = 32, Float splitBudget = 0.3f,
+                 bool precomputeTriangles = false,
+                 NodeLayout nodeLayout = NodeLayout::DepthFirst);
 
     static BVHAggregate *Create(std::vector<Primitive> prims,
                                 const ParameterDictionary &parameters);
@@ -48,6 +65,12 @@ class BVHAggregate {
                                  std::atomic<int> *totalNodes,
                                  std::atomic<int> *orderedPrimsOffset,
                                  std::vector<Primitive> &orderedPrims);
+    BVHBuildNode *buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                            std::vector<BVHPrimitive> references, Float rootSurfaceArea,
+                            int depth, std::atomic<int> *totalNodes,
+                            std::atomic<int> *orderedPrimsOffset,
+                            std::atomic<int64_t> *referenceBudget,
+                            std::vector<Primitive> &orderedPrims);
     BVHBuildNode *buildHLBVH(Allocator alloc,
                              const std::vector<BVHPrimitive> &primitiveInfo,
                              std::atomic<int> *totalNodes,
@@ -61,15 +84,55 @@ class BVHAggregate {
                                 std::vector<BVHBuildNode *> &treeletRoots, int start,
                                 int end, std::atomic<int> *totalNodes) const;
     int flattenBVH(BVHBuildNode *node, int *offset);
+    bool readCache(const std::string &filename, uint64_t key, int boundsBits);
+    void writeCache(const std::string &filename, uint64_t key, int boundsBits,
+                    size_t nInputPrimitives,
+                    const std::vector<uint32_t> &primitiveIndices) const;
+    template <typename Node>
+    Node *collapseBVH(BVHBuildNode *root);
+    template <typename Node>
+    int flattenWideBVH(BVHBuildNode *node, std::vector<Node> &wideNodes);
+
+    void initTriangles();
+    void intersectLeaf(int offset, int nPrimitives, const Ray &ray, Float *tMax,
+                       BVHClosestHit *hit) const;
+    pstd::optional<ShapeIntersection> closestIntersection(const Ray &ray,
+                                                          const BVHClosestHit &hit) const;
+    bool intersectPLeaf(int offset, int nPrimitives, const Ray &ray, Float tMax) const;
+    void replicateNodes();
+    void initPaging();
+    void touchNode(int nodeIndex, int *region) const;
+    void touchTriangles(int offset, int nPrimitives) const;
+
+    template <typename Node>
+    pstd::optional<ShapeIntersection> intersectWide(const Node *wideNodes,
+                                                    const Ray &ray, Float tMax) const;
+    template <typename Node>
+    bool intersectPWide(const Node *wideNodes, const Ray &ray, Float tMax) const;
 
     // BVHAggregate Private Members
     int maxPrimsInNode;
     std::vector<Primitive> primitives;
     SplitMethod splitMethod;
+    NodeLayout nodeLayout;
+    int width;
+    Bounds3f bounds;
+    int nNodes = 0;
     LinearBVHNode *nodes = nullptr;
+    WideNodePointer wideNodes;
+    // Copies of the nodes for each NUMA node, if there is more than one
+    std::vector<LinearBVHNode *> nodeReplicas;
+    std::vector<WideNodePointer> wideNodeReplicas;
+    PrecomputedTriangle *triangles = nullptr;
+    // Paging regions for consecutive runs of nodes and precomputed triangles
+    // if geometry paging is enabled
+    PagedMemoryResource *pager = nullptr;
+    std::vector<int> nodeRegions, triangleRegions;
+    int nodesPerRegion = 0, trianglesPerRegion = 0;
 };
 
 struct KdTreeNode;
+struct KdSubtree;
 struct BoundEdge;
 
 // KdTreeAggregate Definition
@@ -88,11 +151,18 @@ class KdTreeAggregate {
 
   private:
     // KdTreeAggregate Private Methods
-    void buildTree(int nodeNum, const Bounds3f &bounds,
+    void buildTreeParallel(KdSubtree *tree, const Bounds3f &bounds,
+                           const std::vector<Bounds3f> &primBounds,
+                           std::vector<int> primNums, int depth, int badRefines) const;
+    void chooseSplit(const Bounds3f &bounds, const std::vector<Bounds3f> &primBounds,
+                     pstd::span<const int> primNums, std::vector<BoundEdge> edges[3],
+                     bool parallelSort, int *bestAxis, int *bestOffset,
+                     Float *bestCost) const;
+    void buildTree(KdSubtree *tree, const Bounds3f &bounds,
                    const std::vector<Bounds3f> &primBounds,
                    pstd::span<const int> primNums, int depth,
                    std::vector<BoundEdge> edges[3], pstd::span<int> prims0,
-                   pstd::span<int> prims1, int badRefines);
+                   pstd::span<int> prims1, int badRefines) const;
 
     // KdTreeAggregate Private Members
     int isectCost, traversalCost, maxPrims;
@@ -100,7 +170,6 @@ class KdTreeAggregate {
     std::vector<Primitive> primitives;
     std::vector<int> primitiveIndices;
     KdTreeNode *nodes;
-    int nAllocedNodes, nextFreeNode;
     Bounds3f bounds;
 };
 
@@ -0,0 +1,222 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/primitive.h>
+#include <pbrt/options.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+#include <pbrt/util/transform.h>
+
+#include <memory>
+#include <vector>
+
+using namespace pbrt;
+
+// Returns a collection of randomly placed and sized spheres along with the
+// transformations that they refer to.
+static std::vector<Primitive> RandomSpheres(int n, RNG &rng,
+                                            std::vector<std::unique_ptr<Transform>> *xforms) {
+    std::vector<Primitive> prims;
+    for (int i = 0; i < n; ++i) {
+        Vector3f p(Lerp(rng.Uniform<Float>(), -10, 10), Lerp(rng.Uniform<Float>(), -10, 10),
+                   Lerp(rng.Uniform<Float>(), -10, 10));
+        xforms->push_back(std::make_unique<Transform>(Translate(p)));
+        const Transform *renderFromObject = xforms->back().get();
+        xforms->push_back(std::make_unique<Transform>(Inverse(*renderFromObject)));
+        const Transform *objectFromRender = xforms->back().get();
+
+        Float radius = Lerp(rng.Uniform<Float>(), .05, .75);
+        Shape sphere = new Sphere(renderFromObject, objectFromRender, false, radius,
+                                  -radius, radius, 360);
+        prims.push_back(new SimplePrimitive(sphere, nullptr));
+    }
+    return prims;
+}
+
+// Returns randomly placed triangles from a single mesh.
+static std::vector<Primitive> RandomTriangles(int n, RNG &rng) {
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < n; ++i) {
+        Point3f center(Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10));
+        for (int v = 0; v < 3; ++v) {
+            indices.push_back(p.size());
+            p.push_back(center + Vector3f(Lerp(rng.Uniform<Float>(), -1, 1),
+                                          Lerp(rng.Uniform<Float>(), -1, 1),
+                                          Lerp(rng.Uniform<Float>(), -1, 1)));
+        }
+    }
+    TriangleMesh *mesh =
+        new TriangleMesh(Transform(), false, indices, p, {}, {}, {}, {}, Allocator());
+
+    std::vector<Primitive> prims;
+    for (Shape tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+    return prims;
+}
+
+static Ray RandomRay(RNG &rng) {
+    Point3f o(Lerp(rng.Uniform<Float>(), -15, 15), Lerp(rng.Uniform<Float>(), -15, 15),
+              Lerp(rng.Uniform<Float>(), -15, 15));
+    Vector3f d = SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+    return Ray(o, d);
+}
+
+static void CheckIntersectionsMatch(const BVHAggregate &expected,
+                                    const BVHAggregate &bvh, RNG &rng, int nRays) {
+    EXPECT_EQ(expected.Bounds(), bvh.Bounds());
+    for (int i = 0; i < nRays; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : 10.f;
+        pstd::optional<ShapeIntersection> si = expected.Intersect(ray, tMax);
+        pstd::optional<ShapeIntersection> siBVH = bvh.Intersect(ray, tMax);
+        ASSERT_EQ(si.has_value(), siBVH.has_value());
+        // Different traversal orders may return either of two nearly
+        // coincident intersections, so allow a small difference in _tHit_.
+        if (si)
+            EXPECT_NEAR(si->tHit, siBVH->tHit, 1e-4f * si->tHit);
+        EXPECT_EQ(expected.IntersectP(ray, tMax), bvh.IntersectP(ray, tMax));
+    }
+}
+
+static void CheckMatchesBinary(
+    int width, int boundsBits,
+    BVHAggregate::SplitMethod splitMethod = BVHAggregate::SplitMethod::SAH,
+    BVHAggregate::NodeLayout nodeLayout = BVHAggregate::NodeLayout::DepthFirst) {
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> xforms;
+    std::vector<Primitive> prims = RandomSpheres(1000, rng, &xforms);
+
+    BVHAggregate binary(prims, 4, BVHAggregate::SplitMethod::SAH, 2);
+    BVHAggregate bvh(prims, 4, splitMethod, width, boundsBits, 0.3f, false, nodeLayout);
+    CheckIntersectionsMatch(binary, bvh, rng, 10000);
+}
+
+TEST(BVHAggregate, WideMatchesBinary) {
+    CheckMatchesBinary(4, 32);
+    CheckMatchesBinary(8, 32);
+}
+
+TEST(BVHAggregate, QuantizedMatchesBinary) {
+    for (int width : {2, 4, 8}) {
+        CheckMatchesBinary(width, 8);
+        CheckMatchesBinary(width, 16);
+    }
+}
+
+TEST(BVHAggregate, SpatialSplitsMatchBinary) {
+    for (int width : {2, 4, 8})
+        CheckMatchesBinary(width, 32, BVHAggregate::SplitMethod::SBVH);
+    CheckMatchesBinary(4, 8, BVHAggregate::SplitMethod::SBVH);
+}
+
+TEST(BVHAggregate, TreeletLayoutMatchesBinary) {
+    for (int width : {4, 8})
+        CheckMatchesBinary(width, 32, BVHAggregate::SplitMethod::SAH,
+                           BVHAggregate::NodeLayout::Treelet);
+    CheckMatchesBinary(2, 16, BVHAggregate::SplitMethod::SAH,
+                       BVHAggregate::NodeLayout::Treelet);
+}
+
+TEST(BVHAggregate, ParallelBuild) {
+    // Use enough primitives that the top levels are binned and
+    // partitioned in parallel.
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> xforms;
+    std::vector<Primitive> prims = RandomSpheres(300000, rng, &xforms);
+
+    BVHAggregate sah(prims, 4, BVHAggregate::SplitMethod::SAH);
+    BVHAggregate middle(prims, 4, BVHAggregate::SplitMethod::Middle);
+    BVHAggregate equal(prims, 4, BVHAggregate::SplitMethod::EqualCounts);
+    EXPECT_EQ(sah.Bounds(), equal.Bounds());
+    EXPECT_EQ(middle.Bounds(), equal.Bounds());
+
+    for (int i = 0; i < 1000; ++i) {
+        Ray ray = RandomRay(rng);
+        pstd::optional<ShapeIntersection> si = equal.Intersect(ray, Infinity);
+        for (const BVHAggregate *bvh : {&sah, &middle}) {
+            pstd::optional<ShapeIntersection> siBVH = bvh->Intersect(ray, Infinity);
+            ASSERT_EQ(si.has_value(), siBVH.has_value());
+            if (si)
+                EXPECT_NEAR(si->tHit, siBVH->tHit, 1e-4f * si->tHit);
+        }
+    }
+}
+
+TEST(BVHAggregate, PrecomputedTriangles) {
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> xforms;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    // Include other shapes to exercise leaves with both kinds of primitives
+    for (Primitive sphere : RandomSpheres(200, rng, &xforms))
+        prims.push_back(sphere);
+
+    BVHAggregate expected(prims, 4, BVHAggregate::SplitMethod::SAH);
+    for (int width : {2, 4}) {
+        BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH, width, 32, 0.3f,
+                         true /* precomputeTriangles */);
+        CheckIntersectionsMatch(expected, bvh, rng, 10000);
+    }
+}
+
+TEST(KdTreeAggregate, ParallelBuildMatchesBVH) {
+    // Use enough primitives that the upper levels of the kd-tree are built
+    // in parallel.
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> xforms;
+    std::vector<Primitive> prims = RandomSpheres(200000, rng, &xforms);
+
+    BVHAggregate bvh(prims, 4, BVHAggregate::SplitMethod::SAH);
+    KdTreeAggregate kdTree(prims, 80, 1, 0.5f, 1, -1);
+    EXPECT_EQ(bvh.Bounds(), kdTree.Bounds());
+    for (int i = 0; i < 10000; ++i) {
+        Ray ray = RandomRay(rng);
+        Float tMax = (i & 1) ? Infinity : 10.f;
+        pstd::optional<ShapeIntersection> si = bvh.Intersect(ray, tMax);
+        pstd::optional<ShapeIntersection> siKd = kdTree.Intersect(ray, tMax);
+        ASSERT_EQ(si.has_value(), siKd.has_value());
+        if (si)
+            EXPECT_NEAR(si->tHit, siKd->tHit, 1e-4f * std::max<Float>(1, si->tHit));
+        EXPECT_EQ(bvh.IntersectP(ray, tMax), kdTree.IntersectP(ray, tMax));
+    }
+}
+
+#ifndef PBRT_IS_WINDOWS
+TEST(BVHAggregate, Cache) {
+    RNG rng;
+    std::vector<std::unique_ptr<Transform>> xforms;
+    std::vector<Primitive> prims = RandomSpheres(1000, rng, &xforms);
+    BVHAggregate binary(prims, 4, BVHAggregate::SplitMethod::SAH, 2);
+
+    std::string cacheDirectory = Options->bvhCacheDirectory;
+    Options->bvhCacheDirectory = ".";
+    for (int width : {2, 4, 8})
+        for (int boundsBits : {8, 32}) {
+            // Build BVH and write it to the cache
+            size_t nCacheFiles = MatchingFilenames("./bvh-").size();
+            BVHAggregate built(prims, 4, BVHAggregate::SplitMethod::SBVH, width,
+                               boundsBits);
+            EXPECT_EQ(nCacheFiles + 1, MatchingFilenames("./bvh-").size());
+
+            // Load BVH from the cache and check that it matches
+            BVHAggregate cached(prims, 4, BVHAggregate::SplitMethod::SBVH, width,
+                                boundsBits);
+            EXPECT_EQ(nCacheFiles + 1, MatchingFilenames("./bvh-").size());
+            CheckIntersectionsMatch(built, cached, rng, 1000);
+            CheckIntersectionsMatch(binary, cached, rng, 1000);
+        }
+    for (const std::string &filename : MatchingFilenames("./bvh-"))
+        EXPECT_TRUE(RemoveFile(filename));
+    Options->bvhCacheDirectory = cacheDirectory;
+}
+#endif  // !PBRT_IS_WINDOWS
@@ -41,10 +41,56 @@
 #include <pbrt/util/string.h>
 
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <typeindex>
 
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
+STAT_INT_DISTRIBUTION("Integrator/ScratchBuffer high-water mark (bytes)",
+                      scratchBufferHighWaterMark);
+STAT_COUNTER("Integrator/ScratchBuffer reallocations", nScratchBufferReallocations);
+
+Allocator LightSamplerAllocator() {
+    static MemoryTag *tag = MemoryTag::Get("Integrator/Light sampler");
+    return TrackedAllocator(tag);
+}
+
+// ScratchBuffer Sizing Functions
+// The most scratch buffer memory that a sample has needed is recorded for
+// each type of integrator so that later scratch buffers can start out that
+// large and then don't need to grow during rendering.
+static std::mutex scratchBufferSizeMutex;
+static std::map<std::type_index, int> scratchBufferSizes;
+
+static int InitialScratchBufferSize(const Integrator &integrator) {
+    std::lock_guard<std::mutex> lock(scratchBufferSizeMutex);
+    auto iter = scratchBufferSizes.find(typeid(integrator));
+    return iter != scratchBufferSizes.end() ? iter->second : 256;
+}
+
+// Grows all of the threads' buffers to the largest high-water mark among
+// them and records it for the integrator. It must not be called while the
+// buffers are in use.
+static void PresizeScratchBuffers(const Integrator &integrator,
+                                  ThreadLocal<ScratchBuffer> &buffers) {
+    int size = 0;
+    buffers.ForAll(
+        [&](ScratchBuffer &buf) { size = std::max(size, buf.HighWaterMark()); });
+    buffers.ForAll([&](ScratchBuffer &buf) { buf.Reserve(size); });
+
+    std::lock_guard<std::mutex> lock(scratchBufferSizeMutex);
+    int &recordedSize = scratchBufferSizes[typeid(integrator)];
+    recordedSize = std::max(recordedSize, size);
+}
+
+static void ReportScratchBufferStats(ThreadLocal<ScratchBuffer> &buffers) {
+    buffers.ForAll([&](ScratchBuffer &buf) {
+        scratchBufferHighWaterMark << buf.HighWaterMark();
+        nScratchBufferReallocations += buf.Reallocations();
+    });
+}
 
 // RandomWalkIntegrator Method Definitions
 std::unique_ptr<RandomWalkIntegrator> RandomWalkIntegrator::Create(
@@ -96,7 +142,9 @@ void ImageTileIntegrator::Render() {
     });
 
     // Declare common variables for rendering image in tiles
-    ThreadLocal<ScratchBuffer> scratchBuffers([]() { return ScratchBuffer(); });
+    int scratchBufferSize = InitialScratchBufferSize(*this);
+    ThreadLocal<ScratchBuffer> scratchBuffers(
+        [=]() { return ScratchBuffer(scratchBufferSize); });
 
     ThreadLocal<Sampler> samplers([this]() { return samplerPrototype.Clone(); });
 
@@ -159,9 +207,12 @@ void ImageTileIntegrator::Render() {
     }
 
     // Render image in waves
+    // Each wave's tile costs are used to split the most expensive tiles in
+    // the next one.
+    TileCosts tileCosts;
     while (waveStart < spp) {
         // Render current wave's image tiles in parallel
-        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
+        ParallelFor2D(pixelBounds, &tileCosts, [&](Bounds2i tileBounds) {
             // Render image tile given by _tileBounds_
             ScratchBuffer &scratchBuffer = scratchBuffers.Get();
             Sampler &sampler = samplers.Get();
@@ -186,6 +237,9 @@ void ImageTileIntegrator::Render() {
             progress.Update((waveEnd - waveStart) * tileBounds.Area());
         });
 
+        // Size all of the scratch buffers for the largest sample so far
+        PresizeScratchBuffers(*this, scratchBuffers);
+
         // Update start and end wave
         waveStart = waveEnd;
         waveEnd = std::min(spp, waveEnd + nextWaveSize);
@@ -219,6 +273,7 @@ void ImageTileIntegrator::Render() {
 
     if (mseOutFile)
         fclose(mseOutFile);
+    ReportScratchBufferStats(scratchBuffers);
     DisconnectFromDisplayServer();
     LOG_VERBOSE("Rendering finished");
 }
@@ -384,7 +439,7 @@ SimplePathIntegrator::SimplePathIntegrator(int maxDepth, bool sampleLights,
       maxDepth(maxDepth),
       sampleLights(sampleLights),
       sampleBSDF(sampleBSDF),
-      lightSampler(lights, Allocator()) {}
+      lightSampler(lights, LightSamplerAllocator()) {}
 
 SampledSpectrum SimplePathIntegrator::Li(RayDifferential ray, SampledWavelengths &lambda,
                                          Sampler sampler, ScratchBuffer &scratchBuffer,
@@ -502,7 +557,7 @@ LightPathIntegrator::LightPathIntegrator(int maxDepth, Camera camera, Sampler sa
                                          Primitive aggregate, std::vector<Light> lights)
     : ImageTileIntegrator(camera, sampler, aggregate, lights),
       maxDepth(maxDepth),
-      lightSampler(lights, Allocator()) {}
+      lightSampler(lights, LightSamplerAllocator()) {}
 
 void LightPathIntegrator::EvaluatePixelSample(Point2i pPixel, int sampleIndex,
                                               Sampler sampler,
@@ -622,7 +677,8 @@ PathIntegrator::PathIntegrator(int maxDepth, Camera camera, Sampler sampler,
                                const std::string &lightSampleStrategy, bool regularize)
     : RayIntegrator(camera, sampler, aggregate, lights),
       maxDepth(maxDepth),
-      lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
+      lightSampler(
+          LightSampler::Create(lightSampleStrategy, lights, LightSamplerAllocator())),
       regularize(regularize) {}
 
 SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lambda,
@@ -2581,7 +2637,9 @@ void MLTIntegrator::Render() {
     int nBootstrapSamples = nBootstrap * (maxDepth + 1);
     std::vector<Float> bootstrapWeights(nBootstrapSamples, 0);
     // Allocate scratch buffers for MLT samples
-    ThreadLocal<ScratchBuffer> threadScratchBuffers([]() { return ScratchBuffer(); });
+    int scratchBufferSize = InitialScratchBufferSize(*this);
+    ThreadLocal<ScratchBuffer> threadScratchBuffers(
+        [=]() { return ScratchBuffer(scratchBufferSize); });
 
     // Generate bootstrap samples in parallel
     ProgressReporter progress(nBootstrap, "Generating bootstrap paths", Options->quiet);
@@ -2607,6 +2665,7 @@ void MLTIntegrator::Render() {
         progress.Update(end - start);
     });
     progress.Done();
+    PresizeScratchBuffers(*this, threadScratchBuffers);
 
     if (std::accumulate(bootstrapWeights.begin(), bootstrapWeights.end(), 0.) == 0.)
         ErrorExit("No light carrying paths found during bootstrap sampling! "
@@ -2708,6 +2767,7 @@ void MLTIntegrator::Render() {
     });
 
     progressRender.Done();
+    ReportScratchBufferStats(threadScratchBuffers);
 
     // Store final image computed with MLT
     ImageMetadata metadata;
@@ -2827,14 +2887,23 @@ void SPPMIntegrator::Render() {
     for (SPPMPixel &p : pixels)
         p.radius = initialSearchRadius;
     pixelMemoryBytes += pixels.size() * sizeof(SPPMPixel);
+    // In deterministic mode, sum photon flux where thread scheduling doesn't
+    // affect the result
+    std::unique_ptr<OrderIndependentPixelSums> orderIndependentPhi;
+    if (Options->deterministic) {
+        orderIndependentPhi = std::make_unique<OrderIndependentPixelSums>(pixelBounds, 3);
+        pixelMemoryBytes += orderIndependentPhi->BytesAllocated();
+    }
 
     // Create light samplers for SPPM rendering
-    BVHLightSampler lightSampler(lights, Allocator());
-    PowerLightSampler shootLightSampler(lights, Allocator());
+    BVHLightSampler lightSampler(lights, LightSamplerAllocator());
+    PowerLightSampler shootLightSampler(lights, LightSamplerAllocator());
 
     // Allocate per-thread _ScratchBuffer_s for SPPM rendering
     ThreadLocal<ScratchBuffer> threadScratchBuffers(
         []() { return ScratchBuffer(1024 * 1024); });
+    ThreadLocal<ScratchBuffer> photonShootScratchBuffers(
+        []() { return ScratchBuffer(); });
 
     // Allocate samplers for SPPM rendering
     ThreadLocal<Sampler> threadSamplers(
@@ -2842,6 +2911,8 @@ void SPPMIntegrator::Render() {
     pstd::vector<DigitPermutation> *digitPermutations(
         ComputeRadicalInversePermutations(digitPermutationsSeed));
 
+    // Costs of camera path tiles, used to split expensive ones next iteration
+    TileCosts cameraTileCosts;
     for (int iter = 0; iter < nIterations; ++iter) {
         // Connect to display server for SPPM if requested
         if (iter == 0 && !Options->displayServer.empty()) {
@@ -2869,7 +2940,7 @@ void SPPMIntegrator::Render() {
 
         Float timeSample = RadicalInverse(2, iter);
 
-        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
+        ParallelFor2D(pixelBounds, &cameraTileCosts, [&](Bounds2i tileBounds) {
             // Follow camera paths for _tileBounds_ in image for SPPM
             ScratchBuffer &scratchBuffer = threadScratchBuffers.Get();
             Sampler sampler = threadSamplers.Get();
@@ -3055,10 +3126,6 @@ void SPPMIntegrator::Render() {
         });
 
         // Trace photons and accumulate contributions
-        // Create per-thread scratch buffers for photon shooting
-        ThreadLocal<ScratchBuffer> photonShootScratchBuffers(
-            []() { return ScratchBuffer(); });
-
         ParallelFor(0, photonsPerIteration, [&](int64_t start, int64_t end) {
             // Follow photon paths for photon index range _start_ - _end_
             ScratchBuffer &scratchBuffer = photonShootScratchBuffers.Get();
@@ -3146,8 +3213,18 @@ void SPPMIntegrator::Render() {
                                     photonLambda.TerminateSecondary();
                                 RGB Phi_i =
                                     film.ToOutputRGB(pixel.vp.beta * Phi, photonLambda);
-                                for (int i = 0; i < 3; ++i)
-                                    pixel.Phi_i[i].Add(Phi_i[i]);
+                                if (orderIndependentPhi) {
+                                    // Find _pixel_'s coordinates and add to its sums
+                                    int offset = &pixel - &pixels[pixelBounds.pMin];
+                                    int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+                                    Point2i pPixel(pixelBounds.pMin.x + offset % width,
+                                                   pixelBounds.pMin.y + offset / width);
+                                    for (int i = 0; i < 3; ++i)
+                                        orderIndependentPhi->Add(pPixel, i, Phi_i[i]);
+                                } else {
+                                    for (int i = 0; i < 3; ++i)
+                                        pixel.Phi_i[i].Add(Phi_i[i]);
+                                }
 
                                 ++pixel.m;
                             }
@@ -3187,6 +3264,11 @@ void SPPMIntegrator::Render() {
         });
         // Reset _threadScratchBuffers_ after tracing photons
         threadScratchBuffers.ForAll([](ScratchBuffer &buffer) { buffer.Reset(); });
+        // Size all of the scratch buffers for the first iteration's largest needs
+        if (iter == 0) {
+            PresizeScratchBuffers(*this, threadScratchBuffers);
+            PresizeScratchBuffers(*this, photonShootScratchBuffers);
+        }
 
         progress.Update();
         photonPaths += photonsPerIteration;
@@ -3202,6 +3284,9 @@ void SPPMIntegrator::Render() {
 
                 // Update $\tau$ for pixel
                 RGB Phi_i(p.Phi_i[0], p.Phi_i[1], p.Phi_i[2]);
+                if (orderIndependentPhi)
+                    for (int i = 0; i < 3; ++i)
+                        Phi_i[i] = orderIndependentPhi->Sum(pPixel, i);
                 p.tau = (p.tau + Phi_i) * Sqr(rNew) / Sqr(p.radius);
 
                 // Set remaining pixel values for next photon pass
@@ -3210,6 +3295,8 @@ void SPPMIntegrator::Render() {
                 p.m = 0;
                 for (int i = 0; i < 3; ++i)
                     p.Phi_i[i] = (Float)0;
+                if (orderIndependentPhi)
+                    orderIndependentPhi->Reset(pPixel);
             }
             // Reset _VisiblePoint_ in pixel
             p.vp.beta = SampledSpectrum(0.);
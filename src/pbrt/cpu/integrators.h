@@ -30,6 +30,10 @@
 
 namespace pbrt {
 
+// Returns the allocator for integrators' light samplers, which attributes
+// their memory to the "Integrator/Light sampler" memory tag.
+Allocator LightSamplerAllocator();
+
 // Integrator Definition
 class Integrator {
   public:
@@ -267,7 +271,8 @@ class VolPathIntegrator : public RayIntegrator {
                       bool regularize = false)
         : RayIntegrator(camera, sampler, aggregate, lights),
           maxDepth(maxDepth),
-          lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
+          lightSampler(LightSampler::Create(lightSampleStrategy, lights,
+                                            LightSamplerAllocator())),
           regularize(regularize) {}
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
@@ -351,7 +356,7 @@ class BDPTIntegrator : public RayIntegrator {
         : RayIntegrator(camera, sampler, aggregate, lights),
           maxDepth(maxDepth),
           regularize(regularize),
-          lightSampler(new PowerLightSampler(lights, Allocator())),
+          lightSampler(new PowerLightSampler(lights, LightSamplerAllocator())),
           visualizeStrategies(visualizeStrategies),
           visualizeWeights(visualizeWeights) {}
 
@@ -388,7 +393,7 @@ class MLTIntegrator : public Integrator {
                   int maxDepth, int nBootstrap, int nChains, int mutationsPerPixel,
                   Float sigma, Float largeStepProbability, bool regularize)
         : Integrator(aggregate, lights),
-          lightSampler(new PowerLightSampler(lights, Allocator())),
+          lightSampler(new PowerLightSampler(lights, LightSamplerAllocator())),
           camera(camera),
           maxDepth(maxDepth),
           nBootstrap(nBootstrap),
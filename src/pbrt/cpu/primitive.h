@@ -55,6 +55,9 @@ class GeometricPrimitive {
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
+    Shape GetShape() const { return shape; }
+    FloatTexture GetAlpha() const { return alpha; }
+
   private:
     // GeometricPrimitive Private Members
     Shape shape;
@@ -73,6 +76,8 @@ class SimplePrimitive {
     bool IntersectP(const Ray &r, Float tMax) const;
     SimplePrimitive(Shape shape, Material material);
 
+    Shape GetShape() const { return shape; }
+
   private:
     // SimplePrimitive Private Members
     Shape shape;
@@ -480,11 +480,34 @@ Spectrum PixelSensor::swatchReflectances[nSwatchReflectances]{
 
 STAT_MEMORY_COUNTER("Memory/Film pixels", filmPixelMemory);
 
+// Returns the allocator for film pixels; in NUMA mode, their pages are spread
+// over all the nodes, since threads on every node update them.
+static Allocator FilmPixelAllocator(Allocator alloc) {
+    if (NUMANodeCount() > 1 && !Options->useGPU)
+        return Allocator(ParallelFirstTouchMemoryResource());
+    return alloc;
+}
+
+// Splats may come from any thread, so in deterministic mode they are summed in
+// storage where the order of additions does not affect the result.
+static OrderIndependentPixelSums *AllocOrderIndependentSplats(Bounds2i pixelBounds,
+                                                              int nChannels,
+                                                              Allocator alloc) {
+    if (!Options->deterministic)
+        return nullptr;
+    Allocator pixelAlloc = FilmPixelAllocator(alloc);
+    OrderIndependentPixelSums *sums =
+        pixelAlloc.new_object<OrderIndependentPixelSums>(pixelBounds, nChannels,
+                                                         pixelAlloc);
+    filmPixelMemory += sums->BytesAllocated();
+    return sums;
+}
+
 // RGBFilm Method Definitions
 RGBFilm::RGBFilm(FilmBaseParameters p, const RGBColorSpace *colorSpace,
                  Float maxComponentValue, bool writeFP16, Allocator alloc)
     : FilmBase(p),
-      pixels(p.pixelBounds, alloc),
+      pixels(p.pixelBounds, FilmPixelAllocator(alloc)),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
       writeFP16(writeFP16) {
@@ -492,6 +515,7 @@ RGBFilm::RGBFilm(FilmBaseParameters p, const RGBColorSpace *colorSpace,
     CHECK(!pixelBounds.IsEmpty());
     CHECK(colorSpace);
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    orderIndependentSplats = AllocOrderIndependentSplats(pixelBounds, 3, alloc);
     // Compute _outputRGBFromSensorRGB_ matrix
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 }
@@ -517,6 +541,11 @@ PBRT_CPU_GPU void RGBFilm::AddSplat(Point2f p, SampledSpectrum L, const SampledW
         // Evaluate filter at _pi_ and add splat contribution
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
+            if (orderIndependentSplats) {
+                for (int i = 0; i < 3; ++i)
+                    orderIndependentSplats->Add(pi, i, wt * rgb[i]);
+                continue;
+            }
             Pixel &pixel = pixels[pi];
             for (int i = 0; i < 3; ++i)
                 pixel.rgbSplat[i].Add(wt * rgb[i]);
@@ -646,13 +675,14 @@ GBufferFilm::GBufferFilm(FilmBaseParameters p, const AnimatedTransform &outputFr
     : FilmBase(p),
       outputFromRender(outputFromRender),
       applyInverse(applyInverse),
-      pixels(pixelBounds, alloc),
+      pixels(pixelBounds, FilmPixelAllocator(alloc)),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
       writeFP16(writeFP16),
       filterIntegral(filter.Integral()) {
     CHECK(!pixelBounds.IsEmpty());
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    orderIndependentSplats = AllocOrderIndependentSplats(pixelBounds, 3, alloc);
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 }
 
@@ -672,6 +702,11 @@ PBRT_CPU_GPU void GBufferFilm::AddSplat(Point2f p, SampledSpectrum v,
     for (Point2i pi : splatBounds) {
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
+            if (orderIndependentSplats) {
+                for (int i = 0; i < 3; ++i)
+                    orderIndependentSplats->Add(pi, i, wt * rgb[i]);
+                continue;
+            }
             Pixel &pixel = pixels[pi];
             for (int i = 0; i < 3; ++i)
                 pixel.rgbSplat[i].Add(wt * rgb[i]);
@@ -754,7 +789,7 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.rgbSplat[c] / filterIntegral;
+            rgb[c] += splatScale * SplatSum(p, c) / filterIntegral;
 
         rgb = outputRGBFromSensorRGB * rgb;
 
@@ -856,7 +891,7 @@ SpectralFilm::SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMa
       nBuckets(nBuckets),
       maxComponentValue(maxComponentValue),
       writeFP16(writeFP16),
-      pixels(p.pixelBounds, alloc) {
+      pixels(p.pixelBounds, FilmPixelAllocator(alloc)) {
     // Compute _outputRGBFromSensorRGB_ matrix
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 
@@ -870,9 +905,12 @@ SpectralFilm::SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMa
     // SpectralFilm::Pixel structure since the addresses could be computed
     // based on the base pointers and pixel coordinates.
     int nPixels = pixelBounds.Area();
-    double *bucketWeightBuffer = alloc.allocate_object<double>(2 * nBuckets * nPixels);
+    Allocator pixelAlloc = FilmPixelAllocator(alloc);
+    double *bucketWeightBuffer =
+        pixelAlloc.allocate_object<double>(2 * nBuckets * nPixels);
     std::memset(bucketWeightBuffer, 0, 2 * nBuckets * nPixels * sizeof(double));
-    AtomicDouble *splatBuffer = alloc.allocate_object<AtomicDouble>(nBuckets * nPixels);
+    AtomicDouble *splatBuffer =
+        pixelAlloc.allocate_object<AtomicDouble>(nBuckets * nPixels);
     std::memset(splatBuffer, 0, nBuckets * nPixels * sizeof(double));
 
     for (Point2i p : pixelBounds) {
@@ -884,6 +922,7 @@ SpectralFilm::SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMa
         pixel.bucketSplats = splatBuffer;
         splatBuffer += nBuckets;
     }
+    orderIndependentSplats = AllocOrderIndependentSplats(pixelBounds, 3 + nBuckets, alloc);
 }
 
 PBRT_CPU_GPU RGB SpectralFilm::GetPixelRGB(Point2i p, Float splatScale) const {
@@ -898,7 +937,7 @@ PBRT_CPU_GPU RGB SpectralFilm::GetPixelRGB(Point2i p, Float splatScale) const {
 
     // Add splat value at pixel
     for (int c = 0; c < 3; ++c)
-        rgb[c] += splatScale * pixel.rgbSplat[c] / filterIntegral;
+        rgb[c] += splatScale * SplatSum(p, c) / filterIntegral;
 
     // Convert _rgb_ to output RGB color space
     rgb = outputRGBFromSensorRGB * rgb;
@@ -939,6 +978,14 @@ PBRT_CPU_GPU void SpectralFilm::AddSplat(Point2f p, SampledSpectrum L,
         // Evaluate filter at _pi_ and add splat contribution
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
+            if (orderIndependentSplats) {
+                for (int i = 0; i < 3; ++i)
+                    orderIndependentSplats->Add(pi, i, wt * rgb[i]);
+                for (int i = 0; i < NSpectrumSamples; ++i)
+                    orderIndependentSplats->Add(pi, 3 + LambdaToBucket(lambda[i]),
+                                                wt * L[i]);
+                continue;
+            }
             Pixel &pixel = pixels[pi];
 
             for (int i = 0; i < 3; ++i)
@@ -1002,7 +1049,7 @@ Image SpectralFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
             Float c = 0;
             if (pixel.weightSums[i] > 0) {
                 c = pixel.bucketSums[i] / pixel.weightSums[i] +
-                    splatScale * pixel.bucketSplats[i] / filterIntegral;
+                    splatScale * BucketSplatSum(p, i) / filterIntegral;
                 if (writeFP16 && c > 65504) {
                     c = 65504;
                     ++nClamped;
@@ -176,6 +176,56 @@ struct FilmBaseParameters {
     std::string filename;
 };
 
+// OrderIndependentPixelSums Definition
+// Stores _nChannels_ _OrderIndependentSum_s for each pixel in _bounds_. In
+// deterministic mode, it holds the sums that are updated concurrently by
+// multiple threads: film splats and SPPM photon flux.
+class OrderIndependentPixelSums {
+  public:
+    // OrderIndependentPixelSums Public Methods
+    OrderIndependentPixelSums(Bounds2i bounds, int nChannels, Allocator alloc = {})
+        : bounds(bounds), nChannels(nChannels), alloc(alloc) {
+        sums = alloc.allocate_object<OrderIndependentSum>(Size());
+        for (size_t i = 0; i < Size(); ++i)
+            alloc.construct(sums + i);
+    }
+    ~OrderIndependentPixelSums() { alloc.deallocate_object(sums, Size()); }
+
+    OrderIndependentPixelSums(const OrderIndependentPixelSums &) = delete;
+    OrderIndependentPixelSums &operator=(const OrderIndependentPixelSums &) = delete;
+
+    PBRT_CPU_GPU
+    void Add(Point2i p, int c, double v) { sums[Offset(p, c)].Add(v); }
+    PBRT_CPU_GPU
+    double Sum(Point2i p, int c) const { return double(sums[Offset(p, c)]); }
+    PBRT_CPU_GPU
+    void Reset(Point2i p) {
+        for (int c = 0; c < nChannels; ++c)
+            sums[Offset(p, c)].Reset();
+    }
+
+    size_t BytesAllocated() const { return Size() * sizeof(OrderIndependentSum); }
+
+  private:
+    // OrderIndependentPixelSums Private Methods
+    PBRT_CPU_GPU
+    size_t Size() const { return size_t(bounds.Area()) * nChannels; }
+    PBRT_CPU_GPU
+    size_t Offset(Point2i p, int c) const {
+        DCHECK(InsideExclusive(p, bounds));
+        DCHECK(c >= 0 && c < nChannels);
+        int width = bounds.pMax.x - bounds.pMin.x;
+        return (size_t(p.y - bounds.pMin.y) * width + (p.x - bounds.pMin.x)) * nChannels +
+               c;
+    }
+
+    // OrderIndependentPixelSums Private Members
+    Bounds2i bounds;
+    int nChannels;
+    Allocator alloc;
+    OrderIndependentSum *sums;
+};
+
 // FilmBase Definition
 class FilmBase {
   public:
@@ -265,7 +315,7 @@ class RGBFilm : public FilmBase {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.rgbSplat[c] / filterIntegral;
+            rgb[c] += splatScale * SplatSum(p, c) / filterIntegral;
 
         // Convert _rgb_ to output RGB color space
         rgb = outputRGBFromSensorRGB * rgb;
@@ -295,9 +345,20 @@ class RGBFilm : public FilmBase {
         return outputRGBFromSensorRGB * sensorRGB;
     }
 
-    PBRT_CPU_GPU void ResetPixel(Point2i p) { memset(&pixels[p], 0, sizeof(Pixel)); }
+    PBRT_CPU_GPU void ResetPixel(Point2i p) {
+        memset(&pixels[p], 0, sizeof(Pixel));
+        if (orderIndependentSplats)
+            orderIndependentSplats->Reset(p);
+    }
 
   private:
+    // RGBFilm Private Methods
+    PBRT_CPU_GPU
+    double SplatSum(Point2i p, int c) const {
+        return orderIndependentSplats ? orderIndependentSplats->Sum(p, c)
+                                      : double(pixels[p].rgbSplat[c]);
+    }
+
     // RGBFilm::Pixel Definition
     struct Pixel {
         Pixel() = default;
@@ -313,6 +374,7 @@ class RGBFilm : public FilmBase {
     Float filterIntegral;
     SquareMatrix<3> outputRGBFromSensorRGB;
     Array2D<Pixel> pixels;
+    OrderIndependentPixelSums *orderIndependentSplats = nullptr;
 };
 
 // GBufferFilm Definition
@@ -357,7 +419,7 @@ class GBufferFilm : public FilmBase {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.rgbSplat[c] / filterIntegral;
+            rgb[c] += splatScale * SplatSum(p, c) / filterIntegral;
 
         rgb = outputRGBFromSensorRGB * rgb;
 
@@ -369,9 +431,20 @@ class GBufferFilm : public FilmBase {
 
     std::string ToString() const;
 
-    PBRT_CPU_GPU void ResetPixel(Point2i p) { memset(&pixels[p], 0, sizeof(Pixel)); }
+    PBRT_CPU_GPU void ResetPixel(Point2i p) {
+        memset(&pixels[p], 0, sizeof(Pixel));
+        if (orderIndependentSplats)
+            orderIndependentSplats->Reset(p);
+    }
 
   private:
+    // GBufferFilm Private Methods
+    PBRT_CPU_GPU
+    double SplatSum(Point2i p, int c) const {
+        return orderIndependentSplats ? orderIndependentSplats->Sum(p, c)
+                                      : double(pixels[p].rgbSplat[c]);
+    }
+
     // GBufferFilm::Pixel Definition
     struct Pixel {
         Pixel() = default;
@@ -395,6 +468,7 @@ class GBufferFilm : public FilmBase {
     bool writeFP16;
     Float filterIntegral;
     SquareMatrix<3> outputRGBFromSensorRGB;
+    OrderIndependentPixelSums *orderIndependentSplats = nullptr;
 };
 
 // SpectralFilm Definition
@@ -493,9 +567,12 @@ class SpectralFilm : public FilmBase {
         memset(pix.bucketSums, 0, nBuckets * sizeof(double));
         memset(pix.weightSums, 0, nBuckets * sizeof(double));
         memset(pix.bucketSplats, 0, nBuckets * sizeof(AtomicDouble));
+        if (orderIndependentSplats)
+            orderIndependentSplats->Reset(p);
     }
 
   private:
+    // SpectralFilm Private Methods
     PBRT_CPU_GPU
     int LambdaToBucket(Float lambda) const {
         DCHECK_RARE(1e6f, lambda < lambdaMin || lambda > lambdaMax);
@@ -503,6 +580,18 @@ class SpectralFilm : public FilmBase {
         return Clamp(bucket, 0, nBuckets - 1);
     }
 
+    // Channels 0-2 of _orderIndependentSplats_ are RGB; the buckets follow.
+    PBRT_CPU_GPU
+    double SplatSum(Point2i p, int c) const {
+        return orderIndependentSplats ? orderIndependentSplats->Sum(p, c)
+                                      : double(pixels[p].rgbSplat[c]);
+    }
+    PBRT_CPU_GPU
+    double BucketSplatSum(Point2i p, int b) const {
+        return orderIndependentSplats ? orderIndependentSplats->Sum(p, 3 + b)
+                                      : double(pixels[p].bucketSplats[b]);
+    }
+
     // SpectralFilm::Pixel Definition
     struct Pixel {
         Pixel() = default;
@@ -525,6 +614,7 @@ class SpectralFilm : public FilmBase {
     Float filterIntegral;
     Array2D<Pixel> pixels;
     SquareMatrix<3> outputRGBFromSensorRGB;
+    OrderIndependentPixelSums *orderIndependentSplats = nullptr;
 };
 
 PBRT_CPU_GPU
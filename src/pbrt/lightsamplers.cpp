@@ -6,6 +6,7 @@
 
 #include <pbrt/interaction.h>
 #include <pbrt/lights.h>
+#include <pbrt/options.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/hash.h>
@@ -110,6 +111,7 @@ BVHLightSampler::BVHLightSampler(pstd::span<const Light> lights, Allocator alloc
     : lights(lights.begin(), lights.end(), alloc),
       infiniteLights(alloc),
       nodes(alloc),
+      nodeReplicas(alloc),
       lightToBitTrail(alloc) {
     // Initialize _infiniteLights_ array and light BVH
     std::vector<std::pair<int, LightBounds>> bvhLights;
@@ -126,12 +128,23 @@ BVHLightSampler::BVHLightSampler(pstd::span<const Light> lights, Allocator alloc
     }
     if (!bvhLights.empty())
         buildBVH(bvhLights, 0, bvhLights.size(), 0, 0);
-    lightBVHBytes += nodes.size() * sizeof(LightBVHNode) +
+    // Replicate light BVH nodes for each NUMA node when rendering on the CPU
+    if (!Options->useGPU && !nodes.empty())
+        for (LightBVHNode *replica : NUMAReplicate(nodes.data(), nodes.size(), alloc))
+            nodeReplicas.push_back(replica);
+    lightBVHBytes += (1 + nodeReplicas.size()) * nodes.size() * sizeof(LightBVHNode) +
                      lightToBitTrail.capacity() * sizeof(uint32_t) +
                      lights.size() * sizeof(Light) +
                      infiniteLights.size() * sizeof(Light);
 }
 
+BVHLightSampler::~BVHLightSampler() {
+    // Free the NUMA replicas, which were allocated along with _nodes_
+    Allocator alloc = nodes.get_allocator();
+    for (LightBVHNode *replica : nodeReplicas)
+        alloc.deallocate_object(replica, nodes.size());
+}
+
 std::pair<int, LightBounds> BVHLightSampler::buildBVH(
     std::vector<std::pair<int, LightBounds>> &bvhLights, int start, int end,
     uint32_t bitTrail, int depth) {
@@ -12,6 +12,7 @@
 #include <pbrt/lights.h>  // LightBounds. Should that live elsewhere?
 #include <pbrt/util/containers.h>
 #include <pbrt/util/hash.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/sampling.h>
 #include <pbrt/util/vecmath.h>
@@ -261,6 +262,10 @@ class BVHLightSampler {
   public:
     // BVHLightSampler Public Methods
     BVHLightSampler(pstd::span<const Light> lights, Allocator alloc);
+    ~BVHLightSampler();
+
+    BVHLightSampler(const BVHLightSampler &) = delete;
+    BVHLightSampler &operator=(const BVHLightSampler &) = delete;
 
     PBRT_CPU_GPU
     pstd::optional<SampledLight> Sample(const LightSampleContext &ctx, Float u) const {
@@ -286,14 +291,15 @@ class BVHLightSampler {
             u = std::min<Float>((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
             int nodeIndex = 0;
             Float pmf = 1 - pInfinite;
+            const LightBVHNode *treeNodes = localNodes();
 
             while (true) {
                 // Process light BVH node for light sampling
-                LightBVHNode node = nodes[nodeIndex];
+                LightBVHNode node = treeNodes[nodeIndex];
                 if (!node.isLeaf) {
                     // Compute light BVH child node importances
-                    const LightBVHNode *children[2] = {&nodes[nodeIndex + 1],
-                                                       &nodes[node.childOrLightIndex]};
+                    const LightBVHNode *children[2] = {
+                        &treeNodes[nodeIndex + 1], &treeNodes[node.childOrLightIndex]};
                     Float ci[2] = {
                         children[0]->lightBounds.Importance(p, n, allLightBounds),
                         children[1]->lightBounds.Importance(p, n, allLightBounds)};
@@ -335,17 +341,18 @@ class BVHLightSampler {
 
         Float pmf = 1 - pInfinite;
         int nodeIndex = 0;
+        const LightBVHNode *treeNodes = localNodes();
 
         // Compute light's PMF by walking down tree nodes to the light
         while (true) {
-            const LightBVHNode *node = &nodes[nodeIndex];
+            const LightBVHNode *node = &treeNodes[nodeIndex];
             if (node->isLeaf) {
                 DCHECK_EQ(light, lights[node->childOrLightIndex]);
                 return pmf;
             }
             // Compute child importances and update PMF for current node
-            const LightBVHNode *child0 = &nodes[nodeIndex + 1];
-            const LightBVHNode *child1 = &nodes[node->childOrLightIndex];
+            const LightBVHNode *child0 = &treeNodes[nodeIndex + 1];
+            const LightBVHNode *child1 = &treeNodes[node->childOrLightIndex];
             Float ci[2] = {child0->lightBounds.Importance(p, n, allLightBounds),
                            child1->lightBounds.Importance(p, n, allLightBounds)};
             DCHECK_GT(ci[bitTrail & 1], 0);
@@ -380,6 +387,16 @@ class BVHLightSampler {
         std::vector<std::pair<int, LightBounds>> &bvhLights, int start, int end,
         uint32_t bitTrail, int depth);
 
+    // Returns the current thread's NUMA node's copy of _nodes_
+    PBRT_CPU_GPU
+    const LightBVHNode *localNodes() const {
+#ifdef PBRT_IS_GPU_CODE
+        return nodes.data();
+#else
+        return nodeReplicas.empty() ? nodes.data() : nodeReplicas[CurrentNUMANode()];
+#endif
+    }
+
     Float EvaluateCost(const LightBounds &b, const Bounds3f &bounds, int dim) const {
         // Evaluate direction bounds measure for _LightBounds_
         Float theta_o = std::acos(b.cosTheta_o), theta_e = std::acos(b.cosTheta_e);
@@ -400,6 +417,7 @@ class BVHLightSampler {
     pstd::vector<Light> infiniteLights;
     Bounds3f allLightBounds;
     pstd::vector<LightBVHNode> nodes;
+    pstd::vector<LightBVHNode *> nodeReplicas;
     HashMap<Light, uint32_t> lightToBitTrail;
 };
 
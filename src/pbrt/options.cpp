@@ -36,19 +36,24 @@ std::string PBRTOptions::ToString() const {
     return StringPrintf(
         "[ PBRTOptions seed: %s quiet: %s disablePixelJitter: %s "
         "disableWavelengthJitter: %s disableTextureFiltering: %s disableImageTextures: %s "
-        "forceDiffuse: %s useGPU: %s wavefront: %s interactive: %s fullscreen %s "
-        "renderingSpace: %s nThreads: %s logLevel: %s logFile: %s logUtilization: %s "
-        "writePartialImages: %s recordPixelStatistics: %s "
-        "printStatistics: %s pixelSamples: %s gpuDevice: %s quickRender: %s upgrade: %s "
+        "forceDiffuse: %s deterministic: %s useGPU: %s wavefront: %s interactive: %s "
+        "fullscreen %s renderingSpace: %s nThreads: %s numa: %s hugePages: %s "
+        "compactMeshes: %s memoryBudget: %d pagingDirectory: %s textureCacheBudget: %d "
+        "logLevel: %s logFile: %s "
+        "logUtilization: %s writePartialImages: %s recordPixelStatistics: %s "
+        "printStatistics: %s pixelSamples: %s gpuDevice: %s "
+        "quickRender: %s upgrade: %s "
         "imageFile: %s mseReferenceImage: %s mseReferenceOutput: %s debugStart: %s "
-        "displayServer: %s cropWindow: %s pixelBounds: %s pixelMaterial: %s "
-        "displacementEdgeScale: %f ]",
+        "displayServer: %s bvhCacheDirectory: %s cropWindow: %s pixelBounds: %s "
+        "pixelMaterial: %s displacementEdgeScale: %f ]",
         seed, quiet, disablePixelJitter, disableWavelengthJitter, disableTextureFiltering,
-        disableImageTextures, forceDiffuse, useGPU, wavefront, interactive, fullscreen,
-        renderingSpace, nThreads, logLevel, logFile, logUtilization, writePartialImages,
-        recordPixelStatistics, printStatistics, pixelSamples, gpuDevice, quickRender, upgrade,
-        imageFile, mseReferenceImage, mseReferenceOutput, debugStart, displayServer, cropWindow,
-        pixelBounds, pixelMaterial, displacementEdgeScale);
+        disableImageTextures, forceDiffuse, deterministic, useGPU, wavefront, interactive,
+        fullscreen, renderingSpace, nThreads, numa, hugePages, compactMeshes, memoryBudget,
+        pagingDirectory, textureCacheBudget, logLevel, logFile, logUtilization,
+        writePartialImages, recordPixelStatistics, printStatistics, pixelSamples,
+        gpuDevice, quickRender, upgrade,
+        imageFile, mseReferenceImage, mseReferenceOutput, debugStart, displayServer,
+        bvhCacheDirectory, cropWindow, pixelBounds, pixelMaterial, displacementEdgeScale);
 }
 
 }  // namespace pbrt
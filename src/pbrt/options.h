@@ -26,6 +26,7 @@ struct BasicPBRTOptions {
     bool disableTextureFiltering = false;
     bool disableImageTextures = false;
     bool forceDiffuse = false;
+    bool deterministic = false;
     bool useGPU = false;
     bool wavefront = false;
     bool interactive = false;
@@ -36,6 +37,14 @@ struct BasicPBRTOptions {
 // PBRTOptions Definition
 struct PBRTOptions : BasicPBRTOptions {
     int nThreads = 0;
+    bool numa = false;
+    bool hugePages = false;
+    bool compactMeshes = false;
+    // In MB; 0 disables geometry paging
+    int memoryBudget = 0;
+    std::string pagingDirectory;
+    // In MB; 0 disables the texture tile cache
+    int textureCacheBudget = 0;
     LogLevel logLevel = LogLevel::Error;
     std::string logFile;
     bool logUtilization = false;
@@ -50,6 +59,7 @@ struct PBRTOptions : BasicPBRTOptions {
     std::string mseReferenceImage, mseReferenceOutput;
     std::string debugStart;
     std::string displayServer;
+    std::string bvhCacheDirectory;
     pstd::optional<Bounds2f> cropWindow;
     pstd::optional<Bounds2i> pixelBounds;
     pstd::optional<Point2i> pixelMaterial;
@@ -17,10 +17,12 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/gui.h>
 #include <pbrt/util/memory.h>
+#include <pbrt/util/paging.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/texturecache.h>
 
 #include <ImfThreading.h>
 
@@ -87,8 +89,31 @@ void InitPBRT(const PBRTOptions &opt) {
 
     // General \pbrt Initialization
     int nThreads = Options->nThreads != 0 ? Options->nThreads : AvailableCores();
-    ParallelInit(nThreads);  // Threads must be launched before the
-                             // profiler is initialized.
+    // Threads must be launched before the profiler is initialized.
+    ParallelInit(nThreads, Options->numa);
+
+    if (Options->hugePages) {
+        if (Options->useGPU)
+            Warning("--hugepages is ignored when rendering on the GPU.");
+        else
+            EnableHugePages();
+    }
+
+    if (Options->memoryBudget > 0) {
+        if (Options->useGPU)
+            Warning("--memory-budget is ignored when rendering on the GPU.");
+        else
+            EnableGeometryPaging(Options->pagingDirectory,
+                                 size_t(Options->memoryBudget) * 1024 * 1024);
+    }
+
+    if (Options->textureCacheBudget > 0) {
+        if (Options->useGPU)
+            Warning("--texture-cache is ignored when rendering on the GPU.");
+        else
+            EnableTextureCache(Options->pagingDirectory,
+                               size_t(Options->textureCacheBudget) * 1024 * 1024);
+    }
 
     if (Options->useGPU) {
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -140,6 +165,7 @@ void CleanupPBRT() {
 
     if (Options->printStatistics) {
         PrintStats(stdout);
+        PrintMemoryReport(stdout);
         ClearStats();
     }
     if (PrintCheckRare(stdout))
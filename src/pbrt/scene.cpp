@@ -78,6 +78,13 @@ BasicSceneBuilder::GraphicsState::GraphicsState() {
 
 STAT_COUNTER("Scene/Object instances created", nObjectInstancesCreated);
 STAT_COUNTER("Scene/Object instances used", nObjectInstancesUsed);
+STAT_MEMORY_COUNTER("Memory/Scene arena: camera, film, and sampler", cameraArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: media", mediaArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: textures", textureArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: materials", materialArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: lights", lightArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: shapes", shapeArenaBytes);
+STAT_MEMORY_COUNTER("Memory/Scene arena: primitives", primitiveArenaBytes);
 
 // BasicSceneBuilder Method Definitions
 BasicSceneBuilder::BasicSceneBuilder(BasicScene *scene)
@@ -746,7 +753,7 @@ void BasicScene::SetOptions(SceneEntity filter, SceneEntity film,
 
     // Immediately create filter and film
     LOG_VERBOSE("Starting to create filter and film");
-    Allocator alloc = threadAllocators.Get();
+    Allocator alloc = threadAllocator(SceneSubsystem::Camera);
     Filter filt = Filter::Create(filter.name, filter.parameters, &filter.loc, alloc);
 
     // It's a little ugly to poke into the camera's parameters here, but we
@@ -767,7 +774,7 @@ void BasicScene::SetOptions(SceneEntity filter, SceneEntity film,
     // Enqueue asynchronous job to create sampler
     samplerJob = RunAsync([sampler, this]() {
         LOG_VERBOSE("Starting to create sampler");
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Camera);
         Point2i res = this->film.FullResolution();
         return Sampler::Create(sampler.name, sampler.parameters, res, &sampler.loc,
                                alloc);
@@ -776,7 +783,7 @@ void BasicScene::SetOptions(SceneEntity filter, SceneEntity film,
     // Enqueue asynchronous job to create camera
     cameraJob = RunAsync([camera, this]() {
         LOG_VERBOSE("Starting to create camera");
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Camera);
         Medium cameraMedium = GetMedium(camera.medium, &camera.loc);
 
         Camera c = Camera::Create(camera.name, camera.parameters, cameraMedium,
@@ -799,7 +806,7 @@ void BasicScene::AddMedium(MediumSceneEntity medium) {
 
         return Medium::Create(type, medium.parameters,
                               medium.renderFromObject.startTransform, &medium.loc,
-                              threadAllocators.Get());
+                              threadAllocator(SceneSubsystem::Media));
     };
 
     std::lock_guard<std::mutex> lock(mediaMutex);
@@ -858,15 +865,36 @@ std::unique_ptr<Integrator> BasicScene::CreateIntegrator(
 }
 
 BasicScene::BasicScene()
-    : threadAllocators([]() {
+    : threadArenas([this]() {
           pstd::pmr::memory_resource *baseResource = pstd::pmr::get_default_resource();
 #ifdef PBRT_BUILD_GPU_RENDERER
           if (Options->useGPU)
               baseResource = &CUDATrackedMemoryResource::singleton;
 #endif
-          pstd::pmr::monotonic_buffer_resource *resource =
-              new pstd::pmr::monotonic_buffer_resource(1024 * 1024, baseResource);
-          return Allocator(resource);
+          // The statistics counters are thread-local, so these refer to
+          // the counters of the thread that will use the arenas.
+          int64_t *counters[] = {&cameraArenaBytes,    &mediaArenaBytes,
+                                 &textureArenaBytes,   &materialArenaBytes,
+                                 &lightArenaBytes,     &shapeArenaBytes,
+                                 &primitiveArenaBytes};
+          static_assert(PBRT_ARRAYSIZE(counters) == int(SceneSubsystem::Count));
+          const char *tags[] = {"Scene/Camera, film, and sampler",
+                                "Scene/Media",
+                                "Scene/Textures",
+                                "Scene/Materials",
+                                "Scene/Lights",
+                                "Scene/Shapes",
+                                "Scene/Primitives"};
+          static_assert(PBRT_ARRAYSIZE(tags) == int(SceneSubsystem::Count));
+          ThreadArenas threadArenas;
+          for (int i = 0; i < int(SceneSubsystem::Count); ++i) {
+              Allocator upstream =
+                  TrackedAllocator(MemoryTag::Get(tags[i]), Allocator(baseResource));
+              arenas.push_back(std::make_unique<ArenaMemoryResource>(
+                  upstream.resource(), 1024 * 1024, counters[i]));
+              threadArenas[i] = arenas.back().get();
+          }
+          return threadArenas;
       }) {
 }
 
@@ -894,7 +922,7 @@ void BasicScene::startLoadingNormalMaps(const ParameterDictionary &parameters) {
         return;
 
     auto create = [=](std::string filename) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Textures);
         ImageAndMetadata immeta =
             Image::Read(filename, Allocator(), ColorEncoding::Linear);
         Image &image = immeta.image;
@@ -942,7 +970,7 @@ void BasicScene::AddFloatTexture(std::string name, TextureSceneEntity texture) {
     loadingTextureFilenames.insert(filename);
 
     auto create = [=](TextureSceneEntity texture) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Textures);
 
         pbrt::Transform renderFromTexture = texture.renderFromObject.startTransform;
         // Pass nullptr for the textures, since they shouldn't be accessed
@@ -986,7 +1014,7 @@ void BasicScene::AddSpectrumTexture(std::string name, TextureSceneEntity texture
     asyncSpectrumTextures.push_back(std::make_pair(name, texture));
 
     auto create = [=](TextureSceneEntity texture) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Textures);
 
         pbrt::Transform renderFromTexture = texture.renderFromObject.startTransform;
         // nullptr for the textures, as with float textures.
@@ -1012,7 +1040,7 @@ void BasicScene::AddLight(LightSceneEntity light) {
         return Light::Create(light.name, light.parameters,
                              light.renderFromObject.startTransform,
                              GetCamera().GetCameraTransform(), lightMedium, &light.loc,
-                             threadAllocators.Get());
+                             threadAllocator(SceneSubsystem::Lights));
     };
     lightJobs.push_back(RunAsync(create));
 }
@@ -1123,7 +1151,7 @@ void BasicScene::CreateMaterials(const NamedTextures &textures,
     for (const auto &nm : namedMaterials) {
         const std::string &name = nm.first;
         const SceneEntity &mtl = nm.second;
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Materials);
 
         if (namedMaterialsOut->find(name) != namedMaterialsOut->end()) {
             ErrorExit(&mtl.loc, "%s: trying to redefine named material.", name);
@@ -1155,7 +1183,7 @@ void BasicScene::CreateMaterials(const NamedTextures &textures,
     // Regular materials
     materialsOut->reserve(materials.size());
     for (const auto &mtl : materials) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Materials);
         std::string fn = ResolveFilename(mtl.parameters.GetOneString("normalmap", ""));
         Image *normalMap = nullptr;
         if (!fn.empty()) {
@@ -1192,7 +1220,7 @@ NamedTextures BasicScene::CreateTextures() {
     LOG_VERBOSE("Finished consuming texture futures");
 
     LOG_VERBOSE("Starting to create remaining textures");
-    Allocator alloc = threadAllocators.Get();
+    Allocator alloc = threadAllocator(SceneSubsystem::Textures);
     // Create the other SpectrumTypes for the spectrum textures.
     for (const auto &tex : asyncSpectrumTextures) {
         pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
@@ -1214,7 +1242,7 @@ NamedTextures BasicScene::CreateTextures() {
 
     // And do the rest serially
     for (auto &tex : serialFloatTextures) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Textures);
 
         pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
         TextureParameterDictionary texDict(&tex.second.parameters, &textures);
@@ -1224,7 +1252,7 @@ NamedTextures BasicScene::CreateTextures() {
     }
 
     for (auto &tex : serialSpectrumTextures) {
-        Allocator alloc = threadAllocators.Get();
+        Allocator alloc = threadAllocator(SceneSubsystem::Textures);
 
         if (tex.second.renderFromObject.IsAnimated())
             Warning(&tex.second.loc, "Animated world to texture transform not supported. "
@@ -1264,7 +1292,7 @@ std::vector<Light> BasicScene::CreateLights(
         return iter->second;
     };
 
-    Allocator alloc = threadAllocators.Get();
+    Allocator alloc = threadAllocator(SceneSubsystem::Lights);
 
     auto getAlphaTexture = [&](const ParameterDictionary &parameters,
                                const FileLoc *loc) -> FloatTexture {
@@ -1355,7 +1383,6 @@ Primitive BasicScene::CreateAggregate(
     const std::map<std::string, Medium> &media,
     const std::map<std::string, pbrt::Material> &namedMaterials,
     const std::vector<pbrt::Material> &materials) {
-    Allocator alloc;
     auto findMedium = [&media](const std::string &s, const FileLoc *loc) -> Medium {
         if (s.empty())
             return nullptr;
@@ -1377,9 +1404,10 @@ Primitive BasicScene::CreateAggregate(
             else
                 ErrorExit(loc, "%s: couldn't find float texture for \"alpha\" parameter.",
                           alphaTexName);
-        } else if (Float alpha = parameters.GetOneFloat("alpha", 1.f); alpha < 1.f)
+        } else if (Float alpha = parameters.GetOneFloat("alpha", 1.f); alpha < 1.f) {
+            Allocator alloc = threadAllocator(SceneSubsystem::Textures);
             return alloc.new_object<FloatConstantTexture>(alpha);
-        else
+        } else
             return nullptr;
     };
 
@@ -1390,12 +1418,16 @@ Primitive BasicScene::CreateAggregate(
         // parallelize PLY file loading, etc...
         pstd::vector<pstd::vector<pbrt::Shape>> shapeVectors(shapes.size());
         ParallelFor(0, shapes.size(), [&](int64_t i) {
+            Allocator alloc = threadAllocator(SceneSubsystem::Shapes);
             const auto &sh = shapes[i];
             shapeVectors[i] = Shape::Create(
                 sh.name, sh.renderFromObject, sh.objectFromRender, sh.reverseOrientation,
                 sh.parameters, textures.floatTextures, &sh.loc, alloc);
         });
 
+        // This may run in any thread, as instance definitions are created in
+        // parallel, so get the allocator here rather than in the caller.
+        Allocator alloc = threadAllocator(SceneSubsystem::Primitives);
         std::vector<Primitive> primitives;
         for (size_t i = 0; i < shapes.size(); ++i) {
             auto &sh = shapes[i];
@@ -1430,10 +1462,11 @@ Primitive BasicScene::CreateAggregate(
                     area = (*iter->second)[j];
 
                 if (!area && !mi.IsMediumTransition() && !alphaTex)
-                    primitives.push_back(new SimplePrimitive(shapes[j], mtl));
-                else
                     primitives.push_back(
-                        new GeometricPrimitive(shapes[j], mtl, area, mi, alphaTex));
+                        alloc.new_object<SimplePrimitive>(shapes[j], mtl));
+                else
+                    primitives.push_back(alloc.new_object<GeometricPrimitive>(
+                        shapes[j], mtl, area, mi, alphaTex));
             }
             sh.parameters.FreeParameters();
             sh = ShapeSceneEntity();
@@ -1450,13 +1483,15 @@ Primitive BasicScene::CreateAggregate(
     // Animated shapes
     auto CreatePrimitivesForAnimatedShapes =
         [&](std::vector<AnimatedShapeSceneEntity> &shapes) -> std::vector<Primitive> {
+        Allocator alloc = threadAllocator(SceneSubsystem::Primitives);
+        Allocator shapeAlloc = threadAllocator(SceneSubsystem::Shapes);
         std::vector<Primitive> primitives;
         primitives.reserve(shapes.size());
 
         for (auto &sh : shapes) {
-            pstd::vector<pbrt::Shape> shapes =
-                Shape::Create(sh.name, sh.identity, sh.identity, sh.reverseOrientation,
-                              sh.parameters, textures.floatTextures, &sh.loc, alloc);
+            pstd::vector<pbrt::Shape> shapes = Shape::Create(
+                sh.name, sh.identity, sh.identity, sh.reverseOrientation, sh.parameters,
+                textures.floatTextures, &sh.loc, shapeAlloc);
             if (shapes.empty())
                 continue;
 
@@ -1487,9 +1522,9 @@ Primitive BasicScene::CreateAggregate(
                 }
 
                 if (!mi.IsMediumTransition() && !alphaTex)
-                    prims.push_back(new SimplePrimitive(s, mtl));
+                    prims.push_back(alloc.new_object<SimplePrimitive>(s, mtl));
                 else
-                    prims.push_back(new GeometricPrimitive(
+                    prims.push_back(alloc.new_object<GeometricPrimitive>(
                         s, mtl, nullptr /* area light */, mi, alphaTex));
             }
 
@@ -1498,11 +1533,12 @@ Primitive BasicScene::CreateAggregate(
 
             // Create single _Primitive_ for _prims_
             if (prims.size() > 1) {
-                Primitive bvh = new BVHAggregate(std::move(prims));
+                Primitive bvh = alloc.new_object<BVHAggregate>(std::move(prims));
                 prims.clear();
                 prims.push_back(bvh);
             }
-            primitives.push_back(new AnimatedPrimitive(prims[0], sh.renderFromObject));
+            primitives.push_back(
+                alloc.new_object<AnimatedPrimitive>(prims[0], sh.renderFromObject));
 
             sh.parameters.FreeParameters();
             sh = AnimatedShapeSceneEntity();
@@ -1539,7 +1575,8 @@ Primitive BasicScene::CreateAggregate(
                                   movingInstancePrimitives.end());
 
         if (instancePrimitives.size() > 1) {
-            Primitive bvh = new BVHAggregate(std::move(instancePrimitives));
+            Allocator alloc = threadAllocator(SceneSubsystem::Primitives);
+            Primitive bvh = alloc.new_object<BVHAggregate>(std::move(instancePrimitives));
             instancePrimitives.clear();
             instancePrimitives.push_back(bvh);
         }
@@ -1557,6 +1594,7 @@ Primitive BasicScene::CreateAggregate(
     this->instanceDefinitions.clear();
 
     // Instances
+    Allocator alloc = threadAllocator(SceneSubsystem::Primitives);
     for (const auto &inst : instances) {
         auto iter = instanceDefinitions.find(inst.name);
         if (iter == instanceDefinitions.end())
@@ -1567,11 +1605,11 @@ Primitive BasicScene::CreateAggregate(
             continue;
 
         if (inst.renderFromInstance)
-            primitives.push_back(
-                new TransformedPrimitive(iter->second, inst.renderFromInstance));
+            primitives.push_back(alloc.new_object<TransformedPrimitive>(
+                iter->second, inst.renderFromInstance));
         else {
-            primitives.push_back(
-                new AnimatedPrimitive(iter->second, *inst.renderFromInstanceAnim));
+            primitives.push_back(alloc.new_object<AnimatedPrimitive>(
+                iter->second, *inst.renderFromInstanceAnim));
             delete inst.renderFromInstanceAnim;
         }
     }
@@ -256,6 +256,21 @@ struct TransformSet {
     Transform t[MaxTransforms];
 };
 
+// SceneSubsystem Definition
+// Objects with scene lifetime are allocated from per-thread arenas, with a
+// separate arena for each of these so that memory use can be reported
+// per subsystem.
+enum class SceneSubsystem {
+    Camera,
+    Media,
+    Textures,
+    Materials,
+    Lights,
+    Shapes,
+    Primitives,
+    Count
+};
+
 // BasicScene Definition
 class BasicScene {
   public:
@@ -340,9 +355,15 @@ class BasicScene {
 
     void startLoadingNormalMaps(const ParameterDictionary &parameters);
 
+    Allocator threadAllocator(SceneSubsystem subsystem) const {
+        return Allocator(threadArenas.Get()[int(subsystem)]);
+    }
+
     // BasicScene Private Members
+    using ThreadArenas = pstd::array<ArenaMemoryResource *, int(SceneSubsystem::Count)>;
+    std::vector<std::unique_ptr<ArenaMemoryResource>> arenas;
+    mutable ThreadLocal<ThreadArenas> threadArenas;
     AsyncJob<Sampler> *samplerJob = nullptr;
-    mutable ThreadLocal<Allocator> threadAllocators;
     Camera camera;
     Film film;
     std::mutex cameraJobMutex;
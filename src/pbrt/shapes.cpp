@@ -290,7 +290,7 @@ pstd::vector<Shape> Triangle::CreateTriangles(const TriangleMesh *mesh, Allocato
 PBRT_CPU_GPU Bounds3f Triangle::Bounds() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
+    pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
     Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
     return Union(Bounds3f(p0, p1), p2);
@@ -299,13 +299,14 @@ PBRT_CPU_GPU Bounds3f Triangle::Bounds() const {
 PBRT_CPU_GPU DirectionCone Triangle::NormalBounds() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
+    pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
     Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
     Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
     // Ensure correct orientation of geometric normal for normal bounds
-    if (mesh->n) {
-        Normal3f ns(mesh->n[v[0]] + mesh->n[v[1]] + mesh->n[v[2]]);
+    if (mesh->HasNormals()) {
+        Normal3f ns(mesh->GetNormal(v[0]) + mesh->GetNormal(v[1]) +
+                    mesh->GetNormal(v[2]));
         n = FaceForward(n, ns);
     } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
         n *= -1;
@@ -319,7 +320,7 @@ PBRT_CPU_GPU pstd::optional<ShapeIntersection> Triangle::Intersect(const Ray &ra
 #endif
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
+    pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
     Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
     pstd::optional<TriangleIntersection> triIsect =
@@ -340,7 +341,7 @@ PBRT_CPU_GPU bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
 #endif
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
+    pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
     Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
     pstd::optional<TriangleIntersection> isect = IntersectTriangle(ray, tMax, p0, p1, p2);
@@ -356,7 +357,7 @@ PBRT_CPU_GPU bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
 std::string Triangle::ToString() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     auto mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
+    pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
     const Point3f &p0 = mesh->p[v[0]];
     const Point3f &p1 = mesh->p[v[1]];
     const Point3f &p2 = mesh->p[v[2]];
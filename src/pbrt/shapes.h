@@ -849,11 +849,18 @@ class Triangle {
     PBRT_CPU_GPU
     bool IntersectP(const Ray &ray, Float tMax = Infinity) const;
 
+    PBRT_CPU_GPU
+    pstd::array<Point3f, 3> Vertices() const {
+        const TriangleMesh *mesh = GetMesh();
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
+        return {mesh->p[v[0]], mesh->p[v[1]], mesh->p[v[2]]};
+    }
+
     PBRT_CPU_GPU
     Float Area() const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
         Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
         return 0.5f * Length(Cross(p1 - p0, p2 - p0));
@@ -873,7 +880,7 @@ class Triangle {
     Float SolidAngle(Point3f p) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
         Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
         return SphericalTriangleArea(Normalize(p0 - p), Normalize(p1 - p),
@@ -885,15 +892,15 @@ class Triangle {
                                                           int triIndex,
                                                           TriangleIntersection ti,
                                                           Float time, Vector3f wo) {
-        const int *v = &mesh->vertexIndices[3 * triIndex];
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
         Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
         // Compute triangle partial derivatives
         // Compute deltas and matrix determinant for triangle partial derivatives
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->GetUV(v[0]), mesh->GetUV(v[1]), mesh->GetUV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
@@ -937,22 +944,26 @@ class Triangle {
         if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             isect.n = isect.shading.n = -isect.n;
 
-        if (mesh->n || mesh->s) {
+        if (mesh->HasNormals() || mesh->HasTangents()) {
             // Initialize _Triangle_ shading geometry
+            // Decode triangle vertex normals _n_
+            pstd::array<Normal3f, 3> n;
+            if (mesh->HasNormals())
+                n = {mesh->GetNormal(v[0]), mesh->GetNormal(v[1]), mesh->GetNormal(v[2])};
+
             // Compute shading normal _ns_ for triangle
             Normal3f ns;
-            if (mesh->n) {
-                ns =
-                    ti.b0 * mesh->n[v[0]] + ti.b1 * mesh->n[v[1]] + ti.b2 * mesh->n[v[2]];
+            if (mesh->HasNormals()) {
+                ns = ti.b0 * n[0] + ti.b1 * n[1] + ti.b2 * n[2];
                 ns = LengthSquared(ns) > 0 ? Normalize(ns) : isect.n;
             } else
                 ns = isect.n;
 
             // Compute shading tangent _ss_ for triangle
             Vector3f ss;
-            if (mesh->s) {
-                ss =
-                    ti.b0 * mesh->s[v[0]] + ti.b1 * mesh->s[v[1]] + ti.b2 * mesh->s[v[2]];
+            if (mesh->HasTangents()) {
+                ss = ti.b0 * mesh->GetTangent(v[0]) + ti.b1 * mesh->GetTangent(v[1]) +
+                     ti.b2 * mesh->GetTangent(v[2]);
                 if (LengthSquared(ss) == 0)
                     ss = isect.dpdu;
             } else
@@ -967,12 +978,12 @@ class Triangle {
 
             // Compute $\dndu$ and $\dndv$ for triangle shading geometry
             Normal3f dndu, dndv;
-            if (mesh->n) {
+            if (mesh->HasNormals()) {
                 // Compute deltas for triangle partial derivatives of normal
                 Vector2f duv02 = uv[0] - uv[2];
                 Vector2f duv12 = uv[1] - uv[2];
-                Normal3f dn1 = mesh->n[v[0]] - mesh->n[v[2]];
-                Normal3f dn2 = mesh->n[v[1]] - mesh->n[v[2]];
+                Normal3f dn1 = n[0] - n[2];
+                Normal3f dn2 = n[1] - n[2];
 
                 Float determinant =
                     DifferenceOfProducts(duv02[0], duv12[1], duv02[1], duv12[0]);
@@ -984,8 +995,7 @@ class Triangle {
                     // (rather than giving up) so that ray differentials for
                     // rays reflected from triangles with degenerate
                     // parameterizations are still reasonable.
-                    Vector3f dn = Cross(Vector3f(mesh->n[v[2]] - mesh->n[v[0]]),
-                                        Vector3f(mesh->n[v[1]] - mesh->n[v[0]]));
+                    Vector3f dn = Cross(Vector3f(n[2] - n[0]), Vector3f(n[1] - n[0]));
 
                     if (LengthSquared(dn) == 0)
                         dndu = dndv = Normal3f(0, 0, 0);
@@ -1013,7 +1023,7 @@ class Triangle {
     pstd::optional<ShapeSample> Sample(Point2f u) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
         Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
         // Sample point on triangle uniformly by area
@@ -1022,9 +1032,9 @@ class Triangle {
 
         // Compute surface normal for sampled point on triangle
         Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
-        if (mesh->n) {
-            Normal3f ns(b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
-                        (1 - b[0] - b[1]) * mesh->n[v[2]]);
+        if (mesh->HasNormals()) {
+            Normal3f ns(b[0] * mesh->GetNormal(v[0]) + b[1] * mesh->GetNormal(v[1]) +
+                        (1 - b[0] - b[1]) * mesh->GetNormal(v[2]));
             n = FaceForward(n, ns);
         } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             n *= -1;
@@ -1032,9 +1042,9 @@ class Triangle {
         // Compute $(u,v)$ for sampled point on triangle
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->GetUV(v[0]), mesh->GetUV(v[1]), mesh->GetUV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Point2f uvSample = b[0] * uv[0] + b[1] * uv[1] + b[2] * uv[2];
@@ -1053,7 +1063,7 @@ class Triangle {
     pstd::optional<ShapeSample> Sample(const ShapeSampleContext &ctx, Point2f u) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
+        pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
         Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
         // Use uniform area sampling for numerically unstable cases
@@ -1109,9 +1119,9 @@ class Triangle {
         Point3f p = b[0] * p0 + b[1] * p1 + b[2] * p2;
         // Compute surface normal for sampled point on triangle
         Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
-        if (mesh->n) {
-            Normal3f ns(b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
-                        (1 - b[0] - b[1]) * mesh->n[v[2]]);
+        if (mesh->HasNormals()) {
+            Normal3f ns(b[0] * mesh->GetNormal(v[0]) + b[1] * mesh->GetNormal(v[1]) +
+                        (1 - b[0] - b[1]) * mesh->GetNormal(v[2]));
             n = FaceForward(n, ns);
         } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             n *= -1;
@@ -1119,9 +1129,9 @@ class Triangle {
         // Compute $(u,v)$ for sampled point on triangle
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->GetUV(v[0]), mesh->GetUV(v[1]), mesh->GetUV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Point2f uvSample = b[0] * uv[0] + b[1] * uv[1] + b[2] * uv[2];
@@ -1154,7 +1164,7 @@ class Triangle {
         if (ctx.ns != Normal3f(0, 0, 0)) {
             // Get triangle vertices in _p0_, _p1_, and _p2_
             const TriangleMesh *mesh = GetMesh();
-            const int *v = &mesh->vertexIndices[3 * triIndex];
+            pstd::array<int, 3> v = mesh->GetVertexIndices(triIndex);
             Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
 
             Point2f u = InvertSphericalTriangleSample({p0, p1, p2}, ctx.p(), wi);
@@ -1180,7 +1190,10 @@ class Triangle {
 #ifdef PBRT_IS_GPU_CODE
         return (*allTriangleMeshesGPU)[meshIndex];
 #else
-        return (*allMeshes)[meshIndex];
+        const TriangleMesh *mesh = (*allMeshes)[meshIndex];
+        if (mesh->paged)
+            mesh->TouchPagedTriangle(triIndex);
+        return mesh;
 #endif
     }
 
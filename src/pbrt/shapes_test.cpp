@@ -7,6 +7,7 @@
 #include <pbrt/pbrt.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/memory.h>
@@ -16,6 +17,7 @@
 
 #include <cmath>
 #include <functional>
+#include <vector>
 
 using namespace pbrt;
 
@@ -448,6 +450,72 @@ TEST(Triangle, BadCases) {
     EXPECT_FALSE(tris[0].Intersect(ray).has_value());
 }
 
+TEST(TriangleMesh, CompactMatchesFull) {
+    RNG rng;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    std::vector<Normal3f> n;
+    std::vector<Vector3f> s;
+    std::vector<Point2f> uv;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f center(pUnif(rng), pUnif(rng), pUnif(rng));
+        for (int v = 0; v < 3; ++v) {
+            indices.push_back(p.size());
+            p.push_back(center + Vector3f(pUnif(rng, 1), pUnif(rng, 1), pUnif(rng, 1)));
+            Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+            n.push_back(Normal3f(SampleUniformSphere(u)));
+            s.push_back(SampleUniformSphere(Point2f(u[1], u[0])));
+            uv.push_back(Point2f(Lerp(u[0], -1, 2), Lerp(u[1], 0, 3)));
+        }
+    }
+
+    bool compactMeshes = Options->compactMeshes;
+    TriangleMesh *meshes[2];
+    for (int i = 0; i < 2; ++i) {
+        Options->compactMeshes = (i == 1);
+        meshes[i] = new TriangleMesh(Transform(), false, indices, p, s, n, uv, {},
+                                     Allocator());
+    }
+    Options->compactMeshes = compactMeshes;
+    EXPECT_TRUE(meshes[1]->vertexIndices16 && meshes[1]->nOct && meshes[1]->sOct &&
+                meshes[1]->uvQuantized);
+
+    for (int i = 0; i < meshes[0]->nVertices; ++i) {
+        Normal3f n0 = meshes[0]->GetNormal(i), n1 = meshes[1]->GetNormal(i);
+        EXPECT_GT(Dot(n0, n1), 0.9999f);
+        EXPECT_GT(Dot(meshes[0]->GetTangent(i), meshes[1]->GetTangent(i)), 0.9999f);
+        // The uv extents are 3, so the quantization error is at most
+        // 3 / (2 * 65535) in each dimension.
+        Point2f uv0 = meshes[0]->GetUV(i), uv1 = meshes[1]->GetUV(i);
+        EXPECT_LE(std::abs(uv0[0] - uv1[0]), 2.5e-5f);
+        EXPECT_LE(std::abs(uv0[1] - uv1[1]), 2.5e-5f);
+    }
+
+    // Intersections with corresponding triangles of the two meshes should
+    // match up to the precision of the compact encodings.
+    pstd::vector<Shape> tris[2] = {Triangle::CreateTriangles(meshes[0], Allocator()),
+                                   Triangle::CreateTriangles(meshes[1], Allocator())};
+    ASSERT_EQ(tris[0].size(), tris[1].size());
+    for (size_t i = 0; i < tris[0].size(); ++i) {
+        // Trace a ray from a random point toward a point inside the triangle
+        pstd::array<Float, 3> b =
+            SampleUniformTriangle(Point2f(rng.Uniform<Float>(), rng.Uniform<Float>()));
+        Point3f pTri = b[0] * p[3 * i] + b[1] * p[3 * i + 1] + b[2] * p[3 * i + 2];
+        Point3f o(pUnif(rng, 20), pUnif(rng, 20), pUnif(rng, 20));
+        Ray ray(o, pTri - o);
+
+        pstd::optional<ShapeIntersection> si = tris[0][i].Intersect(ray, Infinity);
+        pstd::optional<ShapeIntersection> siCompact = tris[1][i].Intersect(ray, Infinity);
+        ASSERT_EQ(si.has_value(), siCompact.has_value());
+        if (!si)
+            continue;
+        EXPECT_EQ(si->tHit, siCompact->tHit);
+        const SurfaceInteraction &isect = si->intr, &isectCompact = siCompact->intr;
+        EXPECT_LT(Distance(isect.uv, isectCompact.uv), 1e-4f);
+        EXPECT_GT(Dot(isect.shading.n, isectCompact.shading.n), 0.999f);
+    }
+}
+
 TEST(BilinearPatch, Offset) {
     RNG rng;
     for (int i = 0; i < 100; ++i) {
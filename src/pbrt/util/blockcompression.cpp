@@ -0,0 +1,355 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/blockcompression.h>
+
+#include <pbrt/util/float.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/pstd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace pbrt {
+
+// Block Compression Local Functions
+// Finds the mean of the texels' first _n_ channels and the principal axis of
+// their distribution using power iteration on their covariance matrix.
+// Returns false if all of the texels have the same value.
+static bool PrincipalAxis(const uint8_t texels[16][4], int n, float mean[4],
+                          float axis[4]) {
+    for (int c = 0; c < 4; ++c) {
+        mean[c] = 0;
+        axis[c] = 0;
+    }
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < n; ++c)
+            mean[c] += texels[i][c] / 16.f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < n; ++a)
+            for (int b = 0; b < n; ++b)
+                cov[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+
+    // Start with the row of the covariance matrix with the largest variance,
+    // which can't be orthogonal to the principal axis.
+    int start = 0;
+    for (int c = 1; c < n; ++c)
+        if (cov[c][c] > cov[start][start])
+            start = c;
+    if (cov[start][start] == 0)
+        return false;
+    for (int c = 0; c < n; ++c)
+        axis[c] = cov[start][c];
+
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = {};
+        for (int a = 0; a < n; ++a)
+            for (int b = 0; b < n; ++b)
+                next[a] += cov[a][b] * axis[b];
+        float length = 0;
+        for (int c = 0; c < n; ++c)
+            length += Sqr(next[c]);
+        length = std::sqrt(length);
+        if (length == 0)
+            return false;
+        for (int c = 0; c < n; ++c)
+            axis[c] = next[c] / length;
+    }
+    return true;
+}
+
+// Finds endpoints at the extremes of the texels' projections onto the
+// principal axis, moved inward by _inset_ times the distance between them.
+static void AxisEndpoints(const uint8_t texels[16][4], int n, const float mean[4],
+                          const float axis[4], float inset, float e0[4], float e1[4]) {
+    float tMin = Infinity, tMax = -Infinity;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0;
+        for (int c = 0; c < n; ++c)
+            t += (texels[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float delta = inset * (tMax - tMin);
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = Clamp(mean[c] + (tMax - delta) * axis[c], 0, 255);
+        e1[c] = Clamp(mean[c] + (tMin + delta) * axis[c], 0, 255);
+    }
+}
+
+// Computes the endpoints that minimize the squared error in the first _n_
+// channels when each texel is interpolated between them with weight _t[i]_
+// for the second endpoint. Returns false if the system is singular.
+static bool FitEndpoints(const uint8_t texels[16][4], int n, const float t[16],
+                         float e0[4], float e1[4]) {
+    float aa = 0, ab = 0, bb = 0, ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float a = 1 - t[i], b = t[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < n; ++c) {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-3f)
+        return false;
+    for (int c = 0; c < n; ++c) {
+        e0[c] = Clamp((bb * ax[c] - ab * bx[c]) / det, 0, 255);
+        e1[c] = Clamp((aa * bx[c] - ab * ax[c]) / det, 0, 255);
+    }
+    return true;
+}
+
+static int QuantizeBC1Endpoint(const float e[4]) {
+    int r = Clamp(int(std::round(e[0] * 31 / 255)), 0, 31);
+    int g = Clamp(int(std::round(e[1] * 63 / 255)), 0, 63);
+    int b = Clamp(int(std::round(e[2] * 31 / 255)), 0, 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+// Finds the palette entry that is closest to each texel and returns the total
+// squared error.
+static int BC1Indices(const uint8_t texels[16][4], int c0, int c1, int indices[16]) {
+    uint8_t palette[4][4];
+    for (int j = 0; j < 4; ++j)
+        BC1PaletteColor(c0, c1, j, palette[j]);
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int bestError = std::numeric_limits<int>::max();
+        for (int j = 0; j < 4; ++j) {
+            int e = 0;
+            for (int c = 0; c < 3; ++c)
+                e += Sqr(int(palette[j][c]) - int(texels[i][c]));
+            if (e < bestError) {
+                bestError = e;
+                indices[i] = j;
+            }
+        }
+        error += bestError;
+    }
+    return error;
+}
+
+static void EncodeBC4Channel(const uint8_t texels[16][4], int c, uint8_t block[8]) {
+    // Use the channel's extremes as endpoints with the eight-value palette
+    int v0 = 0, v1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        v0 = std::max<int>(v0, texels[i][c]);
+        v1 = std::min<int>(v1, texels[i][c]);
+    }
+    uint64_t bits = 0;
+    if (v0 > v1)
+        for (int i = 0; i < 16; ++i) {
+            int bestIndex = 0, bestError = 256;
+            for (int j = 0; j < 8; ++j) {
+                int e = std::abs(BC4PaletteValue(v0, v1, j) - texels[i][c]);
+                if (e < bestError) {
+                    bestError = e;
+                    bestIndex = j;
+                }
+            }
+            bits |= uint64_t(bestIndex) << (3 * i);
+        }
+
+    block[0] = v0;
+    block[1] = v1;
+    for (int b = 0; b < 6; ++b)
+        block[2 + b] = bits >> (8 * b);
+}
+
+// Finds the BC7 mode 6 palette entry that is closest to each texel in the
+// first _n_ channels for the given 8-bit endpoints and returns the total
+// squared error.
+static int BC7Indices(const uint8_t texels[16][4], int n, const int e0[4],
+                      const int e1[4], int indices[16]) {
+    int palette[16][4];
+    for (int j = 0; j < 16; ++j) {
+        int w = BC7Weight(j);
+        for (int c = 0; c < 4; ++c)
+            palette[j][c] = ((64 - w) * e0[c] + w * e1[c] + 32) >> 6;
+    }
+    int error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int bestError = std::numeric_limits<int>::max();
+        for (int j = 0; j < 16; ++j) {
+            int e = 0;
+            for (int c = 0; c < n; ++c)
+                e += Sqr(palette[j][c] - texels[i][c]);
+            if (e < bestError) {
+                bestError = e;
+                indices[i] = j;
+            }
+        }
+        error += bestError;
+    }
+    return error;
+}
+
+// BC7 mode 6 endpoints, stored as their 7-bit channel values and low bits
+struct BC7Endpoints {
+    int q[2][4];
+    int p[2];
+};
+
+// Quantizes the given endpoints, trying all four combinations of their low
+// bits, and returns the total squared error of the best one.
+static int QuantizeBC7Endpoints(const uint8_t texels[16][4], int n, const float ef0[4],
+                                const float ef1[4], BC7Endpoints *endpoints,
+                                int indices[16]) {
+    int bestError = std::numeric_limits<int>::max();
+    for (int p0 = 0; p0 < 2; ++p0)
+        for (int p1 = 0; p1 < 2; ++p1) {
+            BC7Endpoints ep;
+            ep.p[0] = p0;
+            ep.p[1] = p1;
+            int e0[4], e1[4];
+            for (int c = 0; c < 4; ++c) {
+                ep.q[0][c] = Clamp(int(std::round((ef0[c] - p0) / 2)), 0, 127);
+                ep.q[1][c] = Clamp(int(std::round((ef1[c] - p1) / 2)), 0, 127);
+                e0[c] = (ep.q[0][c] << 1) | p0;
+                e1[c] = (ep.q[1][c] << 1) | p1;
+            }
+            int idx[16];
+            int error = BC7Indices(texels, n, e0, e1, idx);
+            if (error < bestError) {
+                bestError = error;
+                *endpoints = ep;
+                std::memcpy(indices, idx, sizeof(idx));
+            }
+        }
+    return bestError;
+}
+
+static void PutBits(uint8_t block[16], int *bit, int value, int count) {
+    for (int i = 0; i < count; ++i, ++*bit)
+        if (value & (1 << i))
+            block[*bit / 8] |= 1 << (*bit % 8);
+}
+
+// Block Compression Function Definitions
+void EncodeBC1Block(const uint8_t texels[16][4], uint8_t block[8]) {
+    // Find initial endpoints along the principal axis of the texels' colors
+    float mean[4], axis[4];
+    int c0, c1;
+    if (!PrincipalAxis(texels, 3, mean, axis))
+        c0 = c1 = QuantizeBC1Endpoint(mean);
+    else {
+        float e0[4], e1[4];
+        AxisEndpoints(texels, 3, mean, axis, 1.f / 16.f, e0, e1);
+        c0 = QuantizeBC1Endpoint(e0);
+        c1 = QuantizeBC1Endpoint(e1);
+    }
+    // Order the endpoints so that the block uses the four-color palette
+    if (c0 < c1)
+        pstd::swap(c0, c1);
+    int indices[16];
+    int error = BC1Indices(texels, c0, c1, indices);
+
+    // Refine the endpoints using the texels' palette indices
+    for (int iter = 0; iter < 2 && c0 != c1; ++iter) {
+        const float paletteT[4] = {0, 1, 1.f / 3.f, 2.f / 3.f};
+        float t[16], e0[4], e1[4];
+        for (int i = 0; i < 16; ++i)
+            t[i] = paletteT[indices[i]];
+        if (!FitEndpoints(texels, 3, t, e0, e1))
+            break;
+        int n0 = QuantizeBC1Endpoint(e0), n1 = QuantizeBC1Endpoint(e1);
+        if (n0 < n1)
+            pstd::swap(n0, n1);
+        int newIndices[16];
+        int newError = BC1Indices(texels, n0, n1, newIndices);
+        if (newError >= error)
+            break;
+        c0 = n0;
+        c1 = n1;
+        error = newError;
+        std::memcpy(indices, newIndices, sizeof(indices));
+    }
+
+    // Store the endpoints and indices in the block
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= uint32_t(indices[i]) << (2 * i);
+    for (int b = 0; b < 4; ++b)
+        block[4 + b] = bits >> (8 * b);
+}
+
+void EncodeBC4Block(const uint8_t texels[16][4], uint8_t block[8]) {
+    EncodeBC4Channel(texels, 0, block);
+}
+
+void EncodeBC5Block(const uint8_t texels[16][4], uint8_t block[16]) {
+    EncodeBC4Channel(texels, 0, block);
+    EncodeBC4Channel(texels, 1, block + 8);
+}
+
+void EncodeBC7Block(const uint8_t texels[16][4], bool alpha, uint8_t block[16]) {
+    // Find initial endpoints along the principal axis of the texels' values;
+    // if alpha isn't needed, the endpoints are opaque.
+    int n = alpha ? 4 : 3;
+    float mean[4], axis[4], e0[4], e1[4];
+    if (!PrincipalAxis(texels, n, mean, axis))
+        for (int c = 0; c < 4; ++c)
+            e0[c] = e1[c] = mean[c];
+    else
+        AxisEndpoints(texels, n, mean, axis, 0, e0, e1);
+    if (!alpha)
+        e0[3] = e1[3] = 255;
+    BC7Endpoints endpoints;
+    int indices[16];
+    int error = QuantizeBC7Endpoints(texels, n, e0, e1, &endpoints, indices);
+
+    // Refine the endpoints using the texels' palette indices
+    for (int iter = 0; iter < 2; ++iter) {
+        float t[16];
+        for (int i = 0; i < 16; ++i)
+            t[i] = BC7Weight(indices[i]) / 64.f;
+        if (!FitEndpoints(texels, n, t, e0, e1))
+            break;
+        BC7Endpoints newEndpoints;
+        int newIndices[16];
+        int newError =
+            QuantizeBC7Endpoints(texels, n, e0, e1, &newEndpoints, newIndices);
+        if (newError >= error)
+            break;
+        error = newError;
+        endpoints = newEndpoints;
+        std::memcpy(indices, newIndices, sizeof(indices));
+    }
+
+    // Swap the endpoints if necessary so that the first index's high bit is zero
+    if (indices[0] >= 8) {
+        for (int c = 0; c < 4; ++c)
+            pstd::swap(endpoints.q[0][c], endpoints.q[1][c]);
+        pstd::swap(endpoints.p[0], endpoints.p[1]);
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    // Store the mode, endpoints, and indices in the block
+    std::memset(block, 0, 16);
+    int bit = 0;
+    PutBits(block, &bit, 0x40, 7);
+    for (int c = 0; c < 4; ++c) {
+        PutBits(block, &bit, endpoints.q[0][c], 7);
+        PutBits(block, &bit, endpoints.q[1][c], 7);
+    }
+    PutBits(block, &bit, endpoints.p[0], 1);
+    PutBits(block, &bit, endpoints.p[1], 1);
+    for (int i = 0; i < 16; ++i)
+        PutBits(block, &bit, indices[i], i == 0 ? 3 : 4);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,153 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_BLOCKCOMPRESSION_H
+#define PBRT_UTIL_BLOCKCOMPRESSION_H
+
+#include <pbrt/pbrt.h>
+
+#include <cstdint>
+
+namespace pbrt {
+
+// Block Compression Definitions
+// The BC1, BC4, BC5, and BC7 formats store 4x4 blocks of 8-bit texels in 8
+// or 16 bytes; texels are numbered in scanline order within a block. The
+// decoding functions return a single texel's channels as RGBA; channels that
+// a format doesn't store are 0, except for alpha, which is 255.
+
+// BC1 stores two RGB 5:6:5 endpoints and a 2-bit index for each texel that
+// selects one of four colors on the line between them. If the first endpoint
+// is not greater than the second, the fourth color is transparent black.
+PBRT_CPU_GPU inline void BC1ExpandEndpoint(int c, int e[3]) {
+    // Replicate the high bits of each 5- or 6-bit value to find its 8-bit value
+    int r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    e[0] = (r << 3) | (r >> 2);
+    e[1] = (g << 2) | (g >> 4);
+    e[2] = (b << 3) | (b >> 2);
+}
+
+PBRT_CPU_GPU inline void BC1PaletteColor(int c0, int c1, int index, uint8_t rgba[4]) {
+    int e0[3], e1[3];
+    BC1ExpandEndpoint(c0, e0);
+    BC1ExpandEndpoint(c1, e1);
+    rgba[3] = 255;
+    for (int c = 0; c < 3; ++c) {
+        if (index == 0)
+            rgba[c] = e0[c];
+        else if (index == 1)
+            rgba[c] = e1[c];
+        else if (c0 > c1)
+            rgba[c] = index == 2 ? (2 * e0[c] + e1[c] + 1) / 3
+                                 : (e0[c] + 2 * e1[c] + 1) / 3;
+        else if (index == 2)
+            rgba[c] = (e0[c] + e1[c] + 1) / 2;
+        else {
+            rgba[c] = 0;
+            rgba[3] = 0;
+        }
+    }
+}
+
+PBRT_CPU_GPU inline void DecodeBC1Texel(const uint8_t *block, int i, uint8_t rgba[4]) {
+    int c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    int index = (block[4 + i / 4] >> (2 * (i % 4))) & 3;
+    BC1PaletteColor(c0, c1, index, rgba);
+}
+
+// BC4 stores a single channel as two 8-bit endpoints and a 3-bit index for
+// each texel. If the first endpoint is greater than the second, the indices
+// select one of eight values between them; otherwise, they select one of
+// six, 0, or 255.
+PBRT_CPU_GPU inline uint8_t BC4PaletteValue(int v0, int v1, int index) {
+    if (index == 0)
+        return v0;
+    else if (index == 1)
+        return v1;
+    else if (v0 > v1)
+        return ((8 - index) * v0 + (index - 1) * v1 + 3) / 7;
+    else if (index < 6)
+        return ((6 - index) * v0 + (index - 1) * v1 + 2) / 5;
+    else
+        return index == 6 ? 0 : 255;
+}
+
+PBRT_CPU_GPU inline uint8_t DecodeBC4Value(const uint8_t *block, int i) {
+    // Extract the texel's index from the 48 bits that follow the endpoints
+    int bit = 16 + 3 * i;
+    int bits = block[bit / 8];
+    if (bit % 8 > 5)
+        bits |= block[bit / 8 + 1] << 8;
+    int index = (bits >> (bit % 8)) & 7;
+    return BC4PaletteValue(block[0], block[1], index);
+}
+
+PBRT_CPU_GPU inline void DecodeBC4Texel(const uint8_t *block, int i, uint8_t rgba[4]) {
+    rgba[0] = DecodeBC4Value(block, i);
+    rgba[1] = rgba[2] = 0;
+    rgba[3] = 255;
+}
+
+// BC5 stores two channels as a pair of BC4 blocks.
+PBRT_CPU_GPU inline void DecodeBC5Texel(const uint8_t *block, int i, uint8_t rgba[4]) {
+    rgba[0] = DecodeBC4Value(block, i);
+    rgba[1] = DecodeBC4Value(block + 8, i);
+    rgba[2] = 0;
+    rgba[3] = 255;
+}
+
+// BC7 blocks may be encoded in one of eight modes. Only mode 6 is supported:
+// it stores two RGBA endpoints with 7 bits per channel and a shared low bit
+// for each endpoint along with a 4-bit index for each texel. The index of
+// the first texel is stored with 3 bits; its high bit is always zero. pbrt
+// only writes mode 6 blocks; _DecodeBC7Mode6Texel()_ returns zero for blocks
+// in any other mode, so data from elsewhere should be checked with
+// _IsBC7Mode6Block()_.
+PBRT_CPU_GPU inline int BC7Weight(int index) {
+    // The BC7 4-bit interpolation weights are 64 * index / 15, rounded.
+    return (index * 64 + 7) / 15;
+}
+
+PBRT_CPU_GPU inline int BC7Bits(const uint8_t *block, int bit, int count) {
+    // Extract up to 8 bits starting at the given bit
+    int value = block[bit / 8];
+    if (bit / 8 + 1 < 16)
+        value |= block[bit / 8 + 1] << 8;
+    return (value >> (bit % 8)) & ((1 << count) - 1);
+}
+
+PBRT_CPU_GPU inline bool IsBC7Mode6Block(const uint8_t *block) {
+    // The mode is given by the position of the lowest set bit
+    return (block[0] & 0x7f) == 0x40;
+}
+
+PBRT_CPU_GPU inline void DecodeBC7Mode6Texel(const uint8_t *block, int i,
+                                             uint8_t rgba[4]) {
+    if (!IsBC7Mode6Block(block)) {
+        rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+        return;
+    }
+    // Find the endpoints, including their low bits
+    int p0 = BC7Bits(block, 63, 1), p1 = BC7Bits(block, 64, 1);
+    int index = i == 0 ? BC7Bits(block, 65, 3) : BC7Bits(block, 64 + 4 * i, 4);
+    int w = BC7Weight(index);
+    for (int c = 0; c < 4; ++c) {
+        int e0 = BC7Bits(block, 7 + 14 * c, 7) << 1 | p0;
+        int e1 = BC7Bits(block, 14 + 14 * c, 7) << 1 | p1;
+        rgba[c] = ((64 - w) * e0 + w * e1 + 32) >> 6;
+    }
+}
+
+// Block Compression Function Declarations
+// The encoding functions take the RGBA values of a block's texels; channels
+// that the format doesn't store are ignored. If _alpha_ is false, BC7 blocks
+// are encoded without regard to the alpha channel.
+void EncodeBC1Block(const uint8_t texels[16][4], uint8_t block[8]);
+void EncodeBC4Block(const uint8_t texels[16][4], uint8_t block[8]);
+void EncodeBC5Block(const uint8_t texels[16][4], uint8_t block[16]);
+void EncodeBC7Block(const uint8_t texels[16][4], bool alpha, uint8_t block[16]);
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_BLOCKCOMPRESSION_H
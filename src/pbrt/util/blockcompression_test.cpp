@@ -0,0 +1,111 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/blockcompression.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/rng.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace pbrt;
+
+// Encodes the texels in the given format and returns the largest error in
+// the first _nChannels_ channels after decoding them.
+static int RoundTripError(PixelFormat format, const uint8_t texels[16][4],
+                          int nChannels) {
+    uint8_t block[16];
+    switch (format) {
+    case PixelFormat::BC1:
+        EncodeBC1Block(texels, block);
+        break;
+    case PixelFormat::BC4:
+        EncodeBC4Block(texels, block);
+        break;
+    case PixelFormat::BC5:
+        EncodeBC5Block(texels, block);
+        break;
+    case PixelFormat::BC7:
+        EncodeBC7Block(texels, nChannels == 4, block);
+        break;
+    default:
+        LOG_FATAL("Unhandled PixelFormat");
+    }
+
+    int maxError = 0;
+    for (int i = 0; i < 16; ++i) {
+        uint8_t rgba[4];
+        switch (format) {
+        case PixelFormat::BC1:
+            DecodeBC1Texel(block, i, rgba);
+            break;
+        case PixelFormat::BC4:
+            DecodeBC4Texel(block, i, rgba);
+            break;
+        case PixelFormat::BC5:
+            DecodeBC5Texel(block, i, rgba);
+            break;
+        case PixelFormat::BC7:
+            DecodeBC7Mode6Texel(block, i, rgba);
+            break;
+        default:
+            LOG_FATAL("Unhandled PixelFormat");
+        }
+        for (int c = 0; c < nChannels; ++c)
+            maxError = std::max(maxError, std::abs(int(rgba[c]) - int(texels[i][c])));
+    }
+    return maxError;
+}
+
+TEST(BlockCompression, Constant) {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        uint8_t texels[16][4];
+        uint8_t value[4];
+        for (int c = 0; c < 4; ++c)
+            value[c] = rng.Uniform<uint32_t>() & 0xff;
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 4; ++c)
+                texels[i][c] = value[c];
+
+        // Single-channel formats store constant blocks exactly; BC1 quantizes
+        // to 5 and 6 bits and BC7 to 7 bits plus a shared low bit.
+        EXPECT_EQ(0, RoundTripError(PixelFormat::BC4, texels, 1));
+        EXPECT_EQ(0, RoundTripError(PixelFormat::BC5, texels, 2));
+        EXPECT_LE(RoundTripError(PixelFormat::BC1, texels, 3), 4);
+        EXPECT_LE(RoundTripError(PixelFormat::BC7, texels, 4), 1);
+    }
+}
+
+TEST(BlockCompression, Line) {
+    // Texels that lie on a line through color space can be represented well
+    // by all of the formats.
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        uint8_t texels[16][4];
+        int v0[4], v1[4];
+        for (int c = 0; c < 4; ++c) {
+            v0[c] = rng.Uniform<uint32_t>() & 0xff;
+            v1[c] = rng.Uniform<uint32_t>() & 0xff;
+        }
+        for (int i = 0; i < 16; ++i) {
+            Float t = rng.Uniform<Float>();
+            for (int c = 0; c < 4; ++c)
+                texels[i][c] = std::round((1 - t) * v0[c] + t * v1[c]);
+        }
+
+        int range = 0;
+        for (int c = 0; c < 4; ++c)
+            range = std::max(range, std::abs(v1[c] - v0[c]));
+        EXPECT_LE(RoundTripError(PixelFormat::BC4, texels, 1), range / 14 + 1);
+        EXPECT_LE(RoundTripError(PixelFormat::BC5, texels, 2), range / 14 + 1);
+        EXPECT_LE(RoundTripError(PixelFormat::BC1, texels, 3), range / 6 + 8);
+        EXPECT_LE(RoundTripError(PixelFormat::BC7, texels, 3), range / 30 + 4);
+        EXPECT_LE(RoundTripError(PixelFormat::BC7, texels, 4), range / 30 + 4);
+    }
+}
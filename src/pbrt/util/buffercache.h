@@ -9,6 +9,7 @@
 
 #include <pbrt/util/check.h>
 #include <pbrt/util/hash.h>
+#include <pbrt/util/memory.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/stats.h>
@@ -49,7 +50,13 @@ class BufferCache {
 
         // Add _buf_ contents to cache and return pointer to cached copy
         mutex[shardIndex].unlock_shared();
-        T *ptr = alloc.allocate_object<T>(buf.size());
+        // Only track buffers allocated outside of _alloc_; memory from _alloc_
+        // is already accounted for by whoever provided it.
+        static MemoryTag *tag = MemoryTag::Get("Geometry/Shared buffers");
+        Allocator hugePageAlloc = HugePageAllocator(alloc, buf.size() * sizeof(T));
+        Allocator bufferAlloc =
+            hugePageAlloc == alloc ? alloc : TrackedAllocator(tag, hugePageAlloc);
+        T *ptr = bufferAlloc.allocate_object<T>(buf.size());
         std::copy(buf.begin(), buf.end(), ptr);
         bytesUsed += buf.size() * sizeof(T);
         mutex[shardIndex].lock();
@@ -58,7 +65,7 @@ class BufferCache {
             iter != cache[shardIndex].end()) {
             const T *cachePtr = iter->ptr;
             mutex[shardIndex].unlock();
-            alloc.deallocate_object(ptr, buf.size());
+            bufferAlloc.deallocate_object(ptr, buf.size());
             ++nBufferCacheHits;
             redundantBufferBytes += buf.size() * sizeof(T);
             return cachePtr;
@@ -104,10 +111,12 @@ class BufferCache {
 
 // BufferCache Global Declarations
 extern BufferCache<int> *intBufferCache;
+extern BufferCache<uint16_t> *uint16BufferCache;
 extern BufferCache<Point2f> *point2BufferCache;
 extern BufferCache<Point3f> *point3BufferCache;
 extern BufferCache<Vector3f> *vector3BufferCache;
 extern BufferCache<Normal3f> *normal3BufferCache;
+extern BufferCache<OctahedralVector> *octahedralVectorBufferCache;
 
 void InitBufferCaches();
 
@@ -468,6 +468,8 @@ class GammaColorEncoding {
     PBRT_CPU_GPU
     void FromLinear(pstd::span<const Float> vin, pstd::span<uint8_t> vout) const;
 
+    Float Gamma() const { return gamma; }
+
     std::string ToString() const;
 
   private:
@@ -35,7 +35,9 @@
 #endif
 
 #include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstring>
 #include <numeric>
 
 // use lodepng and get 16-bit.
@@ -60,12 +62,51 @@ std::string ToString(PixelFormat format) {
         return "Half";
     case PixelFormat::Float:
         return "Float";
+    case PixelFormat::BC1:
+        return "BC1";
+    case PixelFormat::BC4:
+        return "BC4";
+    case PixelFormat::BC5:
+        return "BC5";
+    case PixelFormat::BC7:
+        return "BC7";
     default:
         LOG_FATAL("Unhandled PixelFormat in FormatName()");
         return "";
     }
 }
 
+pstd::optional<PixelFormat> ParsePixelFormat(const std::string &name) {
+    // Accept the names returned by _ToString()_ as well as lowercase ones
+    for (PixelFormat format :
+         {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float, PixelFormat::BC1,
+          PixelFormat::BC4, PixelFormat::BC5, PixelFormat::BC7}) {
+        std::string formatName = ToString(format);
+        if (name == formatName)
+            return format;
+        std::transform(formatName.begin(), formatName.end(), formatName.begin(),
+                       [](char c) { return std::tolower(c); });
+        if (name == formatName)
+            return format;
+    }
+    return {};
+}
+
+bool SupportsChannels(PixelFormat format, int nChannels) {
+    switch (format) {
+    case PixelFormat::BC1:
+        return nChannels == 3;
+    case PixelFormat::BC4:
+        return nChannels == 1;
+    case PixelFormat::BC5:
+        return nChannels == 2;
+    case PixelFormat::BC7:
+        return nChannels == 3 || nChannels == 4;
+    default:
+        return nChannels > 0;
+    }
+}
+
 PBRT_CPU_GPU int TexelBytes(PixelFormat format) {
     switch (format) {
     case PixelFormat::U256:
@@ -133,7 +174,7 @@ void ForExtent(const Bounds2i &extent, WrapMode2D wrapMode, const Image &image,
 
 // Image Method Definitions
 bool Image::HasAnyInfinitePixels() const {
-    if (format == PixelFormat::U256)
+    if (Is8Bit(format) || IsBlockCompressed(format))
         return false;
 
     for (int y = 0; y < resolution.y; ++y)
@@ -145,7 +186,7 @@ bool Image::HasAnyInfinitePixels() const {
 }
 
 bool Image::HasAnyNaNPixels() const {
-    if (format == PixelFormat::U256)
+    if (Is8Bit(format) || IsBlockCompressed(format))
         return false;
 
     for (int y = 0; y < resolution.y; ++y)
@@ -238,71 +279,8 @@ Image Image::FloatResizeUp(Point2i newRes, WrapMode2D wrapMode) const {
 
     // Resize image in parallel, working by tiles
     ParallelFor2D(Bounds2i({0, 0}, newRes), [&](Bounds2i outExtent) {
-        // Determine extent in source image and copy pixel values to _inBuf_
-        Bounds2i inExtent(Point2i(xWeights[outExtent.pMin.x].firstPixel,
-                                  yWeights[outExtent.pMin.y].firstPixel),
-                          Point2i(xWeights[outExtent.pMax.x - 1].firstPixel + 4,
-                                  yWeights[outExtent.pMax.y - 1].firstPixel + 4));
-        std::vector<float> inBuf(NChannels() * inExtent.Area());
-        CopyRectOut(inExtent, pstd::span<float>(inBuf), wrapMode);
-
-        // Resize image in the $x$ dimension
-        // Compute image extents and allocate _xBuf_
-        int nxOut = outExtent.pMax.x - outExtent.pMin.x;
-        int nyOut = outExtent.pMax.y - outExtent.pMin.y;
-        int nxIn = inExtent.pMax.x - inExtent.pMin.x;
-        int nyIn = inExtent.pMax.y - inExtent.pMin.y;
-        std::vector<float> xBuf(NChannels() * nyIn * nxOut);
-
-        int xBufOffset = 0;
-        for (int yOut = inExtent.pMin.y; yOut < inExtent.pMax.y; ++yOut) {
-            for (int xOut = outExtent.pMin.x; xOut < outExtent.pMax.x; ++xOut) {
-                // Resample image pixel _(xOut, yOut)_
-                DCHECK(xOut >= 0 && xOut < xWeights.size());
-                const ResampleWeight &rsw = xWeights[xOut];
-                // Compute _inOffset_ into _inBuf_ for _(xOut, yOut)_
-                // w.r.t. inBuf
-                int xIn = rsw.firstPixel - inExtent.pMin.x;
-                DCHECK_GE(xIn, 0);
-                DCHECK_LT(xIn + 3, nxIn);
-                int yIn = yOut - inExtent.pMin.y;
-                int inOffset = NChannels() * (xIn + yIn * nxIn);
-                DCHECK_GE(inOffset, 0);
-                DCHECK_LT(inOffset + 3 * NChannels(), inBuf.size());
-
-                for (int c = 0; c < NChannels(); ++c, ++xBufOffset, ++inOffset)
-                    xBuf[xBufOffset] = rsw.weight[0] * inBuf[inOffset] +
-                                       rsw.weight[1] * inBuf[inOffset + NChannels()] +
-                                       rsw.weight[2] * inBuf[inOffset + 2 * NChannels()] +
-                                       rsw.weight[3] * inBuf[inOffset + 3 * NChannels()];
-            }
-        }
-
-        // Resize image in the $y$ dimension
-        std::vector<float> outBuf(NChannels() * nxOut * nyOut);
-        for (int x = 0; x < nxOut; ++x) {
-            for (int y = 0; y < nyOut; ++y) {
-                int yOut = y + outExtent[0][1];
-                DCHECK(yOut >= 0 && yOut < yWeights.size());
-                const ResampleWeight &rsw = yWeights[yOut];
-
-                DCHECK_GE(rsw.firstPixel - inExtent[0][1], 0);
-                int xBufOffset =
-                    NChannels() * (x + nxOut * (rsw.firstPixel - inExtent[0][1]));
-                DCHECK_GE(xBufOffset, 0);
-                int step = NChannels() * nxOut;
-                DCHECK_LT(xBufOffset + 3 * step, xBuf.size());
-
-                int outOffset = NChannels() * (x + y * nxOut);
-                for (int c = 0; c < NChannels(); ++c, ++outOffset, ++xBufOffset)
-                    outBuf[outOffset] =
-                        std::max<Float>(0, (rsw.weight[0] * xBuf[xBufOffset] +
-                                            rsw.weight[1] * xBuf[xBufOffset + step] +
-                                            rsw.weight[2] * xBuf[xBufOffset + 2 * step] +
-                                            rsw.weight[3] * xBuf[xBufOffset + 3 * step]));
-            }
-        }
-
+        std::vector<float> outBuf(NChannels() * outExtent.Area());
+        ResizeUpRect(outExtent, xWeights, yWeights, wrapMode, pstd::MakeSpan(outBuf));
         // Copy resampled image pixels out into _resampledImage_
         resampledImage.CopyRectIn(outExtent, outBuf);
     });
@@ -310,25 +288,163 @@ Image Image::FloatResizeUp(Point2i newRes, WrapMode2D wrapMode) const {
     return resampledImage;
 }
 
+void Image::ResizeUpRect(const Bounds2i &outExtent,
+                         const std::vector<ResampleWeight> &xWeights,
+                         const std::vector<ResampleWeight> &yWeights,
+                         WrapMode2D wrapMode, pstd::span<float> outBuf) const {
+    // Determine extent in source image and copy pixel values to _inBuf_
+    Bounds2i inExtent(Point2i(xWeights[outExtent.pMin.x].firstPixel,
+                              yWeights[outExtent.pMin.y].firstPixel),
+                      Point2i(xWeights[outExtent.pMax.x - 1].firstPixel + 4,
+                              yWeights[outExtent.pMax.y - 1].firstPixel + 4));
+    std::vector<float> inBuf(NChannels() * inExtent.Area());
+    CopyRectOut(inExtent, pstd::span<float>(inBuf), wrapMode);
+
+    // Resize image in the $x$ dimension
+    // Compute image extents and allocate _xBuf_
+    int nxOut = outExtent.pMax.x - outExtent.pMin.x;
+    int nyOut = outExtent.pMax.y - outExtent.pMin.y;
+    int nxIn = inExtent.pMax.x - inExtent.pMin.x;
+    int nyIn = inExtent.pMax.y - inExtent.pMin.y;
+    std::vector<float> xBuf(NChannels() * nyIn * nxOut);
+
+    int xBufOffset = 0;
+    for (int yOut = inExtent.pMin.y; yOut < inExtent.pMax.y; ++yOut) {
+        for (int xOut = outExtent.pMin.x; xOut < outExtent.pMax.x; ++xOut) {
+            // Resample image pixel _(xOut, yOut)_
+            DCHECK(xOut >= 0 && xOut < xWeights.size());
+            const ResampleWeight &rsw = xWeights[xOut];
+            // Compute _inOffset_ into _inBuf_ for _(xOut, yOut)_
+            // w.r.t. inBuf
+            int xIn = rsw.firstPixel - inExtent.pMin.x;
+            DCHECK_GE(xIn, 0);
+            DCHECK_LT(xIn + 3, nxIn);
+            int yIn = yOut - inExtent.pMin.y;
+            int inOffset = NChannels() * (xIn + yIn * nxIn);
+            DCHECK_GE(inOffset, 0);
+            DCHECK_LT(inOffset + 3 * NChannels(), inBuf.size());
+
+            for (int c = 0; c < NChannels(); ++c, ++xBufOffset, ++inOffset)
+                xBuf[xBufOffset] = rsw.weight[0] * inBuf[inOffset] +
+                                   rsw.weight[1] * inBuf[inOffset + NChannels()] +
+                                   rsw.weight[2] * inBuf[inOffset + 2 * NChannels()] +
+                                   rsw.weight[3] * inBuf[inOffset + 3 * NChannels()];
+        }
+    }
+
+    // Resize image in the $y$ dimension
+    CHECK_EQ(outBuf.size(), NChannels() * nxOut * nyOut);
+    for (int x = 0; x < nxOut; ++x) {
+        for (int y = 0; y < nyOut; ++y) {
+            int yOut = y + outExtent[0][1];
+            DCHECK(yOut >= 0 && yOut < yWeights.size());
+            const ResampleWeight &rsw = yWeights[yOut];
+
+            DCHECK_GE(rsw.firstPixel - inExtent[0][1], 0);
+            int xBufOffset =
+                NChannels() * (x + nxOut * (rsw.firstPixel - inExtent[0][1]));
+            DCHECK_GE(xBufOffset, 0);
+            int step = NChannels() * nxOut;
+            DCHECK_LT(xBufOffset + 3 * step, xBuf.size());
+
+            int outOffset = NChannels() * (x + y * nxOut);
+            for (int c = 0; c < NChannels(); ++c, ++outOffset, ++xBufOffset)
+                outBuf[outOffset] =
+                    std::max<Float>(0, (rsw.weight[0] * xBuf[xBufOffset] +
+                                        rsw.weight[1] * xBuf[xBufOffset + step] +
+                                        rsw.weight[2] * xBuf[xBufOffset + 2 * step] +
+                                        rsw.weight[3] * xBuf[xBufOffset + 3 * step]));
+        }
+    }
+}
+
 pstd::vector<Image> Image::GeneratePyramid(Image image, WrapMode2D wrapMode,
                                            Allocator alloc) {
+    if (IsBlockCompressed(image.format)) {
+        // Generate the pyramid from the decoded image and compress its levels
+        PixelFormat format = image.format;
+        ColorEncoding encoding = image.encoding;
+        pstd::vector<Image> levels = GeneratePyramid(
+            image.ConvertToFormat(PixelFormat::U256, encoding), wrapMode);
+        pstd::vector<Image> pyramid(alloc);
+        for (const Image &level : levels) {
+            Image compressed = level.ConvertToFormat(format, encoding);
+            pyramid.push_back(Image(format, compressed.resolution,
+                                    compressed.channelNames, encoding, alloc));
+            std::memcpy(pyramid.back().p8.data(), compressed.p8.data(),
+                        compressed.p8.size());
+        }
+        return pyramid;
+    }
+
     PixelFormat origFormat = image.format;
     int nChannels = image.NChannels();
     ColorEncoding origEncoding = image.encoding;
-    // Prepare _image_ for building pyramid
-    if (!IsPowerOf2(image.resolution[0]) || !IsPowerOf2(image.resolution[1]))
-        image = image.FloatResizeUp(
-            Point2i(RoundUpPow2(image.resolution[0]), RoundUpPow2(image.resolution[1])),
-            wrapMode);
-    else if (!Is32Bit(image.format))
-        image = image.ConvertToFormat(PixelFormat::Float);
-    CHECK(Is32Bit(image.format));
+    // Find the resolution of the pyramid's first level, which is resampled up
+    // to a power of 2 if necessary
+    Point2i resolution0(RoundUpPow2(image.resolution[0]),
+                        RoundUpPow2(image.resolution[1]));
+    bool resize = resolution0 != image.resolution;
+    std::vector<ResampleWeight> xWeights, yWeights;
+    if (resize) {
+        xWeights = ResampleWeights(image.resolution[0], resolution0[0]);
+        yWeights = ResampleWeights(image.resolution[1], resolution0[1]);
+    }
 
     // Initialize levels of pyramid from _image_
-    int nLevels = 1 + Log2Int(std::max(image.resolution[0], image.resolution[1]));
+    int nLevels = 1 + Log2Int(std::max(resolution0[0], resolution0[1]));
     pstd::vector<Image> pyramid(alloc);
     pyramid.reserve(nLevels);
-    for (int i = 0; i < nLevels - 1; ++i) {
+    pyramid.push_back(
+        Image(origFormat, resolution0, image.channelNames, origEncoding, alloc));
+    if (nLevels == 1) {
+        std::memcpy(pyramid[0].RawPointer({0, 0}), image.RawPointer({0, 0}),
+                    image.BytesUsed());
+        return pyramid;
+    }
+
+    // Compute the first level and downsample it in bands of scanlines so that
+    // only the second level is stored as _Float_ values
+    Point2i resolution1(std::max(1, resolution0[0] / 2),
+                        std::max(1, resolution0[1] / 2));
+    Image nextImage(PixelFormat::Float, resolution1, image.channelNames, origEncoding);
+    constexpr int BandScanlines = 8;
+    int nBands = (resolution1[1] + BandScanlines - 1) / BandScanlines;
+    ParallelFor(0, nBands, [&](int64_t band) {
+        // Compute or copy the band's scanlines of the first level
+        int y0 = band * BandScanlines;
+        int y1 = std::min(y0 + BandScanlines, resolution1[1]);
+        Bounds2i extent({0, 2 * y0}, {resolution0[0], std::min(2 * y1, resolution0[1])});
+        std::vector<float> scanlines(nChannels * extent.Area());
+        if (resize) {
+            image.ResizeUpRect(extent, xWeights, yWeights, wrapMode,
+                               pstd::MakeSpan(scanlines));
+            pyramid[0].CopyRectIn(extent, scanlines);
+        } else {
+            image.CopyRectOut(extent, pstd::MakeSpan(scanlines));
+            size_t rowBytes = TexelBytes(origFormat) * nChannels * resolution0[0];
+            for (int y = extent.pMin.y; y < extent.pMax.y; ++y)
+                std::memcpy(pyramid[0].RawPointer({0, y}), image.RawPointer({0, y}),
+                            rowBytes);
+        }
+
+        // Downsample the band's scanlines to the second level
+        int rowLength = nChannels * resolution0[0];
+        int dx = resolution0[0] == 1 ? 0 : nChannels;
+        int dy = resolution0[1] == 1 ? 0 : rowLength;
+        for (int y = y0; y < y1; ++y) {
+            const float *src = scanlines.data() + (2 * (y - y0)) * rowLength;
+            int nextOffset = nextImage.PixelOffset(Point2i(0, y));
+            for (int x = 0; x < resolution1[0]; ++x, src += dx)
+                for (int c = 0; c < nChannels; ++c, ++src, ++nextOffset)
+                    nextImage.p32[nextOffset] =
+                        (src[0] + src[dx] + src[dy] + src[dy + dx]) / 4;
+        }
+    });
+    // Free the original image now that it isn't needed
+    image = std::move(nextImage);
+
+    for (int i = 1; i < nLevels - 1; ++i) {
         // Initialize $i+1$st level from $i$th level and copy $i$th into pyramid
         pyramid.push_back(
             Image(origFormat, image.resolution, image.channelNames, origEncoding, alloc));
@@ -399,7 +515,13 @@ Image::Image(PixelFormat format, Point2i resolution,
         p16.resize(NChannels() * size_t(resolution[0]) * size_t(resolution[1]));
     else if (Is32Bit(format))
         p32.resize(NChannels() * size_t(resolution[0]) * size_t(resolution[1]));
-    else
+    else if (IsBlockCompressed(format)) {
+        // Allocate storage for the 4x4 blocks that cover the image
+        CHECK(SupportsChannels(format, NChannels()));
+        size_t nBlocksX = (resolution[0] + 3) / 4, nBlocksY = (resolution[1] + 3) / 4;
+        p8.resize(nBlocksX * nBlocksY * BlockBytes(format));
+        CHECK(encoding);
+    } else
         LOG_FATAL("Unhandled format in Image::Image()");
 }
 
@@ -444,6 +566,16 @@ ImageChannelValues Image::GetChannels(Point2i p, const ImageChannelDesc &desc,
             cv[i] = p32[pixelOffset + desc.offset[i]];
         break;
     }
+    case PixelFormat::BC1:
+    case PixelFormat::BC4:
+    case PixelFormat::BC5:
+    case PixelFormat::BC7: {
+        uint8_t rgba[4];
+        DecodeBlockTexel(format, &p8[BlockOffset(p)], 4 * (p.y % 4) + p.x % 4, rgba);
+        for (int i = 0; i < desc.offset.size(); ++i)
+            encoding.ToLinear({&rgba[desc.offset[i]], 1}, {&cv[i], 1});
+        break;
+    }
     default:
         LOG_FATAL("Unhandled PixelFormat");
     }
@@ -492,6 +624,51 @@ Image Image::ConvertToFormat(PixelFormat newFormat, ColorEncoding encoding) cons
     if (newFormat == format)
         return *this;
 
+    if (IsBlockCompressed(newFormat)) {
+        // Quantize the image to 8 bits and compress each 4x4 block of pixels;
+        // 8-bit images keep their encoding.
+        CHECK(SupportsChannels(newFormat, NChannels()));
+        if (Is8Bit(format) || IsBlockCompressed(format))
+            encoding = this->encoding;
+        Image image8 = ConvertToFormat(PixelFormat::U256, encoding);
+        Image newImage(newFormat, resolution, channelNames, encoding);
+        int nc = NChannels();
+        int nBlocksX = (resolution.x + 3) / 4, nBlocksY = (resolution.y + 3) / 4;
+        ParallelFor(0, nBlocksY, [&](int64_t by) {
+            for (int bx = 0; bx < nBlocksX; ++bx) {
+                // Gather the block's pixels, replicating the image's edge pixels
+                // in blocks that extend past them
+                uint8_t texels[16][4];
+                for (int i = 0; i < 16; ++i) {
+                    Point2i p(std::min(4 * bx + i % 4, resolution.x - 1),
+                              std::min(4 * int(by) + i / 4, resolution.y - 1));
+                    const uint8_t *pixel = (const uint8_t *)image8.RawPointer(p);
+                    for (int c = 0; c < 4; ++c)
+                        texels[i][c] = c < nc ? pixel[c] : (c == 3 ? 255 : 0);
+                }
+
+                uint8_t *block = (uint8_t *)newImage.RawPointer({4 * bx, 4 * int(by)});
+                switch (newFormat) {
+                case PixelFormat::BC1:
+                    EncodeBC1Block(texels, block);
+                    break;
+                case PixelFormat::BC4:
+                    EncodeBC4Block(texels, block);
+                    break;
+                case PixelFormat::BC5:
+                    EncodeBC5Block(texels, block);
+                    break;
+                case PixelFormat::BC7:
+                    EncodeBC7Block(texels, nc == 4, block);
+                    break;
+                default:
+                    LOG_FATAL("Unhandled PixelFormat");
+                }
+            }
+        });
+        return newImage;
+    }
+
     Image newImage(newFormat, resolution, channelNames, encoding);
     for (int y = 0; y < resolution.y; ++y)
         for (int x = 0; x < resolution.x; ++x)
@@ -522,6 +699,15 @@ ImageChannelValues Image::GetChannels(Point2i p, WrapMode2D wrapMode) const {
             cv[i] = p32[pixelOffset + i];
         break;
     }
+    case PixelFormat::BC1:
+    case PixelFormat::BC4:
+    case PixelFormat::BC5:
+    case PixelFormat::BC7: {
+        uint8_t rgba[4];
+        DecodeBlockTexel(format, &p8[BlockOffset(p)], 4 * (p.y % 4) + p.x % 4, rgba);
+        encoding.ToLinear({rgba, size_t(NChannels())}, {&cv[0], size_t(NChannels())});
+        break;
+    }
     default:
         LOG_FATAL("Unhandled PixelFormat");
     }
@@ -924,6 +1110,10 @@ bool Image::Write(std::string name, const ImageMetadata &metadata) const {
     if (metadata.pixelBounds)
         CHECK_EQ(metadata.pixelBounds->Area(), size_t(resolution.x) * size_t(resolution.y));
 
+    if (IsBlockCompressed(format))
+        // Decode images in block-compressed formats before writing them
+        return ConvertToFormat(PixelFormat::U256, encoding).Write(name, metadata);
+
     if (HasExtension(name, "exr"))
         return WriteEXR(name, metadata);
 
@@ -1286,20 +1476,21 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
 
         if (state.info_png.color.bitdepth == 16) {
             image = Image(PixelFormat::Half, Point2i(width, height), {"Y"});
-            auto bufIter = buf.begin();
-            for (unsigned int y = 0; y < height; ++y)
+            DCHECK_EQ(buf.size(), 2 * size_t(width) * height);
+            ParallelFor(0, height, [&](int64_t y) {
+                const unsigned char *bufIter = &buf[2 * size_t(width) * y];
                 for (unsigned int x = 0; x < width; ++x, bufIter += 2) {
                     // Convert from little endian.
                     Float v = (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f;
                     v = encoding.ToFloatLinear(v);
                     image.SetChannel(Point2i(x, y), 0, v);
                 }
-            DCHECK(bufIter == buf.end());
+            });
         } else {
             image = Image(PixelFormat::U256, Point2i(width, height), {"Y"}, encoding);
             std::copy(buf.begin(), buf.end(), (uint8_t *)image.RawPointer({0, 0}));
         }
-        return ImageAndMetadata{image, ImageMetadata()};
+        return ImageAndMetadata{std::move(image), ImageMetadata()};
     }
     default: {
         std::vector<unsigned char> buf;
@@ -1318,10 +1509,10 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
             if (hasAlpha) {
                 image = Image(PixelFormat::Half, Point2i(width, height),
                               {"R", "G", "B", "A"});
-                auto bufIter = buf.begin();
-                for (unsigned int y = 0; y < height; ++y)
+                DCHECK_EQ(buf.size(), 8 * size_t(width) * height);
+                ParallelFor(0, height, [&](int64_t y) {
+                    const unsigned char *bufIter = &buf[8 * size_t(width) * y];
                     for (unsigned int x = 0; x < width; ++x, bufIter += 8) {
-                        DCHECK(bufIter < buf.end());
                         // Convert from little endian.
                         Float rgba[4] = {
                             (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f,
@@ -1333,13 +1524,13 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
                             image.SetChannel(Point2i(x, y), c, rgba[c]);
                         }
                     }
-                DCHECK(bufIter == buf.end());
+                });
             } else {
                 image = Image(PixelFormat::Half, Point2i(width, height), {"R", "G", "B"});
-                auto bufIter = buf.begin();
-                for (unsigned int y = 0; y < height; ++y)
+                DCHECK_EQ(buf.size(), 6 * size_t(width) * height);
+                ParallelFor(0, height, [&](int64_t y) {
+                    const unsigned char *bufIter = &buf[6 * size_t(width) * y];
                     for (unsigned int x = 0; x < width; ++x, bufIter += 6) {
-                        DCHECK(bufIter < buf.end());
                         // Convert from little endian.
                         Float rgb[3] = {
                             (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f,
@@ -1350,7 +1541,7 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
                             image.SetChannel(Point2i(x, y), c, rgb[c]);
                         }
                     }
-                DCHECK(bufIter == buf.end());
+                });
             }
         } else if (hasAlpha) {
             image = Image(PixelFormat::U256, Point2i(width, height), {"R", "G", "B", "A"},
@@ -1361,12 +1552,16 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
                           encoding);
             std::copy(buf.begin(), buf.end(), (uint8_t *)image.RawPointer({0, 0}));
         }
-        return ImageAndMetadata{image, metadata};
+        return ImageAndMetadata{std::move(image), metadata};
     }
     }
 }
 
 Image Image::SelectChannels(const ImageChannelDesc &desc, Allocator alloc) const {
+    // Decode block-compressed images rather than compressing them again
+    if (IsBlockCompressed(format))
+        return ConvertToFormat(PixelFormat::U256, encoding).SelectChannels(desc, alloc);
+
     std::vector<std::string> descChannelNames;
     // TODO: descChannelNames = ChannelNames(desc)
     for (size_t i = 0; i < desc.offset.size(); ++i)
@@ -1375,31 +1570,34 @@ Image Image::SelectChannels(const ImageChannelDesc &desc, Allocator alloc) const
     Image image(format, resolution, descChannelNames, encoding, alloc);
     switch (format) {
     case PixelFormat::U256:
-        for (int y = 0; y < resolution.y; ++y)
+        ParallelFor(0, resolution.y, [&](int64_t y) {
             for (int x = 0; x < resolution.x; ++x) {
-                const uint8_t *src = (const uint8_t *)RawPointer({x, y});
-                uint8_t *dst = (uint8_t *)image.RawPointer({x, y});
+                const uint8_t *src = (const uint8_t *)RawPointer({x, int(y)});
+                uint8_t *dst = (uint8_t *)image.RawPointer({x, int(y)});
                 for (size_t i = 0; i < desc.offset.size(); ++i)
                     dst[i] = src[desc.offset[i]];
             }
+        });
         break;
     case PixelFormat::Half:
-        for (int y = 0; y < resolution.y; ++y)
+        ParallelFor(0, resolution.y, [&](int64_t y) {
             for (int x = 0; x < resolution.x; ++x) {
-                const Half *src = (const Half *)RawPointer({x, y});
-                Half *dst = (Half *)image.RawPointer({x, y});
+                const Half *src = (const Half *)RawPointer({x, int(y)});
+                Half *dst = (Half *)image.RawPointer({x, int(y)});
                 for (size_t i = 0; i < desc.offset.size(); ++i)
                     dst[i] = src[desc.offset[i]];
             }
+        });
         break;
     case PixelFormat::Float:
-        for (int y = 0; y < resolution.y; ++y)
+        ParallelFor(0, resolution.y, [&](int64_t y) {
             for (int x = 0; x < resolution.x; ++x) {
-                const float *src = (const float *)RawPointer({x, y});
-                float *dst = (float *)image.RawPointer({x, y});
+                const float *src = (const float *)RawPointer({x, int(y)});
+                float *dst = (float *)image.RawPointer({x, int(y)});
                 for (size_t i = 0; i < desc.offset.size(); ++i)
                     dst[i] = src[desc.offset[i]];
             }
+        });
         break;
     default:
         LOG_FATAL("Unhandled PixelFormat");
@@ -1411,6 +1609,8 @@ Image Image::SelectChannels(const ImageChannelDesc &desc, Allocator alloc) const
 Image Image::Crop(const Bounds2i &bounds, Allocator alloc) const {
     CHECK_GT(bounds.Area(), 0);
     CHECK(bounds.pMin.x >= 0 && bounds.pMin.y >= 0);
+    if (IsBlockCompressed(format))
+        return ConvertToFormat(PixelFormat::U256, encoding).Crop(bounds, alloc);
     Image image(format, Point2i(bounds.pMax - bounds.pMin), channelNames, encoding,
                 alloc);
     for (Point2i p : bounds)
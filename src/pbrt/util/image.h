@@ -7,6 +7,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/util/blockcompression.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/containers.h>
@@ -25,7 +26,11 @@
 namespace pbrt {
 
 // PixelFormat Definition
-enum class PixelFormat { U256, Half, Float };
+// The BC1, BC4, BC5, and BC7 formats store 4x4 blocks of 8-bit texels; see
+// _blockcompression.h_. BC1 images have 3 channels, BC4 images 1, BC5 images
+// 2, and BC7 images 3 or 4. Their pixels can be read but not set; images are
+// compressed with _Image::ConvertToFormat()_.
+enum class PixelFormat { U256, Half, Float, BC1, BC4, BC5, BC7 };
 
 // PixelFormat Inline Functions
 PBRT_CPU_GPU inline bool Is8Bit(PixelFormat format) {
@@ -37,12 +42,46 @@ PBRT_CPU_GPU inline bool Is16Bit(PixelFormat format) {
 PBRT_CPU_GPU inline bool Is32Bit(PixelFormat format) {
     return format == PixelFormat::Float;
 }
+PBRT_CPU_GPU inline bool IsBlockCompressed(PixelFormat format) {
+    return format == PixelFormat::BC1 || format == PixelFormat::BC4 ||
+           format == PixelFormat::BC5 || format == PixelFormat::BC7;
+}
 
 std::string ToString(PixelFormat format);
+pstd::optional<PixelFormat> ParsePixelFormat(const std::string &name);
+// Returns false if images in the given format can't have _nChannels_ channels.
+bool SupportsChannels(PixelFormat format, int nChannels);
 
 PBRT_CPU_GPU
 int TexelBytes(PixelFormat format);
 
+PBRT_CPU_GPU inline int BlockBytes(PixelFormat format) {
+    DCHECK(IsBlockCompressed(format));
+    return (format == PixelFormat::BC1 || format == PixelFormat::BC4) ? 8 : 16;
+}
+
+// Decodes the RGBA values of the given texel, numbered in scanline order, in a
+// block of a block-compressed format.
+PBRT_CPU_GPU inline void DecodeBlockTexel(PixelFormat format, const uint8_t *block,
+                                          int texel, uint8_t rgba[4]) {
+    switch (format) {
+    case PixelFormat::BC1:
+        DecodeBC1Texel(block, texel, rgba);
+        break;
+    case PixelFormat::BC4:
+        DecodeBC4Texel(block, texel, rgba);
+        break;
+    case PixelFormat::BC5:
+        DecodeBC5Texel(block, texel, rgba);
+        break;
+    case PixelFormat::BC7:
+        DecodeBC7Mode6Texel(block, texel, rgba);
+        break;
+    default:
+        LOG_FATAL("Unhandled PixelFormat in DecodeBlockTexel()");
+    }
+}
+
 // ResampleWeight Definition
 struct ResampleWeight {
     int firstPixel;
@@ -250,6 +289,14 @@ class Image {
         DCHECK(InsideExclusive(p, Bounds2i({0, 0}, resolution)));
         return NChannels() * (p.y * resolution.x + p.x);
     }
+    // Returns the offset of the block that holds the given pixel in images
+    // in block-compressed formats.
+    PBRT_CPU_GPU
+    size_t BlockOffset(Point2i p) const {
+        DCHECK(InsideExclusive(p, Bounds2i({0, 0}, resolution)));
+        int nBlocksX = (resolution.x + 3) / 4;
+        return BlockBytes(format) * (size_t(p.y / 4) * nBlocksX + p.x / 4);
+    }
 
     PBRT_CPU_GPU
     Float GetChannel(Point2i p, int c, WrapMode2D wrapMode = WrapMode::Clamp) const {
@@ -269,6 +316,16 @@ class Image {
         case PixelFormat::Float: {  // Return _Float_-encoded pixel channel value
             return p32[PixelOffset(p) + c];
         }
+        case PixelFormat::BC1:
+        case PixelFormat::BC4:
+        case PixelFormat::BC5:
+        case PixelFormat::BC7: {  // Decode pixel from its block and return channel value
+            uint8_t rgba[4];
+            DecodeBlockTexel(format, &p8[BlockOffset(p)], 4 * (p.y % 4) + p.x % 4, rgba);
+            Float r;
+            encoding.ToLinear({&rgba[c], 1}, {&r, 1});
+            return r;
+        }
         default:
             LOG_FATAL("Unhandled PixelFormat");
             return 0;
@@ -344,6 +401,10 @@ class Image {
 
     bool Write(std::string name, const ImageMetadata &metadata = {}) const;
 
+    // Returns a copy of the image in the given format. When converting to an
+    // 8-bit or block-compressed format, _encoding_ is used to encode
+    // floating-point pixels; 8-bit and block-compressed images keep their
+    // own encoding and _encoding_ is ignored for them.
     Image ConvertToFormat(PixelFormat format, ColorEncoding encoding = nullptr) const;
 
     // TODO? provide an iterator to iterate over all pixels and channels?
@@ -379,8 +440,12 @@ class Image {
     PBRT_CPU_GPU
     size_t BytesUsed() const { return p8.size() + 2 * p16.size() + 4 * p32.size(); }
 
+    // Returns a pointer to the pixel's values or, for images in block-compressed
+    // formats, to the block that holds the pixel.
     PBRT_CPU_GPU
     const void *RawPointer(Point2i p) const {
+        if (IsBlockCompressed(format))
+            return p8.data() + BlockOffset(p);
         if (Is8Bit(format))
             return p8.data() + PixelOffset(p);
         if (Is16Bit(format))
@@ -404,6 +469,10 @@ class Image {
   private:
     // Image Private Methods
     static std::vector<ResampleWeight> ResampleWeights(int oldRes, int newRes);
+    void ResizeUpRect(const Bounds2i &outExtent,
+                      const std::vector<ResampleWeight> &xWeights,
+                      const std::vector<ResampleWeight> &yWeights, WrapMode2D wrapMode,
+                      pstd::span<float> outBuf) const;
     bool WriteEXR(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePFM(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePNG(const std::string &name, const ImageMetadata &metadata) const;
@@ -732,6 +732,56 @@ TEST(Image, Select) {
         }
 }
 
+TEST(Image, BlockCompressed) {
+    // Use a resolution that isn't a multiple of the block size
+    Point2i res(23, 10);
+    Image image(PixelFormat::Float, res, {"R", "G", "B", "A"});
+    // The channels are linear functions of a single value so that the colors
+    // in each block lie along a line, which the compressed formats represent
+    // well.
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Float t = Float(x + 2 * y) / (res.x + 2 * res.y);
+            image.SetChannels({x, y}, {t, .25f + .5f * t, Float(0.5), 1 - t});
+        }
+
+    for (PixelFormat format :
+         {PixelFormat::BC1, PixelFormat::BC4, PixelFormat::BC5, PixelFormat::BC7}) {
+        std::vector<std::string> channels = {"R", "G", "B", "A"};
+        channels.resize(format == PixelFormat::BC4   ? 1
+                        : format == PixelFormat::BC5 ? 2
+                        : format == PixelFormat::BC1 ? 3
+                                                     : 4);
+        EXPECT_TRUE(SupportsChannels(format, channels.size()));
+        Image src = image.SelectChannels(image.GetChannelDesc(channels));
+        Image compressed = src.ConvertToFormat(format, ColorEncoding::Linear);
+        EXPECT_EQ(format, compressed.Format());
+        EXPECT_EQ(6 * 3 * BlockBytes(format), compressed.BytesUsed());
+
+        // Decoded pixels should be close to the original ones and match the
+        // pixels of the image when it is converted to another format.
+        Image decoded = compressed.ConvertToFormat(PixelFormat::Float);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
+                ImageChannelValues values = compressed.GetChannels({x, y});
+                for (int c = 0; c < src.NChannels(); ++c) {
+                    Float v = compressed.GetChannel({x, y}, c);
+                    EXPECT_NEAR(src.GetChannel({x, y}, c), v, .04f)
+                        << ToString(format) << " (" << x << ", " << y << ") c = " << c;
+                    EXPECT_EQ(v, decoded.GetChannel({x, y}, c));
+                    EXPECT_EQ(v, values[c]);
+                }
+            }
+
+        // Cropping a compressed image gives the decoded pixels.
+        Image cropped = compressed.Crop(Bounds2i({5, 3}, {17, 9}));
+        EXPECT_EQ(PixelFormat::U256, cropped.Format());
+        EXPECT_EQ(Point2i(12, 6), cropped.Resolution());
+        for (int c = 0; c < src.NChannels(); ++c)
+            EXPECT_EQ(compressed.GetChannel({6, 4}, c), cropped.GetChannel({1, 1}, c));
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 static std::string inTestDir(const std::string &path) {
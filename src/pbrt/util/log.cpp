@@ -255,6 +255,7 @@ void InitLogging(LogLevel level, std::string logFile, bool logUtilization, bool
                             double(currentUsage.nice - prevUsage.nice) / delta,
                             double(currentUsage.system - prevUsage.system) / delta,
                             double(currentUsage.idle - prevUsage.idle) / delta);
+                LOG_VERBOSE("Memory: %s", MemoryReportSummary());
                 LOG_VERBOSE(
                     "IO: read request %d read actual %d write request %d write actual %d",
                     currentUsage.readRequest - prevUsage.readRequest,
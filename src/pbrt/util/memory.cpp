@@ -5,9 +5,12 @@
 #include <pbrt/util/memory.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
 
 #include <cstdlib>
+#include <map>
 #ifdef PBRT_HAVE_MALLOC_H
 #include <malloc.h>  // for both memalign and _aligned_malloc
 #endif
@@ -22,12 +25,23 @@
 #include <unistd.h>
 #include <cstdio>
 #endif  // PBRT_IS_LINUX
+#ifndef PBRT_IS_WINDOWS
+#include <sys/resource.h>
+#endif  // !PBRT_IS_WINDOWS
+#ifdef PBRT_HAVE_MMAP
+#include <sys/mman.h>
+#endif  // PBRT_HAVE_MMAP
 #ifdef PBRT_IS_OSX
 #include <mach/mach.h>
 #endif  // PBRT_IS_OSX
 
 namespace pbrt {
 
+STAT_MEMORY_COUNTER("Memory/Huge pages (explicit)", hugetlbBytes);
+STAT_MEMORY_COUNTER("Memory/Huge pages (transparent, requested)",
+                    transparentHugePageBytes);
+STAT_MEMORY_COUNTER("Memory/Huge page fallbacks to regular pages", hugePageFallbackBytes);
+
 /*
  * Author:  David Robert Nadeau
  * Site:    http://NadeauSoftware.com/
@@ -75,4 +89,343 @@ size_t GetCurrentRSS() {
 #endif
 }
 
+size_t GetPeakRSS() {
+#ifdef PBRT_IS_WINDOWS
+    PROCESS_MEMORY_COUNTERS info;
+    GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
+    return (size_t)info.PeakWorkingSetSize;
+#else
+    struct rusage rusage;
+    if (getrusage(RUSAGE_SELF, &rusage) != 0)
+        return 0;
+#ifdef PBRT_IS_OSX
+    return (size_t)rusage.ru_maxrss;
+#else
+    // Linux reports the peak RSS in kilobytes.
+    return (size_t)rusage.ru_maxrss * 1024;
+#endif  // PBRT_IS_OSX
+#endif  // PBRT_IS_WINDOWS
+}
+
+// Returns the number of bytes that are currently backed by transparent huge
+// pages, or zero if this can't be determined.
+static size_t GetTransparentHugePageBytes() {
+#ifdef PBRT_IS_LINUX
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+    if (!fp)
+        return 0;
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    fclose(fp);
+    // Linux reports the size in kilobytes.
+    return (size_t)kb * 1024;
+#else
+    return 0;
+#endif  // PBRT_IS_LINUX
+}
+
+// MemoryTag Method Definitions
+static std::mutex memoryTagMutex;
+
+MemoryTag *MemoryTag::Root() {
+    // Leak the tags so that they can be used during static destruction.
+    static MemoryTag *root = new MemoryTag("Total tracked", nullptr);
+    return root;
+}
+
+MemoryTag *MemoryTag::Get(const std::string &path) {
+    std::lock_guard<std::mutex> lock(memoryTagMutex);
+    MemoryTag *tag = Root();
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = std::min(path.find('/', start), path.size());
+        std::string name = path.substr(start, end - start);
+        start = end + 1;
+        if (name.empty())
+            continue;
+
+        auto iter = std::find_if(
+            tag->children.begin(), tag->children.end(),
+            [&](const std::unique_ptr<MemoryTag> &child) { return child->name == name; });
+        if (iter != tag->children.end())
+            tag = iter->get();
+        else {
+            tag->children.push_back(std::unique_ptr<MemoryTag>(new MemoryTag(name, tag)));
+            tag = tag->children.back().get();
+        }
+    }
+    return tag;
+}
+
+std::vector<MemoryTag *> MemoryTag::Children() const {
+    std::lock_guard<std::mutex> lock(memoryTagMutex);
+    std::vector<MemoryTag *> result;
+    for (const std::unique_ptr<MemoryTag> &child : children)
+        result.push_back(child.get());
+    return result;
+}
+
+std::string MemoryTag::ToString() const {
+    return StringPrintf("[ MemoryTag name: %s currentBytes: %d peakBytes: %d ]", name,
+                        CurrentBytes(), PeakBytes());
+}
+
+Allocator TrackedAllocator(MemoryTag *tag, Allocator alloc) {
+    static std::mutex mutex;
+    static std::map<std::pair<MemoryTag *, pstd::pmr::memory_resource *>,
+                    TrackedMemoryResource *>
+        resources;
+    std::lock_guard<std::mutex> lock(mutex);
+    TrackedMemoryResource *&resource = resources[std::make_pair(tag, alloc.resource())];
+    // Resources are leaked since memory may be freed through them at any time
+    // up until exit.
+    if (!resource)
+        resource = new TrackedMemoryResource(alloc.resource(), tag);
+    return Allocator(resource);
+}
+
+// Memory Report Function Definitions
+static std::string MemoryString(int64_t bytes) {
+    double mib = double(bytes) / (1024. * 1024.);
+    if (std::abs(mib) >= 1024.)
+        return StringPrintf("%.2f GiB", mib / 1024.);
+    return StringPrintf("%.2f MiB", mib);
+}
+
+static void PrintMemoryTag(FILE *dest, const MemoryTag *tag, int depth) {
+    std::string title = std::string(2 * depth, ' ') + tag->Name();
+    fprintf(dest, "    %-42s%14s%14s\n", title.c_str(),
+            MemoryString(tag->CurrentBytes()).c_str(),
+            MemoryString(tag->PeakBytes()).c_str());
+    for (const MemoryTag *child : tag->Children())
+        PrintMemoryTag(dest, child, depth + 1);
+}
+
+void PrintMemoryReport(FILE *dest) {
+    fprintf(dest, "Memory\n");
+    fprintf(dest, "    %-42s%14s%14s\n", "", "Current", "Peak");
+    const MemoryTag *root = MemoryTag::Root();
+    PrintMemoryTag(dest, root, 0);
+
+    // Compare the tracked memory to the process's RSS
+    int64_t rss = GetCurrentRSS(), peakRSS = GetPeakRSS();
+    fprintf(dest, "    %-42s%14s%14s\n", "Process RSS", MemoryString(rss).c_str(),
+            MemoryString(peakRSS).c_str());
+    if (size_t thpBytes = GetTransparentHugePageBytes(); thpBytes > 0)
+        fprintf(dest, "    %-42s%14s\n", "  Transparent huge pages",
+                MemoryString(thpBytes).c_str());
+    if (rss > 0) {
+        int64_t untracked = rss - root->CurrentBytes();
+        fprintf(dest, "    %-42s%14s  (%.1f%% of RSS)\n", "Untracked",
+                MemoryString(untracked).c_str(), 100. * untracked / rss);
+    }
+}
+
+std::string MemoryReportSummary() {
+    const MemoryTag *root = MemoryTag::Root();
+    std::string summary =
+        StringPrintf("tracked %d MB (", root->CurrentBytes() / (1024 * 1024));
+    std::vector<MemoryTag *> tags = root->Children();
+    for (size_t i = 0; i < tags.size(); ++i)
+        summary += StringPrintf("%s%s %d MB", i > 0 ? ", " : "", tags[i]->Name(),
+                                tags[i]->CurrentBytes() / (1024 * 1024));
+    return summary + ")";
+}
+
+// ArenaMemoryResource Method Definitions
+void *ArenaMemoryResource::do_allocate(size_t size, size_t alignment) {
+    if (bytesCounter)
+        *bytesCounter += size;
+
+    if (IsLarge(size, alignment)) {
+        // Give large allocations their own block so that they don't waste
+        // the rest of the current chunk and can be returned upstream.
+        Block *b = allocateBlock(size, alignment);
+        std::lock_guard<std::mutex> lock(largeMutex);
+        b->next = largeBlocks;
+        if (largeBlocks)
+            largeBlocks->prev = b;
+        largeBlocks = b;
+        largeBytes += size;
+        return (char *)b + HeaderSize(alignment);
+    }
+
+    // Bump-allocate from the current chunk, starting a new one if needed
+    uintptr_t ptr = ((uintptr_t)current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (!current || ptr + size > (uintptr_t)end) {
+        Block *b = allocateBlock(chunkSize, alignof(std::max_align_t));
+        b->next = chunks;
+        chunks = b;
+        current = (char *)b + HeaderSize(alignof(std::max_align_t));
+        end = current + chunkSize;
+        chunkBytesReserved += chunkSize;
+        ptr = ((uintptr_t)current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    DCHECK_LE(ptr + size, (uintptr_t)end);
+    current = (char *)ptr + size;
+    chunkBytesAllocated += size;
+    return (void *)ptr;
+}
+
+void ArenaMemoryResource::do_deallocate(void *p, size_t size, size_t alignment) {
+    // Memory from chunks is only reclaimed by Release()
+    if (!p || !IsLarge(size, alignment))
+        return;
+
+    Block *b = (Block *)((char *)p - HeaderSize(alignment));
+    DCHECK_EQ(b->size, size);
+    std::lock_guard<std::mutex> lock(largeMutex);
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        largeBlocks = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    largeBytes -= size;
+    freeBlock(b);
+}
+
+ArenaMemoryResource::Block *ArenaMemoryResource::allocateBlock(size_t size,
+                                                               size_t alignment) {
+    Block *b = (Block *)upstream->allocate(HeaderSize(alignment) + size,
+                                           BlockAlignment(alignment));
+    *b = Block{nullptr, nullptr, size, alignment};
+    return b;
+}
+
+void ArenaMemoryResource::freeBlock(Block *b) {
+    upstream->deallocate(b, HeaderSize(b->alignment) + b->size,
+                         BlockAlignment(b->alignment));
+}
+
+void ArenaMemoryResource::Release() {
+    while (chunks) {
+        Block *next = chunks->next;
+        freeBlock(chunks);
+        chunks = next;
+    }
+    current = end = nullptr;
+    chunkBytesAllocated = chunkBytesReserved = 0;
+
+    std::lock_guard<std::mutex> lock(largeMutex);
+    while (largeBlocks) {
+        Block *next = largeBlocks->next;
+        freeBlock(largeBlocks);
+        largeBlocks = next;
+    }
+    largeBytes = 0;
+}
+
+size_t ArenaMemoryResource::BytesAllocated() {
+    std::lock_guard<std::mutex> lock(largeMutex);
+    return chunkBytesAllocated + largeBytes;
+}
+
+size_t ArenaMemoryResource::BytesReserved() {
+    std::lock_guard<std::mutex> lock(largeMutex);
+    return chunkBytesReserved + largeBytes;
+}
+
+std::string ArenaMemoryResource::ToString() const {
+    return StringPrintf("[ ArenaMemoryResource chunkSize: %d chunkBytesAllocated: %d "
+                        "chunkBytesReserved: %d largeBytes: %d ]",
+                        chunkSize, chunkBytesAllocated, chunkBytesReserved,
+                        largeBytes);
+}
+
+// HugePageMemoryResource Definition
+// Allocations of at least _HugePageSize_ are mapped directly, preferably
+// using explicitly reserved huge pages. If none are available, a 2MB-aligned
+// mapping is requested to be backed by transparent huge pages instead.
+class HugePageMemoryResource : public pstd::pmr::memory_resource {
+  public:
+    void *do_allocate(size_t size, size_t alignment) {
+#ifdef PBRT_HAVE_MMAP
+        if (size >= HugePageSize && alignment <= HugePageSize) {
+            size_t mapSize = RoundUp(size);
+#ifdef MAP_HUGETLB
+            void *hugePtr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (hugePtr != MAP_FAILED) {
+                hugetlbBytes += mapSize;
+                return hugePtr;
+            }
+            if (!warnedNoHugetlb.exchange(true))
+                LOG_VERBOSE("Unable to map %d bytes using huge pages (%s); falling "
+                            "back to transparent huge pages",
+                            mapSize, ErrorString());
+#endif  // MAP_HUGETLB
+            // Over-allocate so that the mapping can be trimmed to start at a
+            // huge page boundary, which transparent huge pages require.
+            size_t extSize = mapSize + HugePageSize;
+            char *ext = (char *)mmap(nullptr, extSize, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ext == (char *)MAP_FAILED)
+                LOG_FATAL("mmap of %d bytes failed: %s", extSize, ErrorString());
+            char *ptr = (char *)RoundUp((uintptr_t)ext);
+            if (ptr > ext)
+                munmap(ext, ptr - ext);
+            if (ptr + mapSize < ext + extSize)
+                munmap(ptr + mapSize, ext + extSize - (ptr + mapSize));
+#ifdef MADV_HUGEPAGE
+            if (madvise(ptr, mapSize, MADV_HUGEPAGE) == 0) {
+                transparentHugePageBytes += mapSize;
+                return ptr;
+            }
+#endif  // MADV_HUGEPAGE
+            hugePageFallbackBytes += mapSize;
+            return ptr;
+        }
+#endif  // PBRT_HAVE_MMAP
+        return pstd::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *ptr, size_t size, size_t alignment) {
+#ifdef PBRT_HAVE_MMAP
+        if (size >= HugePageSize && alignment <= HugePageSize) {
+            if (munmap(ptr, RoundUp(size)) != 0)
+                LOG_ERROR("munmap failed: %s", ErrorString());
+            return;
+        }
+#endif  // PBRT_HAVE_MMAP
+        pstd::pmr::new_delete_resource()->deallocate(ptr, size, alignment);
+    }
+
+    bool do_is_equal(const memory_resource &other) const noexcept {
+        return this == &other;
+    }
+
+  private:
+    static size_t RoundUp(size_t size) {
+        return (size + HugePageSize - 1) & ~(HugePageSize - 1);
+    }
+
+    std::atomic<bool> warnedNoHugetlb{false};
+};
+
+// Huge Page Allocation Function Definitions
+static bool hugePagesEnabled = false;
+
+void EnableHugePages(bool enable) {
+#ifndef PBRT_HAVE_MMAP
+    if (enable)
+        Warning("Huge pages are not supported on this system.");
+#endif  // !PBRT_HAVE_MMAP
+    hugePagesEnabled = enable;
+}
+
+bool HugePagesEnabled() {
+    return hugePagesEnabled;
+}
+
+Allocator HugePageAllocator(Allocator alloc, size_t bytes) {
+    if (!hugePagesEnabled || bytes < HugePageSize)
+        return alloc;
+    static HugePageMemoryResource resource;
+    return Allocator(&resource);
+}
+
 }  // namespace pbrt
@@ -11,26 +11,82 @@
 #include <pbrt/util/math.h>
 #include <pbrt/util/pstd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <cstdio>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace pbrt {
 
 size_t GetCurrentRSS();
+size_t GetPeakRSS();
+
+// MemoryTag Definition
+// Memory use is accounted for with a hierarchy of tags that are named by
+// slash-separated paths like "Scene/Textures"; bytes that are recorded with
+// a tag are included in the current and peak totals of all of its ancestors.
+class MemoryTag {
+  public:
+    // MemoryTag Public Methods
+    static MemoryTag *Get(const std::string &path);
+    static MemoryTag *Root();
+
+    void Add(int64_t bytes) {
+        for (MemoryTag *tag = this; tag; tag = tag->parent) {
+            int64_t current =
+                tag->currentBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            int64_t peak = tag->peakBytes.load(std::memory_order_relaxed);
+            while (peak < current && !tag->peakBytes.compare_exchange_weak(
+                                         peak, current, std::memory_order_relaxed))
+                ;
+        }
+    }
+
+    const std::string &Name() const { return name; }
+    int64_t CurrentBytes() const { return currentBytes.load(); }
+    int64_t PeakBytes() const { return peakBytes.load(); }
+    std::vector<MemoryTag *> Children() const;
+
+    std::string ToString() const;
+
+  private:
+    // MemoryTag Private Methods
+    MemoryTag(std::string name, MemoryTag *parent)
+        : name(std::move(name)), parent(parent) {}
+
+    // MemoryTag Private Members
+    std::string name;
+    MemoryTag *parent;
+    // _children_ is protected by a mutex shared by all tags.
+    std::vector<std::unique_ptr<MemoryTag>> children;
+    std::atomic<int64_t> currentBytes{0}, peakBytes{0};
+};
+
+// Memory Report Function Declarations
+// Prints the current and peak bytes of each tag along with the process's
+// RSS and the part of it that isn't accounted for by the tags.
+void PrintMemoryReport(FILE *dest);
+// Returns a one-line summary of the current use of the top-level tags.
+std::string MemoryReportSummary();
 
 class TrackedMemoryResource : public pstd::pmr::memory_resource {
   public:
     TrackedMemoryResource(
-        pstd::pmr::memory_resource *source = pstd::pmr::get_default_resource())
-        : source(source) {}
+        pstd::pmr::memory_resource *source = pstd::pmr::get_default_resource(),
+        MemoryTag *tag = nullptr)
+        : source(source), tag(tag) {}
 
     void *do_allocate(size_t size, size_t alignment) {
         void *ptr = source->allocate(size, alignment);
+        if (tag)
+            tag->Add(size);
         uint64_t currentBytes = allocatedBytes.fetch_add(size) + size;
         uint64_t prevMax = maxAllocatedBytes.load(std::memory_order_relaxed);
         while (prevMax < currentBytes &&
@@ -40,6 +96,8 @@ class TrackedMemoryResource : public pstd::pmr::memory_resource {
     }
     void do_deallocate(void *p, size_t bytes, size_t alignment) {
         source->deallocate(p, bytes, alignment);
+        if (tag)
+            tag->Add(-int64_t(bytes));
         allocatedBytes -= bytes;
     }
 
@@ -52,9 +110,91 @@ class TrackedMemoryResource : public pstd::pmr::memory_resource {
 
   private:
     pstd::pmr::memory_resource *source;
+    MemoryTag *tag;
     std::atomic<uint64_t> allocatedBytes{0}, maxAllocatedBytes{0};
 };
 
+// Returns an allocator that allocates from _alloc_ and records its memory
+// use with _tag_. Allocators for the same tag and upstream allocator share a
+// single _TrackedMemoryResource_.
+Allocator TrackedAllocator(MemoryTag *tag, Allocator alloc = {});
+
+// ArenaMemoryResource Definition
+class ArenaMemoryResource : public pstd::pmr::memory_resource {
+  public:
+    // ArenaMemoryResource Public Methods
+    ArenaMemoryResource(
+        pstd::pmr::memory_resource *upstream = pstd::pmr::get_default_resource(),
+        size_t chunkSize = 1024 * 1024, int64_t *bytesCounter = nullptr)
+        : upstream(upstream), chunkSize(chunkSize), bytesCounter(bytesCounter) {}
+
+    ArenaMemoryResource(const ArenaMemoryResource &) = delete;
+    ArenaMemoryResource &operator=(const ArenaMemoryResource &) = delete;
+
+    ~ArenaMemoryResource() { Release(); }
+
+    void Release();
+
+    size_t BytesAllocated();
+    size_t BytesReserved();
+
+    std::string ToString() const;
+
+  protected:
+    void *do_allocate(size_t size, size_t alignment);
+    void do_deallocate(void *p, size_t size, size_t alignment);
+
+    bool do_is_equal(const memory_resource &other) const noexcept {
+        return this == &other;
+    }
+
+  private:
+    // ArenaMemoryResource Private Members
+    struct Block {
+        Block *prev, *next;
+        size_t size, alignment;
+    };
+    static size_t BlockAlignment(size_t alignment) {
+        return std::max(alignment, alignof(Block));
+    }
+    static size_t HeaderSize(size_t alignment) {
+        alignment = BlockAlignment(alignment);
+        return (sizeof(Block) + alignment - 1) & ~(alignment - 1);
+    }
+    bool IsLarge(size_t size, size_t alignment) const {
+        return size + alignment > chunkSize / 4;
+    }
+    Block *allocateBlock(size_t size, size_t alignment);
+    void freeBlock(Block *b);
+
+    pstd::pmr::memory_resource *upstream;
+    size_t chunkSize;
+    int64_t *bytesCounter;
+    Block *chunks = nullptr;
+    char *current = nullptr, *end = nullptr;
+    size_t chunkBytesAllocated = 0, chunkBytesReserved = 0;
+    // Large allocations may be freed from other threads, so their list is
+    // protected by a mutex.
+    std::mutex largeMutex;
+    Block *largeBlocks = nullptr;
+    size_t largeBytes = 0;
+};
+
+// Huge Page Allocation Declarations
+static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+// Huge pages are only used for allocations made through _HugePageAllocator()_
+// after they have been enabled; memory must be freed through the allocator it
+// was allocated with even if the setting has changed since.
+void EnableHugePages(bool enable = true);
+bool HugePagesEnabled();
+
+// Returns an allocator that backs an allocation of _bytes_ bytes with huge
+// pages if they have been enabled and the allocation is large enough to
+// benefit from them; otherwise _alloc_ is returned. The same value of
+// _bytes_ must be passed when getting the allocator to free the memory.
+Allocator HugePageAllocator(Allocator alloc, size_t bytes);
+
 template <typename T>
 struct AllocationTraits {
     using SingleObject = T *;
@@ -82,10 +222,13 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
         ptr = b.ptr;
         allocSize = b.allocSize;
         offset = b.offset;
+        retiredBytes = b.retiredBytes;
+        highWaterMark = b.highWaterMark;
+        nReallocs = b.nReallocs;
         smallBuffers = std::move(b.smallBuffers);
 
         b.ptr = nullptr;
-        b.allocSize = b.offset = 0;
+        b.allocSize = b.offset = b.retiredBytes = b.highWaterMark = b.nReallocs = 0;
     }
 
     ~ScratchBuffer() {
@@ -99,6 +242,9 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
         std::swap(b.ptr, ptr);
         std::swap(b.allocSize, allocSize);
         std::swap(b.offset, offset);
+        std::swap(b.retiredBytes, retiredBytes);
+        std::swap(b.highWaterMark, highWaterMark);
+        std::swap(b.nReallocs, nReallocs);
         std::swap(b.smallBuffers, smallBuffers);
         return *this;
     }
@@ -130,16 +276,43 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
     }
 
     void Reset() {
+        highWaterMark = std::max(highWaterMark, retiredBytes + offset);
+        offset = retiredBytes = 0;
+        if (smallBuffers.empty())
+            return;
         for (const auto &buf : smallBuffers)
             Allocator().deallocate_bytes(buf.first, buf.second, align);
         smallBuffers.clear();
-        offset = 0;
+        // Make sure that the largest use so far fits in a single buffer so
+        // that the same use doesn't need to allocate again.
+        Reserve(highWaterMark);
     }
 
+    // Grows the buffer so that _size_ bytes can be allocated without
+    // reallocation. It must be called just after _Reset()_.
+    void Reserve(int size) {
+        DCHECK(offset == 0 && smallBuffers.empty());
+        if (size <= allocSize)
+            return;
+        Allocator().deallocate_bytes(ptr, allocSize, align);
+        // Leave at least 1/8 slack for differences in alignment padding,
+        // even if _size_ is already a power of two.
+        allocSize = RoundUpPow2(size + size / 8);
+        ptr = (char *)Allocator().allocate_bytes(allocSize, align);
+        ++nReallocs;
+    }
+
+    // Returns the most memory that has been used between calls to _Reset()_.
+    int HighWaterMark() const { return highWaterMark; }
+    // Returns the number of times that the buffer has had to grow.
+    int Reallocations() const { return nReallocs; }
+
   private:
     // ScratchBuffer Private Methods
     void Realloc(size_t minSize) {
         smallBuffers.push_back(std::make_pair(ptr, allocSize));
+        retiredBytes += offset;
+        ++nReallocs;
         allocSize = std::max(2 * minSize, allocSize + minSize);
         ptr = (char *)Allocator().allocate_bytes(allocSize, align);
         offset = 0;
@@ -149,6 +322,9 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
     static constexpr int align = PBRT_L1_CACHE_LINE_SIZE;
     char *ptr = nullptr;
     int allocSize = 0, offset = 0;
+    // Bytes used in _smallBuffers_ since the last _Reset()_
+    int retiredBytes = 0;
+    int highWaterMark = 0, nReallocs = 0;
     std::list<std::pair<char *, size_t>> smallBuffers;
 };
 
@@ -0,0 +1,190 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/rng.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+TEST(ArenaMemoryResource, NoOverlap) {
+    TrackedMemoryResource upstream;
+    ArenaMemoryResource arena(&upstream, 4096);
+    Allocator alloc(&arena);
+    RNG rng;
+    struct Span {
+        char *ptr;
+        size_t size;
+    };
+    std::vector<Span> spans;
+
+    for (int i = 0; i < 5000; ++i) {
+        // Include some allocations that are large enough to get their own
+        // blocks.
+        size_t size = rng.Uniform<Float>() < .1f ? rng.Uniform<int>(8192)
+                                                 : rng.Uniform<int>(256);
+        size_t align = size_t(1) << rng.Uniform<int>(7);
+
+        char *p = (char *)alloc.allocate_bytes(size, align);
+        EXPECT_EQ(0, (uintptr_t)p % align);
+        // O(n^2)...
+        for (const Span &s : spans)
+            EXPECT_TRUE(p >= s.ptr + s.size || p + size <= s.ptr);
+        spans.push_back(Span{p, size});
+    }
+
+    EXPECT_GT(arena.BytesAllocated(), 0);
+    EXPECT_GE(arena.BytesReserved(), arena.BytesAllocated());
+    EXPECT_GE(upstream.CurrentAllocatedBytes(), arena.BytesReserved());
+
+    arena.Release();
+    EXPECT_EQ(0, arena.BytesAllocated());
+    EXPECT_EQ(0, arena.BytesReserved());
+    EXPECT_EQ(0, upstream.CurrentAllocatedBytes());
+}
+
+TEST(ArenaMemoryResource, LargeDeallocate) {
+    TrackedMemoryResource upstream;
+    int64_t bytes = 0;
+    ArenaMemoryResource arena(&upstream, 4096, &bytes);
+    Allocator alloc(&arena);
+
+    // Small allocations are only returned upstream by Release()...
+    void *small = alloc.allocate_bytes(64);
+    alloc.deallocate_bytes(small, 64);
+    EXPECT_EQ(64, arena.BytesAllocated());
+
+    // ...but large ones are returned when they are freed.
+    size_t smallUpstream = upstream.CurrentAllocatedBytes();
+    void *large[3];
+    for (int i = 0; i < 3; ++i)
+        large[i] = alloc.allocate_bytes(10000, 64);
+    EXPECT_EQ(64 + 3 * 10000, arena.BytesAllocated());
+    EXPECT_EQ(64 + 3 * 10000, bytes);
+    alloc.deallocate_bytes(large[1], 10000, 64);
+    alloc.deallocate_bytes(large[0], 10000, 64);
+    EXPECT_EQ(64 + 10000, arena.BytesAllocated());
+    alloc.deallocate_bytes(large[2], 10000, 64);
+    EXPECT_EQ(smallUpstream, upstream.CurrentAllocatedBytes());
+    EXPECT_EQ(64, arena.BytesAllocated());
+}
+
+TEST(HugePageAllocator, Basics) {
+    bool wasEnabled = HugePagesEnabled();
+    EnableHugePages();
+    Allocator alloc;
+    EXPECT_EQ(alloc.resource(), HugePageAllocator(alloc, 4096).resource());
+
+    size_t size = 3 * HugePageSize + 100;
+    Allocator hugeAlloc = HugePageAllocator(alloc, size);
+    char *ptr = (char *)hugeAlloc.allocate_bytes(size, 64);
+#ifdef PBRT_HAVE_MMAP
+    EXPECT_EQ(0, (uintptr_t)ptr % HugePageSize);
+#endif
+    std::fill(ptr, ptr + size, 1);
+    EXPECT_EQ(1, ptr[size - 1]);
+    hugeAlloc.deallocate_bytes(ptr, size, 64);
+
+    // Disabling huge pages returns the given allocator again.
+    EnableHugePages(false);
+    EXPECT_EQ(alloc.resource(), HugePageAllocator(alloc, size).resource());
+    EnableHugePages(wasEnabled);
+}
+
+TEST(MemoryTag, Hierarchy) {
+    MemoryTag *parent = MemoryTag::Get("Test/Parent");
+    MemoryTag *a = MemoryTag::Get("Test/Parent/A");
+    MemoryTag *b = MemoryTag::Get("Test/Parent/B");
+    EXPECT_EQ(a, MemoryTag::Get("Test/Parent/A"));
+    EXPECT_EQ(2, parent->Children().size());
+
+    int64_t rootBytes = MemoryTag::Root()->CurrentBytes();
+    Allocator allocA = TrackedAllocator(a), allocB = TrackedAllocator(b);
+    EXPECT_EQ(allocA.resource(), TrackedAllocator(a).resource());
+    void *pa = allocA.allocate_bytes(1000);
+    void *pb = allocB.allocate_bytes(500);
+    EXPECT_EQ(1000, a->CurrentBytes());
+    EXPECT_EQ(1500, parent->CurrentBytes());
+    EXPECT_EQ(rootBytes + 1500, MemoryTag::Root()->CurrentBytes());
+
+    // Peaks are maintained after memory is freed.
+    allocA.deallocate_bytes(pa, 1000);
+    EXPECT_EQ(0, a->CurrentBytes());
+    EXPECT_EQ(1000, a->PeakBytes());
+    EXPECT_EQ(500, parent->CurrentBytes());
+    EXPECT_EQ(1500, parent->PeakBytes());
+    allocB.deallocate_bytes(pb, 500);
+    EXPECT_EQ(0, parent->CurrentBytes());
+}
+
+TEST(MemoryTag, Report) {
+    MemoryTag::Get("Test/Report/Child");
+    FILE *f = tmpfile();
+    ASSERT_TRUE(f != nullptr);
+    PrintMemoryReport(f);
+    rewind(f);
+    std::string report;
+    char buf[256];
+    while (fgets(buf, sizeof(buf), f))
+        report += buf;
+    fclose(f);
+
+    // Each tag is printed once, indented under its parent.
+    auto count = [&](const std::string &s) {
+        int n = 0;
+        for (size_t pos = report.find(s); pos != std::string::npos;
+             pos = report.find(s, pos + 1))
+            ++n;
+        return n;
+    };
+    EXPECT_EQ(1, count("Total tracked")) << report;
+    EXPECT_EQ(1, count("  Test ")) << report;
+    EXPECT_EQ(1, count("    Report ")) << report;
+    EXPECT_EQ(1, count("      Child ")) << report;
+}
+
+TEST(ScratchBuffer, HighWaterMark) {
+    ScratchBuffer buf(256);
+    auto use = [&]() {
+        for (int i = 0; i < 10; ++i)
+            buf.Alloc(100, 16);
+    };
+
+    // The first use outgrows the initial buffer...
+    use();
+    EXPECT_GT(buf.Reallocations(), 0);
+    buf.Reset();
+    EXPECT_GE(buf.HighWaterMark(), 1000);
+
+    // ...but afterward, the same use fits.
+    int nReallocs = buf.Reallocations();
+    for (int i = 0; i < 10; ++i) {
+        use();
+        buf.Reset();
+    }
+    EXPECT_EQ(nReallocs, buf.Reallocations());
+
+    // Reserving space up front avoids reallocation entirely.
+    ScratchBuffer presized(256);
+    presized.Reserve(buf.HighWaterMark());
+    nReallocs = presized.Reallocations();
+    for (int i = 0; i < 10; ++i)
+        presized.Alloc(100, 16);
+    EXPECT_EQ(nReallocs, presized.Reallocations());
+
+    // A power-of-two reservation still leaves room for alignment padding.
+    ScratchBuffer exact(256);
+    exact.Reserve(1024);
+    nReallocs = exact.Reallocations();
+    exact.Alloc(1000, 8);
+    exact.Alloc(24, 64);
+    EXPECT_EQ(nReallocs, exact.Reallocations());
+}
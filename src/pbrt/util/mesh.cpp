@@ -4,10 +4,12 @@
 
 #include <pbrt/util/mesh.h>
 
+#include <pbrt/options.h>
 #include <pbrt/util/buffercache.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/paging.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
 #include <pbrt/util/transform.h>
@@ -18,6 +20,47 @@ namespace pbrt {
 
 STAT_RATIO("Geometry/Triangles per mesh", nTris, nTriMeshes);
 STAT_MEMORY_COUNTER("Memory/Triangles", triangleBytes);
+STAT_MEMORY_COUNTER("Memory/Triangle mesh compaction savings", compactionSavedBytes);
+
+// Compact vertex attributes are only used on the CPU; the GPU aggregate
+// requires full-precision vertex indices.
+static bool UseCompactMeshes() {
+    return Options->compactMeshes && !Options->useGPU;
+}
+
+// Vectors are stored using the octahedral encoding, which can't represent
+// zero-length vectors and normalizes the others.
+template <typename V>
+static bool CanEncodeOctahedral(const std::vector<V> &v) {
+    return std::all_of(v.begin(), v.end(),
+                       [](const V &w) { return LengthSquared(w) > 0; });
+}
+
+template <typename V>
+static std::vector<OctahedralVector> EncodeOctahedral(const std::vector<V> &v) {
+    std::vector<OctahedralVector> oct(v.size());
+    for (size_t i = 0; i < v.size(); ++i)
+        oct[i] = OctahedralVector(Vector3f(v[i]));
+    compactionSavedBytes += v.size() * (sizeof(V) - sizeof(OctahedralVector));
+    return oct;
+}
+
+// Returns a copy of _buf_ that is shared with other meshes through the
+// buffer cache, unless geometry paging is enabled; then, each mesh has its
+// own copy, split into paging regions that are returned in _region_, so that
+// meshes and parts of them can be paged independently.
+template <typename T>
+static const T *StoreBuffer(BufferCache<T> *cache, const std::vector<T> &buf,
+                            int *region, Allocator alloc) {
+    PagedMemoryResource *pager = GeometryPager();
+    if (!pager)
+        return cache->LookupOrAdd(buf, alloc);
+    T *ptr = Allocator(pager).allocate_object<T>(buf.size());
+    std::copy(buf.begin(), buf.end(), ptr);
+    *region =
+        pager->AddRegions(ptr, buf.size() * sizeof(T), TriangleMesh::PagingRegionBytes);
+    return ptr;
+}
 
 // TriangleMesh Method Definitions
 TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrientation,
@@ -30,13 +73,20 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
     ++nTriMeshes;
     nTris += nTriangles;
     triangleBytes += sizeof(*this);
+    paged = GeometryPager() != nullptr;
     // Initialize mesh _vertexIndices_
-    vertexIndices = intBufferCache->LookupOrAdd(indices, alloc);
+    bool compact = UseCompactMeshes();
+    if (compact && nVertices <= 65536) {
+        std::vector<uint16_t> indices16(indices.begin(), indices.end());
+        vertexIndices16 = StoreBuffer(uint16BufferCache, indices16, &indicesRegion, alloc);
+        compactionSavedBytes += indices.size() * (sizeof(int) - sizeof(uint16_t));
+    } else
+        vertexIndices = StoreBuffer(intBufferCache, indices, &indicesRegion, alloc);
 
     // Transform mesh vertices to rendering space and initialize mesh _p_
     for (Point3f &pt : p)
         pt = renderFromObject(pt);
-    this->p = point3BufferCache->LookupOrAdd(p, alloc);
+    this->p = StoreBuffer(point3BufferCache, p, &pRegion, alloc);
 
     // Remainder of _TriangleMesh_ constructor
     this->reverseOrientation = reverseOrientation;
@@ -44,7 +94,23 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
 
     if (!uv.empty()) {
         CHECK_EQ(nVertices, uv.size());
-        this->uv = point2BufferCache->LookupOrAdd(uv, alloc);
+        for (Point2f st : uv)
+            uvBounds = Union(uvBounds, st);
+        // Quantize $(u,v)$ to 16 bits over their bounds if their extents are
+        // at most 4, so that the error is at most $4 / (2 \cdot 65535) \approx
+        // 3.05 \times 10^{-5}$
+        Vector2f extent = uvBounds.Diagonal();
+        if (compact && extent.x <= 4 && extent.y <= 4) {
+            std::vector<uint16_t> q(2 * uv.size());
+            for (size_t i = 0; i < uv.size(); ++i) {
+                Vector2f o = uvBounds.Offset(uv[i]);
+                q[2 * i] = pstd::round(Clamp(o.x, 0, 1) * 65535.f);
+                q[2 * i + 1] = pstd::round(Clamp(o.y, 0, 1) * 65535.f);
+            }
+            uvQuantized = StoreBuffer(uint16BufferCache, q, &uvRegion, alloc);
+            compactionSavedBytes += uv.size() * (sizeof(Point2f) - 2 * sizeof(uint16_t));
+        } else
+            this->uv = StoreBuffer(point2BufferCache, uv, &uvRegion, alloc);
     }
     if (!n.empty()) {
         CHECK_EQ(nVertices, n.size());
@@ -53,18 +119,27 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
             if (reverseOrientation)
                 nn = -nn;
         }
-        this->n = normal3BufferCache->LookupOrAdd(n, alloc);
+        if (compact && CanEncodeOctahedral(n))
+            nOct = StoreBuffer(octahedralVectorBufferCache, EncodeOctahedral(n),
+                               &nRegion, alloc);
+        else
+            this->n = StoreBuffer(normal3BufferCache, n, &nRegion, alloc);
     }
     if (!s.empty()) {
         CHECK_EQ(nVertices, s.size());
         for (Vector3f &ss : s)
             ss = renderFromObject(ss);
-        this->s = vector3BufferCache->LookupOrAdd(s, alloc);
+        if (compact && CanEncodeOctahedral(s))
+            sOct = StoreBuffer(octahedralVectorBufferCache, EncodeOctahedral(s),
+                               &sRegion, alloc);
+        else
+            this->s = StoreBuffer(vector3BufferCache, s, &sRegion, alloc);
     }
 
     if (!faceIndices.empty()) {
         CHECK_EQ(nTriangles, faceIndices.size());
-        this->faceIndices = intBufferCache->LookupOrAdd(faceIndices, alloc);
+        this->faceIndices =
+            StoreBuffer(intBufferCache, faceIndices, &faceIndicesRegion, alloc);
     }
 
     // Make sure that we don't have too much stuff to be using integers to
@@ -76,12 +151,31 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
     CHECK_LE(indices.size(), std::numeric_limits<int>::max());
 }
 
+void TriangleMesh::TouchPagedTriangle(int triIndex) const {
+    // Touch the regions holding the triangle's elements of each array
+    PagedMemoryResource *pager = GeometryPager();
+    auto touch = [&](int firstRegion, size_t offset) {
+        if (firstRegion != -1)
+            pager->Touch(firstRegion + int(offset / PagingRegionBytes));
+    };
+    size_t indexBytes = vertexIndices16 ? sizeof(uint16_t) : sizeof(int);
+    touch(indicesRegion, 3 * size_t(triIndex) * indexBytes);
+    touch(faceIndicesRegion, size_t(triIndex) * sizeof(int));
+    for (int v : GetVertexIndices(triIndex)) {
+        touch(pRegion, v * sizeof(Point3f));
+        touch(nRegion, v * (n ? sizeof(Normal3f) : sizeof(OctahedralVector)));
+        touch(sRegion, v * (s ? sizeof(Vector3f) : sizeof(OctahedralVector)));
+        touch(uvRegion, v * (uv ? sizeof(Point2f) : 2 * sizeof(uint16_t)));
+    }
+}
+
 std::string TriangleMesh::ToString() const {
     std::string np = "(nullptr)";
     return StringPrintf(
         "[ TriangleMesh reverseOrientation: %s transformSwapsHandedness: %s "
         "nTriangles: %d nVertices: %d vertexIndices: %s p: %s n: %s "
-        "s: %s uv: %s faceIndices: %s ]",
+        "s: %s uv: %s faceIndices: %s vertexIndices16: %s nOct: %s sOct: %s "
+        "uvQuantized: %s uvBounds: %s paged: %s ]",
         reverseOrientation, transformSwapsHandedness, nTriangles, nVertices,
         vertexIndices ? StringPrintf("%s", pstd::MakeSpan(vertexIndices, 3 * nTriangles))
                       : np,
@@ -89,7 +183,15 @@ std::string TriangleMesh::ToString() const {
         n ? StringPrintf("%s", pstd::MakeSpan(n, nVertices)) : np,
         s ? StringPrintf("%s", pstd::MakeSpan(s, nVertices)) : np,
         uv ? StringPrintf("%s", pstd::MakeSpan(uv, nVertices)) : np,
-        faceIndices ? StringPrintf("%s", pstd::MakeSpan(faceIndices, nTriangles)) : np);
+        faceIndices ? StringPrintf("%s", pstd::MakeSpan(faceIndices, nTriangles)) : np,
+        vertexIndices16
+            ? StringPrintf("%s", pstd::MakeSpan(vertexIndices16, 3 * nTriangles))
+            : np,
+        nOct ? StringPrintf("%s", pstd::MakeSpan(nOct, nVertices)) : np,
+        sOct ? StringPrintf("%s", pstd::MakeSpan(sOct, nVertices)) : np,
+        uvQuantized ? StringPrintf("%s", pstd::MakeSpan(uvQuantized, 2 * nVertices))
+                    : np,
+        uvBounds, paged);
 }
 
 static void PlyErrorCallback(p_ply, const char *message) {
@@ -97,14 +199,26 @@ static void PlyErrorCallback(p_ply, const char *message) {
 }
 
 bool TriangleMesh::WritePLY(std::string filename) const {
-    if (s)
+    if (HasTangents())
         Warning(R"(%s: PLY mesh will be missing tangent vectors "S".)", filename);
 
+    // Decode any compactly-stored vertex attributes
+    std::vector<int> indices;
+    for (int i = 0; i < nTriangles; ++i)
+        for (int v : GetVertexIndices(i))
+            indices.push_back(v);
+    std::vector<Normal3f> N;
+    if (HasNormals())
+        for (int i = 0; i < nVertices; ++i)
+            N.push_back(GetNormal(i));
+    std::vector<Point2f> UV;
+    if (HasUVs())
+        for (int i = 0; i < nVertices; ++i)
+            UV.push_back(GetUV(i));
+
     return pbrt::WritePLY(
-        filename, pstd::span<const int>(vertexIndices, 3 * nTriangles),
-        pstd::span<const int>(), pstd::span<const Point3f>(p, nVertices),
-        pstd::span<const Normal3f>(n, n ? nVertices : 0),
-        pstd::span<const Point2f>(uv, uv ? nVertices : 0),
+        filename, indices, pstd::span<const int>(),
+        pstd::span<const Point3f>(p, nVertices), N, UV,
         pstd::span<const int>(faceIndices, faceIndices ? nTriangles : 0));
 }
 
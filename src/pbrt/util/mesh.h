@@ -33,8 +33,49 @@ class TriangleMesh {
 
     bool WritePLY(std::string filename) const;
 
+    // Records an access to the paged attributes of the given triangle.
+    void TouchPagedTriangle(int triIndex) const;
+
     static void Init(Allocator alloc);
 
+    // Vertex attributes may be stored using either the full-precision or
+    // the compact representation, so they should be accessed using these
+    // methods.
+    PBRT_CPU_GPU
+    pstd::array<int, 3> GetVertexIndices(int triIndex) const {
+        if (vertexIndices16) {
+            const uint16_t *v = &vertexIndices16[3 * triIndex];
+            return {v[0], v[1], v[2]};
+        }
+        const int *v = &vertexIndices[3 * triIndex];
+        return {v[0], v[1], v[2]};
+    }
+
+    PBRT_CPU_GPU
+    bool HasNormals() const { return n || nOct; }
+    PBRT_CPU_GPU
+    Normal3f GetNormal(int vertex) const {
+        return n ? n[vertex] : Normal3f(Vector3f(nOct[vertex]));
+    }
+
+    PBRT_CPU_GPU
+    bool HasTangents() const { return s || sOct; }
+    PBRT_CPU_GPU
+    Vector3f GetTangent(int vertex) const {
+        return s ? s[vertex] : Vector3f(sOct[vertex]);
+    }
+
+    PBRT_CPU_GPU
+    bool HasUVs() const { return uv || uvQuantized; }
+    PBRT_CPU_GPU
+    Point2f GetUV(int vertex) const {
+        if (uv)
+            return uv[vertex];
+        const uint16_t *q = &uvQuantized[2 * vertex];
+        return Point2f(Lerp(q[0] / 65535.f, uvBounds.pMin.x, uvBounds.pMax.x),
+                       Lerp(q[1] / 65535.f, uvBounds.pMin.y, uvBounds.pMax.y));
+    }
+
     // TriangleMesh Public Members
     int nTriangles, nVertices;
     const int *vertexIndices = nullptr;
@@ -43,6 +84,19 @@ class TriangleMesh {
     const Vector3f *s = nullptr;
     const Point2f *uv = nullptr;
     const int *faceIndices = nullptr;
+    // Compact encodings of the attributes above; for each attribute, at most
+    // one of the two representations is used.
+    const uint16_t *vertexIndices16 = nullptr;
+    const OctahedralVector *nOct = nullptr, *sOct = nullptr;
+    const uint16_t *uvQuantized = nullptr;
+    Bounds2f uvBounds;
+    // If the mesh is paged, each of the attribute arrays above is split into
+    // regions of the _GeometryPager()_ of at most _PagingRegionBytes_; these
+    // are the indices of the arrays' first regions, or -1 for unused arrays.
+    static constexpr size_t PagingRegionBytes = 64 * 1024;
+    bool paged = false;
+    int indicesRegion = -1, pRegion = -1, nRegion = -1, sRegion = -1, uvRegion = -1;
+    int faceIndicesRegion = -1;
     bool reverseOrientation, transformSwapsHandedness;
 };
 
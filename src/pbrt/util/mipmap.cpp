@@ -12,15 +12,28 @@
 #include <pbrt/util/file.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // PBRT_HAVE_MMAP
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Image maps", imageMapBytes);
+STAT_MEMORY_COUNTER("Memory/Mapped image map files", mappedImageMapBytes);
 
 ///////////////////////////////////////////////////////////////////////////
 // MIPMap Helper Declarations
@@ -46,6 +59,78 @@ std::string MIPMapFilterOptions::ToString() const {
                         maxAnisotropy);
 }
 
+// Tiled MIP Map File Definitions
+// Tiled MIP map files start with a header that is followed by the tiles of
+// each level, stored as _TextureTileCache_ stores them. The header is padded
+// to 4kB. BC1 and BC4 tiles are 2kB and other formats' tiles are multiples
+// of 4kB, so tiles in formats other than those two start at page boundaries.
+// Values are stored in the byte order of the system that wrote the file.
+static constexpr char TiledMIPMapMagic[8] = "pbrtmip";
+static constexpr int TiledMIPMapVersion = 1;
+static constexpr int64_t TiledMIPMapHeaderBytes = 4096;
+
+struct TiledMIPMapHeader {
+    char magic[8];
+    int32_t version;
+    int32_t tileSize;
+    int32_t format;
+    int32_t nChannels;
+    int32_t wrapMode;
+    int32_t nLevels;
+    char encoding[32];
+    char colorSpace[32];
+    char channelNames[4][32];
+    struct {
+        int32_t resolution[2];
+        int64_t offset;
+    } levels[32];
+};
+static_assert(sizeof(TiledMIPMapHeader) <= TiledMIPMapHeaderBytes,
+              "Tiled MIP map header is too large");
+
+// Maximum number of texels that _MIPMap::texelRun()_ converts at once
+static constexpr int MaxRunTexels = 64;
+
+// Converts the bits of a half-precision value to a _float_, giving the same
+// results as _Half::operator float()_. It doesn't branch, so loops over it
+// can be vectorized by the compiler.
+static inline float HalfBitsToFloat(uint16_t h) {
+    // Shift the exponent and mantissa into place and rescale; this also
+    // handles denormals. Infinities and NaNs need their exponent fixed up.
+    uint32_t bits = uint32_t(h & 0x7fff) << 13;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    f *= 0x1p112f;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if (f >= 65536.f)
+        bits |= 255u << 23;
+    bits |= uint32_t(h & 0x8000) << 16;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static std::string ColorEncodingName(ColorEncoding encoding) {
+    if (!encoding || encoding.Is<LinearColorEncoding>())
+        return "linear";
+    else if (encoding.Is<sRGBColorEncoding>())
+        return "sRGB";
+    else
+        return StringPrintf("gamma %f", encoding.Cast<GammaColorEncoding>()->Gamma());
+}
+
+static std::string ColorSpaceName(const RGBColorSpace *colorSpace) {
+    for (const char *name : {"srgb", "dci-p3", "rec2020", "aces2065-1"})
+        if (RGBColorSpace::GetNamed(name) == colorSpace)
+            return name;
+    LOG_FATAL("Unknown color space");
+    return "";
+}
+
+static void CopyHeaderString(char *dest, size_t size, const std::string &str) {
+    CHECK_LT(str.size(), size);
+    std::memcpy(dest, str.c_str(), str.size() + 1);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 /*
@@ -193,34 +278,442 @@ static PBRT_CONST Float MIPFilterLUT[MIPFilterLUTSize] = {
 // MIPMap Method Definitions
 MIPMap::MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
                Allocator alloc, const MIPMapFilterOptions &options)
-    : colorSpace(colorSpace), wrapMode(wrapMode), options(options) {
+    : mappedLevels(alloc), levelResolutions(alloc), colorSpace(colorSpace),
+      wrapMode(wrapMode), options(options) {
     CHECK(colorSpace);
-    pyramid = Image::GeneratePyramid(std::move(image), wrapMode, alloc);
+    // MIP map levels are large and accessed incoherently, so use huge pages
+    // for them if possible. If the texture cache is in use, the levels are
+    // only needed until they have been added to it.
+    tileCache = TextureCache();
+    Allocator pyramidAlloc =
+        tileCache ? Allocator() : HugePageAllocator(alloc, image.BytesUsed());
+    pyramid = Image::GeneratePyramid(std::move(image), wrapMode, pyramidAlloc);
     if (Options->disableImageTextures) {
         Image top = pyramid.back();
         pyramid.clear();
         pyramid.push_back(top);
     }
-    std::for_each(pyramid.begin(), pyramid.end(),
-                  [](const Image &im) { imageMapBytes += im.BytesUsed(); });
+    format = pyramid[0].Format();
+    encoding = pyramid[0].Encoding();
+    nChannels = pyramid[0].NChannels();
+    for (const Image &im : pyramid)
+        levelResolutions.push_back(im.Resolution());
+
+    if (tileCache) {
+        // Move the pyramid's levels to the texture cache
+        cacheTexture = tileCache->AddTexture(pyramid);
+        pyramid.clear();
+    } else
+        std::for_each(pyramid.begin(), pyramid.end(),
+                      [](const Image &im) { imageMapBytes += im.BytesUsed(); });
+}
+
+MIPMap::MIPMap(const std::string &filename, WrapMode wrapMode, Allocator alloc,
+               const MIPMapFilterOptions &options)
+    : mappedLevels(alloc), levelResolutions(alloc), wrapMode(wrapMode), options(options) {
+#ifdef PBRT_HAVE_MMAP
+    constexpr int TileSize = TextureTileCache::TileSize;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        ErrorExit("%s: %s", filename, ErrorString());
+
+    // Read the file's header and make sure that it can be used
+    TiledMIPMapHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+        std::memcmp(header.magic, TiledMIPMapMagic, sizeof(header.magic)) != 0)
+        ErrorExit("%s: not a tiled MIP map file", filename);
+    if (header.version != TiledMIPMapVersion)
+        ErrorExit("%s: tiled MIP map file version %d is not supported", filename,
+                  header.version);
+    if (header.tileSize != TileSize)
+        ErrorExit("%s: tile size %d doesn't match expected tile size %d", filename,
+                  header.tileSize, TileSize);
+    if (header.nLevels < 1 || header.nLevels > 32 ||
+        (header.nChannels != 1 && header.nChannels != 3 && header.nChannels != 4) ||
+        header.format < int(PixelFormat::U256) || header.format > int(PixelFormat::BC7) ||
+        !SupportsChannels(PixelFormat(header.format), header.nChannels))
+        ErrorExit("%s: corrupt tiled MIP map file", filename);
+    header.encoding[sizeof(header.encoding) - 1] = '\0';
+    header.colorSpace[sizeof(header.colorSpace) - 1] = '\0';
+
+    format = PixelFormat(header.format);
+    nChannels = header.nChannels;
+    encoding = ColorEncoding::Get(header.encoding, alloc);
+    colorSpace = RGBColorSpace::GetNamed(header.colorSpace);
+    if (!colorSpace)
+        ErrorExit("%s: %s: unknown color space", filename, header.colorSpace);
+    if (WrapMode(header.wrapMode) != wrapMode)
+        Warning("%s: MIP map was generated with \"%s\" wrap mode but \"%s\" is "
+                "being used for lookups.",
+                filename, WrapMode(header.wrapMode), wrapMode);
+
+    // Find the levels' tiles and make sure that the file holds all of them
+    size_t tileBytes = TextureTileCache::TileBytes(format, nChannels);
+    int64_t fileBytes = TiledMIPMapHeaderBytes;
+    for (int i = 0; i < header.nLevels; ++i) {
+        Point2i resolution(header.levels[i].resolution[0],
+                           header.levels[i].resolution[1]);
+        if (resolution.x < 1 || resolution.y < 1)
+            ErrorExit("%s: corrupt tiled MIP map file", filename);
+        // Tile coordinates must fit in the texture cache's 19-bit tile keys
+        if (resolution.x > (TileSize << 19) || resolution.y > (TileSize << 19))
+            ErrorExit("%s: level %d resolution %d x %d is too large for a tiled MIP "
+                      "map; at most %d texels are supported in each dimension.",
+                      filename, i, resolution.x, resolution.y, TileSize << 19);
+        int nTilesX = (resolution.x + TileSize - 1) / TileSize;
+        int nTilesY = (resolution.y + TileSize - 1) / TileSize;
+        // Make sure the level's tiles follow the header, are aligned to tile
+        // boundaries, and end within the range of file offsets
+        int64_t offset = header.levels[i].offset;
+        int64_t levelBytes = int64_t(nTilesX) * nTilesY * int64_t(tileBytes);
+        if (offset < TiledMIPMapHeaderBytes ||
+            (offset - TiledMIPMapHeaderBytes) % int64_t(tileBytes) != 0 ||
+            offset > std::numeric_limits<int64_t>::max() - levelBytes)
+            ErrorExit("%s: corrupt tiled MIP map file", filename);
+        mappedLevels.push_back(TextureTileCache::Level{resolution, nTilesX, offset});
+        fileBytes = std::max<int64_t>(fileBytes, offset + levelBytes);
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    if (stat.st_size < fileBytes)
+        ErrorExit("%s: tiled MIP map file is truncated", filename);
+
+    if (Options->disableImageTextures) {
+        TextureTileCache::Level top = mappedLevels.back();
+        mappedLevels.clear();
+        mappedLevels.push_back(top);
+    }
+    for (const TextureTileCache::Level &level : mappedLevels)
+        levelResolutions.push_back(level.resolution);
+
+    tileCache = TextureCache();
+    if (tileCache) {
+        // Let the texture cache read tiles from the file as they are needed
+        std::vector<std::string> channelNames;
+        for (int c = 0; c < nChannels; ++c) {
+            header.channelNames[c][sizeof(header.channelNames[c]) - 1] = '\0';
+            channelNames.push_back(header.channelNames[c]);
+        }
+        cacheTexture = tileCache->AddTextureFile(filename, format, channelNames,
+                                                 encoding, mappedLevels);
+    } else {
+        void *ptr = mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+            ErrorExit("%s: %s", filename, ErrorString());
+        mappedTiles = (const uint8_t *)ptr;
+        mappedImageMapBytes += fileBytes;
+    }
+    close(fd);
+#else
+    ErrorExit("%s: tiled MIP map files are not supported on this system.", filename);
+#endif  // PBRT_HAVE_MMAP
+}
+
+bool MIPMap::WriteTiled(const std::string &filename,
+                        pstd::optional<PixelFormat> newFormat,
+                        ColorEncoding newEncoding) const {
+    CHECK(!pyramid.empty());
+    constexpr int TileSize = TextureTileCache::TileSize;
+    if (pyramid.size() > 32) {
+        Error("%s: too many MIP map levels (%d) for a tiled file.", filename,
+              pyramid.size());
+        return false;
+    }
+
+    // Find the format and encoding of the tiles' texels
+    const Image &base = pyramid[0];
+    PixelFormat tileFormat = newFormat.value_or(base.Format());
+    if (!SupportsChannels(tileFormat, nChannels)) {
+        Error("%s: %s images can't have %d channels.", filename, tileFormat, nChannels);
+        return false;
+    }
+    ColorEncoding tileEncoding = base.Encoding();
+    bool baseIs8Bit = Is8Bit(base.Format()) || IsBlockCompressed(base.Format());
+    if (!baseIs8Bit && (Is8Bit(tileFormat) || IsBlockCompressed(tileFormat))) {
+        tileEncoding = newEncoding ? newEncoding : ColorEncoding::sRGB;
+        // Warn about values that the quantized texels will clamp to one
+        Float maxValue = 0;
+        for (int y = 0; y < base.Resolution().y; ++y)
+            for (int x = 0; x < base.Resolution().x; ++x)
+                for (int c = 0; c < nChannels; ++c)
+                    maxValue = std::max(maxValue, base.GetChannel({x, y}, c));
+        if (maxValue > 1)
+            Warning("%s: %s texels can't store values greater than one; values up "
+                    "to %f will be clamped.",
+                    filename, tileFormat, maxValue);
+    }
+
+    // Initialize the header and find where each level's tiles start
+    TiledMIPMapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TiledMIPMapMagic, sizeof(header.magic));
+    header.version = TiledMIPMapVersion;
+    header.tileSize = TileSize;
+    header.format = int(tileFormat);
+    header.nChannels = nChannels;
+    header.wrapMode = int(wrapMode);
+    header.nLevels = pyramid.size();
+    CopyHeaderString(header.encoding, sizeof(header.encoding),
+                     ColorEncodingName(tileEncoding));
+    CopyHeaderString(header.colorSpace, sizeof(header.colorSpace),
+                     ColorSpaceName(colorSpace));
+    for (int c = 0; c < nChannels; ++c)
+        CopyHeaderString(header.channelNames[c], sizeof(header.channelNames[c]),
+                         base.ChannelNames()[c]);
+    size_t tileBytes = TextureTileCache::TileBytes(tileFormat, nChannels);
+    int64_t offset = TiledMIPMapHeaderBytes;
+    for (size_t i = 0; i < pyramid.size(); ++i) {
+        Point2i resolution = pyramid[i].Resolution();
+        header.levels[i].resolution[0] = resolution.x;
+        header.levels[i].resolution[1] = resolution.y;
+        header.levels[i].offset = offset;
+        offset += int64_t((resolution.x + TileSize - 1) / TileSize) *
+                  ((resolution.y + TileSize - 1) / TileSize) * tileBytes;
+    }
+
+    FILE *f = FOpenWrite(filename);
+    if (!f) {
+        Error("%s: %s", filename, ErrorString());
+        return false;
+    }
+    // Write the padded header followed by the tiles
+    std::vector<uint8_t> data(TiledMIPMapHeaderBytes, 0);
+    std::memcpy(data.data(), &header, sizeof(header));
+    bool success = fwrite(data.data(), 1, data.size(), f) == data.size();
+    data.resize(tileBytes);
+    for (const Image &level : pyramid) {
+        // Convert the level to the tiles' format if necessary
+        Image converted;
+        if (level.Format() != tileFormat)
+            converted = level.ConvertToFormat(tileFormat, tileEncoding);
+        const Image &image = converted ? converted : level;
+        Point2i resolution = image.Resolution();
+        for (int y = 0; y < (resolution.y + TileSize - 1) / TileSize; ++y)
+            for (int x = 0; x < (resolution.x + TileSize - 1) / TileSize; ++x) {
+                TextureTileCache::CopyTile(image, {x, y}, pstd::MakeSpan(data));
+                success &= fwrite(data.data(), 1, data.size(), f) == data.size();
+            }
+    }
+    success &= fclose(f) == 0;
+    if (!success)
+        Error("%s: error writing tiled MIP map: %s", filename, ErrorString());
+    return success;
+}
+
+Float MIPMap::texelChannel(int level, Point2i st, int c) const {
+    if (!pyramid.empty())
+        return pyramid[level].GetChannel(st, c, wrapMode);
+    if (!RemapPixelCoords(&st, levelResolutions[level], wrapMode))
+        return 0;
+    constexpr int TileSize = TextureTileCache::TileSize;
+    Point2i tile(st.x / TileSize, st.y / TileSize);
+    Point2i p(st.x % TileSize, st.y % TileSize);
+    if (tileCache)
+        // Look up the texel in its tile in the texture cache
+        return tileCache->GetTile(cacheTexture, level, tile).GetChannel(p, c);
+
+    // Find the texel in its tile in the mapped file and convert it to _Float_
+    const uint8_t *texel = mappedTexel(level, tile, p);
+    switch (format) {
+    case PixelFormat::U256: {
+        Float v;
+        encoding.ToLinear({texel + c, 1}, {&v, 1});
+        return v;
+    }
+    case PixelFormat::Half: {
+        uint16_t bits;
+        std::memcpy(&bits, texel + 2 * c, sizeof(bits));
+        return Float(Half::FromBits(bits));
+    }
+    case PixelFormat::Float: {
+        float v;
+        std::memcpy(&v, texel + 4 * c, sizeof(v));
+        return v;
+    }
+    case PixelFormat::BC1:
+    case PixelFormat::BC4:
+    case PixelFormat::BC5:
+    case PixelFormat::BC7: {
+        uint8_t rgba[4];
+        DecodeBlockTexel(format, texel, 4 * (p.y % 4) + p.x % 4, rgba);
+        Float v;
+        encoding.ToLinear({&rgba[c], 1}, {&v, 1});
+        return v;
+    }
+    default:
+        LOG_FATAL("Unhandled PixelFormat");
+        return 0;
+    }
+}
+
+const uint8_t *MIPMap::mappedTexel(int level, Point2i tile, Point2i p) const {
+    constexpr int TileSize = TextureTileCache::TileSize;
+    const TextureTileCache::Level &l = mappedLevels[level];
+    const uint8_t *tileData = mappedTiles + l.fileOffset +
+                              (size_t(tile.y) * l.nTilesX + tile.x) *
+                                  TextureTileCache::TileBytes(format, nChannels);
+    if (IsBlockCompressed(format))
+        // Return the block that holds the texel
+        return tileData + ((p.y / 4) * (TileSize / 4) + p.x / 4) * BlockBytes(format);
+    return tileData + (p.y * TileSize + p.x) * TexelBytes(format) * nChannels;
+}
+
+int MIPMap::texelRun(int level, Point2i st, int maxTexels, int runChannels,
+                     Float *values) const {
+    // Remap texel coordinates outside of the level according to the wrap mode
+    Point2i resolution = levelResolutions[level];
+    if (st.x < 0 || st.y < 0 || st.x >= resolution.x || st.y >= resolution.y) {
+        // Find how many texels until the run may reach the level's interior
+        int nOutside = (st.x < 0 && st.y >= 0 && st.y < resolution.y)
+                           ? std::min(maxTexels, -st.x)
+                           : maxTexels;
+        switch (wrapMode) {
+        case WrapMode::Repeat:
+            st = Point2i(Mod(st.x, resolution.x), Mod(st.y, resolution.y));
+            break;
+        case WrapMode::Clamp:
+            st.y = Clamp(st.y, 0, resolution.y - 1);
+            if (st.x < 0 || st.x >= resolution.x) {
+                // Replicate the texel at the edge of the level
+                nOutside = st.x < 0 ? std::min(maxTexels, -st.x) : maxTexels;
+                st.x = Clamp(st.x, 0, resolution.x - 1);
+                texelRun(level, st, 1, runChannels, values);
+                for (int i = runChannels; i < nOutside * runChannels; ++i)
+                    values[i] = values[i - runChannels];
+                return nOutside;
+            }
+            break;
+        case WrapMode::Black:
+            std::fill(values, values + nOutside * runChannels, Float(0));
+            return nOutside;
+        default:
+            // Octahedral wrapping changes both coordinates, so the caller
+            // handles each texel individually.
+            return 0;
+        }
+    }
+
+    // Find up to _maxTexels_ texels starting at _st_ that are adjacent in memory;
+    // runs of block-compressed texels end at the edge of their block.
+    int n = std::min(maxTexels, resolution.x - st.x);
+    if (IsBlockCompressed(format))
+        n = std::min(n, 4 - st.x % 4);
+    const void *texels;
+    if (!pyramid.empty())
+        texels = pyramid[level].RawPointer(st);
+    else {
+        constexpr int TileSize = TextureTileCache::TileSize;
+        Point2i tile(st.x / TileSize, st.y / TileSize);
+        Point2i p(st.x % TileSize, st.y % TileSize);
+        n = std::min(n, TileSize - p.x);
+        if (tileCache)
+            texels = tileCache->GetTile(cacheTexture, level, tile).RawPointer(p);
+        else
+            texels = mappedTexel(level, tile, p);
+    }
+
+    // Convert the first _runChannels_ channels of the texels to _Float_ values
+    DCHECK_LE(runChannels, nChannels);
+    int nValues = n * runChannels;
+    switch (format) {
+    case PixelFormat::U256: {
+        const uint8_t *u = (const uint8_t *)texels;
+        if (runChannels == nChannels)
+            encoding.ToLinear({u, size_t(nValues)}, {values, size_t(nValues)});
+        else {
+            // Gather the channels so that they can be converted together
+            uint8_t gathered[4 * MaxRunTexels];
+            DCHECK_LE(nValues, 4 * MaxRunTexels);
+            for (int i = 0; i < n; ++i)
+                for (int c = 0; c < runChannels; ++c)
+                    gathered[i * runChannels + c] = u[i * nChannels + c];
+            encoding.ToLinear({gathered, size_t(nValues)}, {values, size_t(nValues)});
+        }
+        break;
+    }
+    case PixelFormat::Half: {
+        const uint16_t *h = (const uint16_t *)texels;
+        for (int i = 0; i < n; ++i)
+            for (int c = 0; c < runChannels; ++c)
+                values[i * runChannels + c] = HalfBitsToFloat(h[i * nChannels + c]);
+        break;
+    }
+    case PixelFormat::Float: {
+        const float *f = (const float *)texels;
+        for (int i = 0; i < n; ++i)
+            for (int c = 0; c < runChannels; ++c)
+                values[i * runChannels + c] = f[i * nChannels + c];
+        break;
+    }
+    case PixelFormat::BC1:
+    case PixelFormat::BC4:
+    case PixelFormat::BC5:
+    case PixelFormat::BC7: {
+        // Decode the texels from their block and convert them together
+        uint8_t decoded[4 * 4];
+        int first = 4 * (st.y % 4) + st.x % 4;
+        for (int i = 0; i < n; ++i) {
+            uint8_t rgba[4];
+            DecodeBlockTexel(format, (const uint8_t *)texels, first + i, rgba);
+            for (int c = 0; c < runChannels; ++c)
+                decoded[i * runChannels + c] = rgba[c];
+        }
+        encoding.ToLinear({decoded, size_t(nValues)}, {values, size_t(nValues)});
+        break;
+    }
+    default:
+        LOG_FATAL("Unhandled PixelFormat");
+    }
+    return n;
+}
+
+template <>
+Float MIPMap::texelValue(const Float *values) const {
+    return values[0];
+}
+
+template <>
+RGB MIPMap::texelValue(const Float *values) const {
+    if (nChannels == 3 || nChannels == 4)
+        return RGB(values[0], values[1], values[2]);
+    else {
+        CHECK_EQ(1, nChannels);
+        return RGB(values[0], values[0], values[0]);
+    }
+}
+
+Float MIPMap::bilerpChannel(int level, Point2f st, int c) const {
+    if (!pyramid.empty())
+        return pyramid[level].BilerpChannel(st, c, wrapMode);
+    // Bilinearly interpolate texels from the tiles as _Image::BilerpChannel()_
+    // does
+    Point2i resolution = levelResolutions[level];
+    Float x = st[0] * resolution.x - 0.5f, y = st[1] * resolution.y - 0.5f;
+    int xi = pstd::floor(x), yi = pstd::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    pstd::array<Float, 4> v = {
+        texelChannel(level, {xi, yi}, c), texelChannel(level, {xi + 1, yi}, c),
+        texelChannel(level, {xi, yi + 1}, c), texelChannel(level, {xi + 1, yi + 1}, c)};
+    return ((1 - dx) * (1 - dy) * v[0] + dx * (1 - dy) * v[1] + (1 - dx) * dy * v[2] +
+            dx * dy * v[3]);
 }
 
 template <>
 Float MIPMap::Texel(int level, Point2i st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    return pyramid[level].GetChannel(st, 0, wrapMode);
+    DCHECK(level >= 0 && level < Levels());
+    return texelChannel(level, st, 0);
 }
 
 template <>
 RGB MIPMap::Texel(int level, Point2i st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    if (int nc = pyramid[level].NChannels(); nc == 3 || nc == 4)
-        return RGB(pyramid[level].GetChannel(st, 0, wrapMode),
-                   pyramid[level].GetChannel(st, 1, wrapMode),
-                   pyramid[level].GetChannel(st, 2, wrapMode));
+    DCHECK(level >= 0 && level < Levels());
+    if (nChannels == 3 || nChannels == 4)
+        return RGB(texelChannel(level, st, 0), texelChannel(level, st, 1),
+                   texelChannel(level, st, 2));
     else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].GetChannel(st, 0, wrapMode);
+        CHECK_EQ(1, nChannels);
+        Float v = texelChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
@@ -285,14 +778,13 @@ T MIPMap::Filter(Point2f st, Vector2f dst0, Vector2f dst1) const {
 
 template <>
 RGB MIPMap::Bilerp(int level, Point2f st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    if (int nc = pyramid[level].NChannels(); nc == 3 || nc == 4)
-        return RGB(pyramid[level].BilerpChannel(st, 0, wrapMode),
-                   pyramid[level].BilerpChannel(st, 1, wrapMode),
-                   pyramid[level].BilerpChannel(st, 2, wrapMode));
+    DCHECK(level >= 0 && level < Levels());
+    if (nChannels == 3 || nChannels == 4)
+        return RGB(bilerpChannel(level, st, 0), bilerpChannel(level, st, 1),
+                   bilerpChannel(level, st, 2));
     else {
-        DCHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].BilerpChannel(st, 0, wrapMode);
+        DCHECK_EQ(1, nChannels);
+        Float v = bilerpChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
@@ -329,20 +821,53 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     int t1 = pstd::floor(st[1] + 2 * invDet * vSqrt);
 
     // Scan over ellipse bound and evaluate quadratic equation to filter image
+    // Only the first channel is needed for _Float_ lookups
+    int runChannels = std::is_same_v<T, Float> ? 1 : nChannels;
     T sum{};
     Float sumWts = 0;
     for (int it = t0; it <= t1; ++it) {
         Float tt = it - st[1];
-        for (int is = s0; is <= s1; ++is) {
-            Float ss = is - st[0];
-            // Compute squared radius and filter texel if it is inside the ellipse
-            Float r2 = A * Sqr(ss) + B * ss * tt + C * Sqr(tt);
-            if (r2 < 1) {
-                int index = std::min<int>(r2 * MIPFilterLUTSize, MIPFilterLUTSize - 1);
-                Float weight = MIPFilterLUT[index];
-                sum += weight * Texel<T>(level, {is, it});
-                sumWts += weight;
+        // Find the texels in the row that may be inside the ellipse
+        Float disc = Sqr(B * tt) - 4 * A * (C * Sqr(tt) - 1);
+        if (disc <= 0)
+            continue;
+        Float sCenter = st[0] - B * tt / (2 * A), sRadius = std::sqrt(disc) / (2 * A);
+        int rowS0 = std::max<int>(s0, pstd::floor(sCenter - sRadius));
+        int rowS1 = std::min<int>(s1, pstd::ceil(sCenter + sRadius));
+
+        // Filter runs of texels that are adjacent in memory; texels that need
+        // to be remapped by the wrap mode are filtered individually.
+        Float values[4 * MaxRunTexels], weights[MaxRunTexels];
+        bool inside[MaxRunTexels];
+        for (int is = rowS0; is <= rowS1;) {
+            int n = texelRun(level, {is, it}, std::min(rowS1 - is + 1, MaxRunTexels),
+                             runChannels, values);
+            bool run = n > 0;
+            if (!run)
+                n = 1;
+            // Compute the texels' squared radii and filter weights
+            for (int i = 0; i < n; ++i) {
+                Float ss = is + i - st[0];
+                Float r2 = A * Sqr(ss) + B * ss * tt + C * Sqr(tt);
+                inside[i] = r2 < 1;
+                weights[i] = 0;
+                if (inside[i]) {
+                    int index = std::min<int>(r2 * MIPFilterLUTSize, MIPFilterLUTSize - 1);
+                    weights[i] = MIPFilterLUT[index];
+                }
+            }
+
+            // Only accumulate texels inside the ellipse so that infinite
+            // texels outside it don't contribute NaN values
+            for (int i = 0; i < n; ++i) {
+                if (!inside[i])
+                    continue;
+                T texel = run ? texelValue<T>(&values[i * runChannels])
+                              : Texel<T>(level, {is, it});
+                sum += weights[i] * texel;
+                sumWts += weights[i];
             }
+            is += n;
         }
     }
     return sum / sumWts;
@@ -351,7 +876,13 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
 MIPMap *MIPMap::CreateFromFile(const std::string &filename,
                                const MIPMapFilterOptions &options, WrapMode wrapMode,
                                ColorEncoding encoding, Allocator alloc) {
-    ImageAndMetadata imageAndMetadata = Image::Read(filename, alloc, encoding);
+    if (HasExtension(filename, "mipmap"))
+        return alloc.new_object<MIPMap>(filename, wrapMode, alloc, options);
+
+    // Images that are added to the texture cache don't need to outlive this
+    // function, so they are allocated separately from the MIP map.
+    Allocator imageAlloc = TextureCache() ? Allocator() : alloc;
+    ImageAndMetadata imageAndMetadata = Image::Read(filename, imageAlloc, encoding);
 
     Image &image = imageAndMetadata.image;
     if (image.NChannels() != 1) {
@@ -360,18 +891,19 @@ MIPMap *MIPMap::CreateFromFile(const std::string &filename,
         ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
         if (rgbaDesc) {
             // Is alpha all ones?
-            bool allOne = true;
-            for (int y = 0; y < image.Resolution().y; ++y)
-                for (int x = 0; x < image.Resolution().x; ++x)
-                    if (image.GetChannels({x, y}, rgbaDesc)[3] != 1)
+            std::atomic<bool> allOne{true};
+            ParallelFor(0, image.Resolution().y, [&](int64_t y) {
+                for (int x = 0; x < image.Resolution().x && allOne; ++x)
+                    if (image.GetChannel({x, int(y)}, rgbaDesc.offset[3]) != 1)
                         allOne = false;
+            });
             if (allOne)
-                image = image.SelectChannels(rgbDesc, alloc);
+                image = image.SelectChannels(rgbDesc, imageAlloc);
             else
-                image = image.SelectChannels(rgbaDesc, alloc);
+                image = image.SelectChannels(rgbaDesc, imageAlloc);
         } else {
             if (rgbDesc)
-                image = image.SelectChannels(rgbDesc, alloc);
+                image = image.SelectChannels(rgbDesc, imageAlloc);
             else
                 ErrorExit("%s: image doesn't have R, G, and B channels", filename);
         }
@@ -394,17 +926,19 @@ T MIPMap::Bilerp(int level, Point2f st) const {
 
 template <>
 Float MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    switch (pyramid[level].NChannels()) {
+    CHECK(level >= 0 && level < Levels());
+    switch (nChannels) {
     case 1:
-        return pyramid[level].BilerpChannel(st, 0, wrapMode);
+        return bilerpChannel(level, st, 0);
     case 3:
-        return pyramid[level].Bilerp(st, wrapMode).Average();
+        if (!pyramid.empty())
+            return pyramid[level].Bilerp(st, wrapMode).Average();
+        return Bilerp<RGB>(level, st).Average();
     case 4:
         // Return alpha
-        return pyramid[level].BilerpChannel(st, 3, wrapMode);
+        return bilerpChannel(level, st, 3);
     default:
-        LOG_FATAL("Unexpected number of image channels: %d", pyramid[level].NChannels());
+        LOG_FATAL("Unexpected number of image channels: %d", nChannels);
     }
 }
 
@@ -9,6 +9,7 @@
 
 #include <pbrt/util/image.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/texturecache.h>
 #include <pbrt/util/vecmath.h>
 
 #include <memory>
@@ -51,6 +52,11 @@ class MIPMap {
     // MIPMap Public Methods
     MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
            Allocator alloc, const MIPMapFilterOptions &options);
+    // Reads a MIP map from a file written by _WriteTiled()_; its tiles are
+    // accessed directly from the file without any decoding other than that of
+    // block-compressed texels when they are looked up.
+    MIPMap(const std::string &filename, WrapMode wrapMode, Allocator alloc,
+           const MIPMapFilterOptions &options);
     static MIPMap *CreateFromFile(const std::string &filename,
                                   const MIPMapFilterOptions &options, WrapMode wrapMode,
                                   ColorEncoding encoding, Allocator alloc);
@@ -58,15 +64,28 @@ class MIPMap {
     template <typename T>
     T Filter(Point2f st, Vector2f dstdx, Vector2f dstdy) const;
 
+    // Writes all of the MIP map's levels to a tiled file. Files with the
+    // ".mipmap" extension are read in that format by _CreateFromFile()_.
+    // The levels may be converted to another format, such as a block-compressed
+    // one; levels that aren't already 8-bit are quantized using _newEncoding_,
+    // or the sRGB encoding if it isn't provided. Those formats can't store
+    // values greater than one, so high dynamic range images are clamped.
+    bool WriteTiled(const std::string &filename,
+                    pstd::optional<PixelFormat> newFormat = {},
+                    ColorEncoding newEncoding = nullptr) const;
+
     std::string ToString() const;
 
     Point2i LevelResolution(int level) const {
-        CHECK(level >= 0 && level < pyramid.size());
-        return pyramid[level].Resolution();
+        CHECK(level >= 0 && level < levelResolutions.size());
+        return levelResolutions[level];
     }
-    int Levels() const { return int(pyramid.size()); }
+    int Levels() const { return int(levelResolutions.size()); }
     const RGBColorSpace *GetRGBColorSpace() const { return colorSpace; }
-    const Image &GetLevel(int level) const { return pyramid[level]; }
+    const Image &GetLevel(int level) const {
+        CHECK(!pyramid.empty());
+        return pyramid[level];
+    }
 
   private:
     // MIPMap Private Methods
@@ -77,8 +96,28 @@ class MIPMap {
     template <typename T>
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
 
+    Float texelChannel(int level, Point2i st, int c) const;
+    Float bilerpChannel(int level, Point2f st, int c) const;
+    const uint8_t *mappedTexel(int level, Point2i tile, Point2i p) const;
+    int texelRun(int level, Point2i st, int maxTexels, int runChannels,
+                 Float *values) const;
+    template <typename T>
+    T texelValue(const Float *values) const;
+
     // MIPMap Private Members
+    // If the texture cache is in use, the pyramid's levels are stored there
+    // and _pyramid_ is empty.
     pstd::vector<Image> pyramid;
+    TextureTileCache *tileCache = nullptr;
+    int cacheTexture = -1;
+    // MIP maps that are read from tiled files without the texture cache
+    // access the tiles of their levels in the memory-mapped file.
+    const uint8_t *mappedTiles = nullptr;
+    pstd::vector<TextureTileCache::Level> mappedLevels;
+    PixelFormat format;
+    ColorEncoding encoding;
+    pstd::vector<Point2i> levelResolutions;
+    int nChannels;
     const RGBColorSpace *colorSpace;
     WrapMode wrapMode;
     MIPMapFilterOptions options;
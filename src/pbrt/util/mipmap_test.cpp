@@ -0,0 +1,330 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/color.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/rng.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace pbrt;
+
+#ifdef PBRT_HAVE_MMAP
+TEST(MIPMap, TiledFile) {
+    struct Config {
+        PixelFormat format;
+        Point2i resolution;
+        std::vector<std::string> channelNames;
+        WrapMode wrapMode;
+    };
+    for (const Config &config :
+         {Config{PixelFormat::Float, {300, 200}, {"Y"}, WrapMode::Repeat},
+          Config{PixelFormat::U256, {256, 128}, {"R", "G", "B"}, WrapMode::Clamp},
+          Config{PixelFormat::Half, {129, 65}, {"R", "G", "B", "A"}, WrapMode::Repeat}}) {
+        Image image(config.format, config.resolution, config.channelNames,
+                    ColorEncoding::sRGB);
+        RNG rng;
+        for (int y = 0; y < config.resolution.y; ++y)
+            for (int x = 0; x < config.resolution.x; ++x)
+                for (int c = 0; c < image.NChannels(); ++c)
+                    image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+        MIPMapFilterOptions options;
+        options.filter = FilterFunction::EWA;
+        MIPMap mipmap(image, RGBColorSpace::sRGB, config.wrapMode, Allocator(),
+                      options);
+        std::string filename = "test.mipmap";
+        ASSERT_TRUE(mipmap.WriteTiled(filename));
+        MIPMap *tiled = MIPMap::CreateFromFile(filename, options, config.wrapMode,
+                                               nullptr, Allocator());
+        ASSERT_EQ(mipmap.Levels(), tiled->Levels());
+        EXPECT_EQ(RGBColorSpace::sRGB, tiled->GetRGBColorSpace());
+
+        // Lookups in the mapped file should match the original exactly.
+        for (int i = 0; i < 1000; ++i) {
+            Point2f st(-1 + 3 * rng.Uniform<Float>(), -1 + 3 * rng.Uniform<Float>());
+            Vector2f dst0(.1f * rng.Uniform<Float>(), .01f * rng.Uniform<Float>());
+            Vector2f dst1(.01f * rng.Uniform<Float>(), .1f * rng.Uniform<Float>());
+            EXPECT_EQ(mipmap.Filter<Float>(st, dst0, dst1),
+                      tiled->Filter<Float>(st, dst0, dst1));
+            if (image.NChannels() > 1)
+                EXPECT_EQ(mipmap.Filter<RGB>(st, dst0, dst1),
+                          tiled->Filter<RGB>(st, dst0, dst1));
+        }
+        EXPECT_TRUE(RemoveFile(filename));
+    }
+}
+
+TEST(MIPMap, TiledFileCompressed) {
+    struct Config {
+        PixelFormat format;
+        std::vector<std::string> channelNames;
+    };
+    for (const Config &config : {Config{PixelFormat::BC1, {"R", "G", "B"}},
+                                 Config{PixelFormat::BC4, {"Y"}},
+                                 Config{PixelFormat::BC7, {"R", "G", "B", "A"}}}) {
+        // Create a smooth image with correlated channels so that compression
+        // doesn't lose much, even at the coarser levels
+        Point2i res(200, 130);
+        Image image(PixelFormat::U256, res, config.channelNames, ColorEncoding::sRGB);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < image.NChannels(); ++c)
+                    image.SetChannel({x, y}, c,
+                                     (c + 2) / 5.f *
+                                         (0.5f + 0.4f * std::sin(0.05f * x + 0.03f * y)));
+
+        MIPMapFilterOptions options;
+        options.filter = FilterFunction::EWA;
+        MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(), options);
+        std::string filename = "test.mipmap";
+        ASSERT_TRUE(mipmap.WriteTiled(filename, config.format));
+        MIPMap *tiled = MIPMap::CreateFromFile(filename, options, WrapMode::Clamp,
+                                               nullptr, Allocator());
+        ASSERT_EQ(mipmap.Levels(), tiled->Levels());
+        // MIP maps of compressed images are compressed level by level.
+        MIPMap compressed(image.ConvertToFormat(config.format), RGBColorSpace::sRGB,
+                          WrapMode::Clamp, Allocator(), options);
+        EXPECT_EQ(config.format, compressed.GetLevel(0).Format());
+
+        RNG rng;
+        for (int i = 0; i < 1000; ++i) {
+            Point2f st(rng.Uniform<Float>(), rng.Uniform<Float>());
+            Vector2f dst0(.05f * rng.Uniform<Float>(), .005f * rng.Uniform<Float>());
+            Vector2f dst1(.005f * rng.Uniform<Float>(), .05f * rng.Uniform<Float>());
+            Float v = mipmap.Filter<Float>(st, dst0, dst1);
+            EXPECT_NEAR(v, tiled->Filter<Float>(st, dst0, dst1), .04f);
+            EXPECT_NEAR(v, compressed.Filter<Float>(st, dst0, dst1), .04f);
+            if (image.NChannels() > 1) {
+                RGB rgb = mipmap.Filter<RGB>(st, dst0, dst1);
+                RGB tiledRGB = tiled->Filter<RGB>(st, dst0, dst1);
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_NEAR(rgb[c], tiledRGB[c], .04f);
+            }
+        }
+        EXPECT_TRUE(RemoveFile(filename));
+    }
+}
+#endif  // PBRT_HAVE_MMAP
+
+// Returns the texel's value as _MIPMap::Texel()_ does for in-memory pyramids.
+template <typename T>
+static T ReferenceTexel(const Image &image, Point2i p, WrapMode wrapMode) {
+    if constexpr (std::is_same_v<T, Float>)
+        return image.GetChannel(p, 0, wrapMode);
+    else if (image.NChannels() == 1) {
+        Float v = image.GetChannel(p, 0, wrapMode);
+        return RGB(v, v, v);
+    } else
+        return RGB(image.GetChannel(p, 0, wrapMode), image.GetChannel(p, 1, wrapMode),
+                   image.GetChannel(p, 2, wrapMode));
+}
+
+// EWA filtering that looks up each texel in the ellipse's bounds individually
+// using the same filter weights as _MIPMap::EWA()_.
+template <typename T>
+static T ReferenceEWA(const MIPMap &mipmap, WrapMode wrapMode, int level, Point2f st,
+                      Vector2f dst0, Vector2f dst1) {
+    if (level >= mipmap.Levels())
+        return ReferenceTexel<T>(mipmap.GetLevel(mipmap.Levels() - 1), {0, 0},
+                                 wrapMode);
+    Point2i levelRes = mipmap.LevelResolution(level);
+    st[0] = st[0] * levelRes[0] - 0.5f;
+    st[1] = st[1] * levelRes[1] - 0.5f;
+    dst0[0] *= levelRes[0];
+    dst0[1] *= levelRes[1];
+    dst1[0] *= levelRes[0];
+    dst1[1] *= levelRes[1];
+
+    Float A = Sqr(dst0[1]) + Sqr(dst1[1]) + 1;
+    Float B = -2 * (dst0[0] * dst0[1] + dst1[0] * dst1[1]);
+    Float C = Sqr(dst0[0]) + Sqr(dst1[0]) + 1;
+    Float invF = 1 / (A * C - Sqr(B) * 0.25f);
+    A *= invF;
+    B *= invF;
+    C *= invF;
+
+    Float det = -Sqr(B) + 4 * A * C;
+    Float invDet = 1 / det;
+    Float uSqrt = SafeSqrt(det * C), vSqrt = SafeSqrt(A * det);
+    int s0 = std::ceil(st[0] - 2 * invDet * uSqrt);
+    int s1 = std::floor(st[0] + 2 * invDet * uSqrt);
+    int t0 = std::ceil(st[1] - 2 * invDet * vSqrt);
+    int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
+
+    T sum{};
+    Float sumWts = 0;
+    for (int it = t0; it <= t1; ++it) {
+        Float tt = it - st[1];
+        for (int is = s0; is <= s1; ++is) {
+            Float ss = is - st[0];
+            Float r2 = A * Sqr(ss) + B * ss * tt + C * Sqr(tt);
+            if (r2 < 1) {
+                // Compute the weight that the 128-entry filter table stores
+                int index = std::min<int>(r2 * 128, 127);
+                Float weight = std::exp(-2 * Float(index) / 127) - std::exp(Float(-2));
+                sum += weight * ReferenceTexel<T>(mipmap.GetLevel(level), {is, it},
+                                                  wrapMode);
+                sumWts += weight;
+            }
+        }
+    }
+    return sum / sumWts;
+}
+
+// Chooses levels and filters them as _MIPMap::Filter()_ does with EWA.
+template <typename T>
+static T ReferenceFilter(const MIPMap &mipmap, WrapMode wrapMode, Point2f st,
+                         Vector2f dst0, Vector2f dst1) {
+    if (LengthSquared(dst0) < LengthSquared(dst1))
+        pstd::swap(dst0, dst1);
+    Float longerVecLength = Length(dst0), shorterVecLength = Length(dst1);
+    Float maxAnisotropy = MIPMapFilterOptions().maxAnisotropy;
+    if (shorterVecLength * maxAnisotropy < longerVecLength && shorterVecLength > 0) {
+        Float scale = longerVecLength / (shorterVecLength * maxAnisotropy);
+        dst1 *= scale;
+        shorterVecLength *= scale;
+    }
+    Float lod = std::max<Float>(0, mipmap.Levels() - 1 + Log2(shorterVecLength));
+    int ilod = std::floor(lod);
+    return Lerp(lod - ilod, ReferenceEWA<T>(mipmap, wrapMode, ilod, st, dst0, dst1),
+                ReferenceEWA<T>(mipmap, wrapMode, ilod + 1, st, dst0, dst1));
+}
+
+static void ExpectMatch(Float ref, Float v) {
+    // Lookups with infinite texels in their footprint should also give
+    // non-finite values
+    if (std::isfinite(ref))
+        EXPECT_NEAR(ref, v, 1e-5f + 1e-4f * std::abs(ref));
+    else
+        EXPECT_FALSE(std::isfinite(v)) << ref;
+}
+
+TEST(MIPMap, EWAMatchesTexels) {
+    // Filtering runs of texels should give the same results as filtering
+    // each texel individually for all formats and wrap modes.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black,
+                                  WrapMode::OctahedralSphere})
+            for (std::vector<std::string> channels :
+                 {std::vector<std::string>{"Y"}, std::vector<std::string>{"R", "G", "B"},
+                  std::vector<std::string>{"R", "G", "B", "A"}}) {
+                // Octahedral images must be square; make the others non-square.
+                // (Resampling images that aren't a power of two in size
+                // doesn't support the black wrap mode.)
+                bool octahedral = wrapMode == WrapMode::OctahedralSphere;
+                Point2i res = octahedral ? Point2i(64, 64) : Point2i(128, 32);
+                Image image(format, res, channels, ColorEncoding::sRGB);
+                RNG rng(int(format) * 7 + int(wrapMode));
+                for (int y = 0; y < res.y; ++y)
+                    for (int x = 0; x < res.x; ++x)
+                        for (int c = 0; c < image.NChannels(); ++c)
+                            image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+                MIPMapFilterOptions options;
+                options.filter = FilterFunction::EWA;
+                MIPMap mipmap(image, RGBColorSpace::sRGB, wrapMode, Allocator(),
+                              options);
+                for (int i = 0; i < 1000; ++i) {
+                    // The octahedral wrap mode only handles lookups within one
+                    // image width of the image, so keep its ellipses small.
+                    Float extent = octahedral ? .02f : .2f;
+                    Point2f st = octahedral ? Point2f(rng.Uniform<Float>(),
+                                                      rng.Uniform<Float>())
+                                            : Point2f(-1 + 3 * rng.Uniform<Float>(),
+                                                      -1 + 3 * rng.Uniform<Float>());
+                    Vector2f dst0(extent * rng.Uniform<Float>(),
+                                  .1f * extent * (rng.Uniform<Float>() - .5f));
+                    Vector2f dst1(.1f * extent * (rng.Uniform<Float>() - .5f),
+                                  extent * rng.Uniform<Float>());
+                    ExpectMatch(ReferenceFilter<Float>(mipmap, wrapMode, st, dst0, dst1),
+                                mipmap.Filter<Float>(st, dst0, dst1));
+                    RGB ref = ReferenceFilter<RGB>(mipmap, wrapMode, st, dst0, dst1);
+                    RGB rgb = mipmap.Filter<RGB>(st, dst0, dst1);
+                    for (int c = 0; c < 3; ++c)
+                        ExpectMatch(ref[c], rgb[c]);
+                }
+            }
+}
+
+TEST(MIPMap, EWAInfiniteTexels) {
+    // Infinite texels outside the filter ellipse must not affect the result.
+    for (PixelFormat format : {PixelFormat::Half, PixelFormat::Float}) {
+        Point2i res(128, 128);
+        Image image(format, res, {"R", "G", "B"});
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < 3; ++c)
+                    image.SetChannel({x, y}, c, .25f * (c + 1));
+        std::vector<Point2i> infTexels = {{20, 30}, {64, 64}, {100, 90}};
+        for (Point2i p : infTexels)
+            image.SetChannel(p, 0, Infinity);
+
+        MIPMapFilterOptions options;
+        options.filter = FilterFunction::EWA;
+        MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(), options);
+        RNG rng;
+        int nFinite = 0;
+        for (int i = 0; i < 3000; ++i) {
+            // Center thin ellipses near the infinite texels
+            Point2i p = infTexels[i % infTexels.size()];
+            Point2f st((p.x + .5f + 6 * (rng.Uniform<Float>() - .5f)) / res.x,
+                       (p.y + .5f + 6 * (rng.Uniform<Float>() - .5f)) / res.y);
+            Float angle = 2 * Pi * rng.Uniform<Float>();
+            Float length = 4.f / res.x * (1 + rng.Uniform<Float>());
+            Vector2f dst0(length * std::cos(angle), length * std::sin(angle));
+            Vector2f dst1 = Vector2f(-dst0.y, dst0.x) / 8;
+            Float ref = ReferenceFilter<Float>(mipmap, WrapMode::Clamp, st, dst0, dst1);
+            nFinite += std::isfinite(ref);
+            ExpectMatch(ref, mipmap.Filter<Float>(st, dst0, dst1));
+            RGB refRGB = ReferenceFilter<RGB>(mipmap, WrapMode::Clamp, st, dst0, dst1);
+            RGB rgb = mipmap.Filter<RGB>(st, dst0, dst1);
+            for (int c = 0; c < 3; ++c)
+                ExpectMatch(refRGB[c], rgb[c]);
+        }
+        // Make sure that many of the lookups didn't include the infinite texels.
+        EXPECT_GT(nFinite, 100);
+    }
+}
+
+TEST(MIPMap, EWAConstant) {
+    // EWA filtering a constant image should give the same constant, including
+    // for ellipses that extend past the edges of the image.
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp}) {
+            Image image(format, {100, 37}, {"R", "G", "B"}, ColorEncoding::Linear);
+            for (int y = 0; y < 37; ++y)
+                for (int x = 0; x < 100; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        image.SetChannel({x, y}, c, .2f * (c + 1));
+
+            MIPMapFilterOptions options;
+            options.filter = FilterFunction::EWA;
+            MIPMap mipmap(image, RGBColorSpace::sRGB, wrapMode, Allocator(), options);
+            RNG rng;
+            for (int i = 0; i < 1000; ++i) {
+                Point2f st(-1 + 3 * rng.Uniform<Float>(), -1 + 3 * rng.Uniform<Float>());
+                Float scale = std::pow(2.f, -8 * rng.Uniform<Float>());
+                Vector2f dst0(scale * rng.Uniform<Float>(),
+                              .1f * scale * rng.Uniform<Float>());
+                Vector2f dst1(.1f * scale * rng.Uniform<Float>(),
+                              scale * rng.Uniform<Float>());
+                RGB rgb = mipmap.Filter<RGB>(st, dst0, dst1);
+                EXPECT_NEAR(.2f, rgb.r, 1e-3f);
+                EXPECT_NEAR(.4f, rgb.g, 1e-3f);
+                EXPECT_NEAR(.6f, rgb.b, 1e-3f);
+                EXPECT_NEAR(.2f, mipmap.Filter<Float>(st, dst0, dst1), 1e-3f);
+            }
+        }
+}
@@ -0,0 +1,243 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/paging.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+
+#include <algorithm>
+#include <cstdlib>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // PBRT_HAVE_MMAP
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/Paged geometry", pagedBytes);
+STAT_COUNTER("Geometry/Paged regions paged in", nRegionsPagedIn);
+STAT_COUNTER("Geometry/Paged regions evicted", nRegionsEvicted);
+
+// PagedMemoryResource Method Definitions
+PagedMemoryResource::PagedMemoryResource(const std::string &directory, size_t budget)
+    : budget(budget) {
+#ifdef PBRT_HAVE_MMAP
+    pageSize = sysconf(_SC_PAGESIZE);
+    // Create the paging file and unlink it so that it is removed at exit
+    std::string filename = directory + "/pbrt-paging-XXXXXX";
+    std::vector<char> name(filename.begin(), filename.end());
+    name.push_back('\0');
+    fd = mkstemp(name.data());
+    if (fd == -1)
+        ErrorExit("%s: unable to create paging file: %s", filename, ErrorString());
+    unlink(name.data());
+
+    // Reserve address space for the file to be mapped into as it grows
+    reservedBytes = size_t(1) << 40;
+    void *ptr = mmap(nullptr, reservedBytes, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+        ErrorExit("Unable to reserve address space for paging: %s", ErrorString());
+    base = (char *)ptr;
+#else
+    ErrorExit("Paging is not supported on this system.");
+#endif  // PBRT_HAVE_MMAP
+}
+
+PagedMemoryResource::~PagedMemoryResource() {
+#ifdef PBRT_HAVE_MMAP
+    munmap(base, reservedBytes);
+    close(fd);
+#endif  // PBRT_HAVE_MMAP
+    for (std::atomic<Region *> &chunk : regionChunks)
+        delete[] chunk.load();
+}
+
+void *PagedMemoryResource::do_allocate(size_t size, size_t alignment) {
+#ifdef PBRT_HAVE_MMAP
+    std::lock_guard<std::mutex> lock(mutex);
+    alignment = std::max<size_t>(alignment, 64);
+    size_t offset = (allocatedBytes + alignment - 1) & ~(alignment - 1);
+    if (offset + size > fileBytes) {
+        // Grow the paging file and map the new part of it
+        constexpr size_t growBytes = 64 * 1024 * 1024;
+        size_t newFileBytes = (offset + size + growBytes - 1) / growBytes * growBytes;
+        if (newFileBytes > reservedBytes)
+            ErrorExit("Paged geometry exceeds %d bytes.", reservedBytes);
+        if (ftruncate(fd, newFileBytes) != 0)
+            ErrorExit("Unable to grow paging file: %s", ErrorString());
+        if (mmap(base + fileBytes, newFileBytes - fileBytes, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, fileBytes) == MAP_FAILED)
+            ErrorExit("Unable to map paging file: %s", ErrorString());
+        fileBytes = newFileBytes;
+    }
+    allocatedBytes = offset + size;
+    pagedBytes += size;
+    return base + offset;
+#else
+    LOG_FATAL("Paging is not supported on this system.");
+    return nullptr;
+#endif  // PBRT_HAVE_MMAP
+}
+
+void PagedMemoryResource::do_deallocate(void *p, size_t size, size_t alignment) {
+    // Space in the paging file isn't reused, but the pages that are entirely
+    // within the allocation are released.
+    pagedBytes -= size;
+#if defined(PBRT_HAVE_MMAP) && defined(MADV_REMOVE)
+    uintptr_t start = ((uintptr_t)p + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)p + size) & ~(pageSize - 1);
+    if (start < end && madvise((void *)start, end - start, MADV_REMOVE) != 0)
+        LOG_ERROR("madvise failed: %s", ErrorString());
+#endif
+}
+
+int PagedMemoryResource::AddRegion() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return addRegion();
+}
+
+void PagedMemoryResource::AddToRegion(int index, const void *ptr, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    addToRegion(index, ptr, size);
+}
+
+int PagedMemoryResource::AddRegions(const void *ptr, size_t size, size_t regionBytes) {
+    // Hold the mutex throughout so that the regions' indices are consecutive
+    std::lock_guard<std::mutex> lock(mutex);
+    int first = nRegions;
+    for (size_t offset = 0; offset < size; offset += regionBytes)
+        addToRegion(addRegion(), (const char *)ptr + offset,
+                    std::min(regionBytes, size - offset));
+    return first;
+}
+
+int PagedMemoryResource::addRegion() {
+    int index = nRegions;
+    int chunk = Log2Int(uint32_t(index / FirstChunkRegions + 1));
+    CHECK_LT(chunk, MaxRegionChunks);
+    if (!regionChunks[chunk].load(std::memory_order_relaxed))
+        regionChunks[chunk].store(new Region[FirstChunkRegions << chunk],
+                                  std::memory_order_release);
+    // New regions are resident since their contents have just been written.
+    getRegion(index).resident.store(true, std::memory_order_relaxed);
+    ++nRegions;
+    return index;
+}
+
+void PagedMemoryResource::addToRegion(int index, const void *ptr, size_t size) {
+    CHECK_LT(index, nRegions);
+    Region &region = getRegion(index);
+    region.ranges.push_back({(char *)ptr, size});
+    region.bytes += size;
+    if (region.resident.load(std::memory_order_relaxed)) {
+        residentBytes += size;
+        if (residentBytes > budget)
+            evict(index);
+    }
+}
+
+void PagedMemoryResource::ClearRegion(int index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Region &region = getRegion(index);
+    if (region.resident.load(std::memory_order_relaxed))
+        residentBytes -= region.bytes;
+    region.ranges.clear();
+    region.bytes = 0;
+}
+
+void PagedMemoryResource::pageIn(int index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Region &region = getRegion(index);
+    // Another thread may have paged in the region already
+    if (region.resident.load(std::memory_order_relaxed))
+        return;
+    // The region's pages are faulted in as they are accessed; here, it is
+    // only accounted for.
+    region.resident.store(true, std::memory_order_relaxed);
+    residentBytes += region.bytes;
+    ++nRegionsPagedIn;
+    if (residentBytes > budget)
+        evict(index);
+}
+
+void PagedMemoryResource::evict(int keepRegion) {
+    // Sweep the clock hand over the regions, evicting the resident ones that
+    // haven't been touched since it last passed them. Two sweeps suffice to
+    // clear all of the referenced flags.
+    for (int i = 0; i < 2 * nRegions && residentBytes > budget; ++i) {
+        clockHand = (clockHand + 1) % nRegions;
+        Region &region = getRegion(clockHand);
+        if (clockHand == keepRegion || !region.resident.load(std::memory_order_relaxed))
+            continue;
+        if (region.referenced.exchange(false, std::memory_order_relaxed))
+            continue;
+        evictRegion(region);
+    }
+}
+
+void PagedMemoryResource::evictRegion(Region &region) {
+    region.resident.store(false, std::memory_order_relaxed);
+    residentBytes -= region.bytes;
+    ++nRegionsEvicted;
+#ifdef PBRT_HAVE_MMAP
+    for (const std::pair<char *, size_t> &range : region.ranges) {
+        // Drop the pages overlapping the range from the address space. Pages
+        // in a shared file mapping remain in the page cache, so they are
+        // written back first and then dropped from it as well.
+        uintptr_t start = (uintptr_t)range.first & ~(pageSize - 1);
+        uintptr_t end = ((uintptr_t)range.first + range.second + pageSize - 1) &
+                        ~(pageSize - 1);
+        bool inFile = (char *)start >= base && (char *)end <= base + fileBytes;
+        if (inFile)
+            msync((void *)start, end - start, MS_ASYNC);
+        if (madvise((void *)start, end - start, MADV_DONTNEED) != 0)
+            LOG_ERROR("madvise failed: %s", ErrorString());
+#ifdef POSIX_FADV_DONTNEED
+        if (inFile)
+            posix_fadvise(fd, (char *)start - base, end - start, POSIX_FADV_DONTNEED);
+#endif  // POSIX_FADV_DONTNEED
+    }
+#endif  // PBRT_HAVE_MMAP
+}
+
+size_t PagedMemoryResource::ResidentBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return residentBytes;
+}
+
+std::string PagedMemoryResource::ToString() const {
+    return StringPrintf("[ PagedMemoryResource budget: %d residentBytes: %d "
+                        "nRegions: %d fileBytes: %d allocatedBytes: %d ]",
+                        budget, residentBytes, nRegions, fileBytes, allocatedBytes);
+}
+
+// Geometry Paging Function Definitions
+static PagedMemoryResource *geometryPager;
+
+void EnableGeometryPaging(std::string directory, size_t budget) {
+#ifdef PBRT_HAVE_MMAP
+    if (directory.empty()) {
+        const char *tmp = getenv("TMPDIR");
+        directory = tmp ? tmp : "/tmp";
+    }
+    // Leak this so that paged memory remains valid until exit
+    geometryPager = new PagedMemoryResource(directory, budget);
+    LOG_VERBOSE("Paging geometry to %s with a %d MB budget", directory,
+                budget / (1024 * 1024));
+#else
+    Warning("Geometry paging is not supported on this system.");
+#endif  // PBRT_HAVE_MMAP
+}
+
+PagedMemoryResource *GeometryPager() {
+    return geometryPager;
+}
+
+}  // namespace pbrt
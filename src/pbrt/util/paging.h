@@ -0,0 +1,122 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_PAGING_H
+#define PBRT_UTIL_PAGING_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/math.h>
+#include <pbrt/util/pstd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pbrt {
+
+// PagedMemoryResource Definition
+// Allocates memory from a temporary file that is mapped into the address
+// space, so that its contents can be dropped from memory and later read back
+// from disk. Allocated memory is added to regions, which are the unit of
+// paging: a region is paged in when it is touched and, when the total size of
+// the resident regions exceeds the budget, regions that haven't been touched
+// recently are evicted using the CLOCK algorithm. Evicted pages are faulted
+// back in from the file if they are accessed again, so it is safe to evict a
+// region while other threads are reading it.
+class PagedMemoryResource : public pstd::pmr::memory_resource {
+  public:
+    // PagedMemoryResource Public Methods
+    PagedMemoryResource(const std::string &directory, size_t budget);
+    ~PagedMemoryResource();
+
+    PagedMemoryResource(const PagedMemoryResource &) = delete;
+    PagedMemoryResource &operator=(const PagedMemoryResource &) = delete;
+
+    // Regions may contain ranges of memory that were not allocated by the
+    // _PagedMemoryResource_ as long as they are backed by a read-only file
+    // mapping; they are evicted but not otherwise managed.
+    int AddRegion();
+    void AddToRegion(int region, const void *ptr, size_t size);
+    // Splits the range into regions of at most _regionBytes_ and returns the
+    // index of the first one; the others follow it consecutively.
+    int AddRegions(const void *ptr, size_t size, size_t regionBytes);
+    // Removes all of the region's ranges, e.g. before they are freed.
+    void ClearRegion(int region);
+
+    void Touch(int region) {
+        Region &r = getRegion(region);
+        if (!r.resident.load(std::memory_order_relaxed))
+            pageIn(region);
+        // Only write the referenced flag if it is clear so that the cache
+        // lines of frequently-touched regions stay shared across threads.
+        if (!r.referenced.load(std::memory_order_relaxed))
+            r.referenced.store(true, std::memory_order_relaxed);
+    }
+
+    size_t Budget() const { return budget; }
+    size_t ResidentBytes();
+
+    std::string ToString() const;
+
+  protected:
+    void *do_allocate(size_t size, size_t alignment);
+    void do_deallocate(void *p, size_t size, size_t alignment);
+
+    bool do_is_equal(const memory_resource &other) const noexcept {
+        return this == &other;
+    }
+
+  private:
+    // PagedMemoryResource Private Members
+    struct Region {
+        std::atomic<bool> resident{false};
+        std::atomic<bool> referenced{false};
+        // The remaining members are protected by _mutex_.
+        size_t bytes = 0;
+        std::vector<std::pair<char *, size_t>> ranges;
+    };
+
+    // Regions are stored in chunks of increasing size that are never moved,
+    // so that regions can be added while others are being touched.
+    static constexpr int FirstChunkRegions = 1024, MaxRegionChunks = 24;
+    Region &getRegion(int index) const {
+        int chunk = Log2Int(uint32_t(index / FirstChunkRegions + 1));
+        int offset = index - FirstChunkRegions * ((1 << chunk) - 1);
+        return regionChunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    int addRegion();
+    void addToRegion(int region, const void *ptr, size_t size);
+    void pageIn(int region);
+    void evict(int keepRegion);
+    void evictRegion(Region &region);
+
+    size_t budget, pageSize;
+    std::atomic<Region *> regionChunks[MaxRegionChunks] = {};
+
+    std::mutex mutex;
+    int nRegions = 0, clockHand = 0;
+    size_t residentBytes = 0;
+    int fd = -1;
+    char *base = nullptr;
+    size_t reservedBytes = 0, fileBytes = 0, allocatedBytes = 0;
+};
+
+// Geometry Paging Function Declarations
+// Only triangle mesh attributes, BVH nodes, and the BVH's copies of triangle
+// vertices are paged. Other per-triangle data stays in memory and isn't
+// counted against the budget: the _Triangle_ (8 bytes) and its primitive
+// (16 bytes for a _SimplePrimitive_) as well as the BVH's _Primitive_ (8
+// bytes). Nor is the temporary memory used while building the BVH.
+void EnableGeometryPaging(std::string directory, size_t budget);
+// Returns nullptr if geometry paging hasn't been enabled.
+PagedMemoryResource *GeometryPager();
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_PAGING_H
@@ -0,0 +1,96 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/paging.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+#ifdef PBRT_HAVE_MMAP
+static std::string PagingDirectory() {
+    const char *tmp = getenv("TMPDIR");
+    return tmp ? tmp : "/tmp";
+}
+
+TEST(PagedMemoryResource, Budget) {
+    constexpr size_t regionBytes = 256 * 1024;
+    PagedMemoryResource pager(PagingDirectory(), 4 * regionBytes);
+    Allocator alloc(&pager);
+
+    // Fill regions with more data than fits in the budget
+    constexpr int nRegions = 32;
+    std::vector<int> regions;
+    std::vector<uint32_t *> data;
+    for (int r = 0; r < nRegions; ++r) {
+        regions.push_back(pager.AddRegion());
+        uint32_t *ptr = alloc.allocate_object<uint32_t>(regionBytes / sizeof(uint32_t));
+        for (size_t i = 0; i < regionBytes / sizeof(uint32_t); ++i)
+            ptr[i] = r * 1000003 + i;
+        pager.AddToRegion(regions.back(), ptr, regionBytes);
+        data.push_back(ptr);
+        EXPECT_LE(pager.ResidentBytes(), pager.Budget());
+    }
+
+    // Touch regions from multiple threads and make sure that their contents
+    // are intact after they have been evicted and paged back in.
+    std::atomic<int> nMismatches{0};
+    ParallelFor(0, 10000, [&](int64_t i) {
+        RNG rng(i);
+        int r = rng.Uniform<int>(nRegions);
+        pager.Touch(regions[r]);
+        size_t offset = rng.Uniform<uint32_t>(regionBytes / sizeof(uint32_t));
+        if (data[r][offset] != r * 1000003 + offset)
+            ++nMismatches;
+    });
+    EXPECT_EQ(0, nMismatches.load());
+    EXPECT_LE(pager.ResidentBytes(), pager.Budget());
+
+    // Regions that are touched frequently should stay resident
+    for (int i = 0; i < 100; ++i) {
+        pager.Touch(regions[0]);
+        pager.Touch(regions[i % nRegions]);
+    }
+    size_t resident = pager.ResidentBytes();
+    pager.Touch(regions[0]);
+    EXPECT_EQ(resident, pager.ResidentBytes());
+
+    // Cleared regions don't count toward the budget
+    for (int r : regions)
+        pager.ClearRegion(r);
+    EXPECT_EQ(0, pager.ResidentBytes());
+}
+
+TEST(PagedMemoryResource, LargeAllocation) {
+    // Split an allocation that is larger than the budget into regions
+    constexpr size_t regionBytes = 64 * 1024, count = 1024 * 1024;
+    PagedMemoryResource pager(PagingDirectory(), 8 * regionBytes);
+    uint32_t *data = Allocator(&pager).allocate_object<uint32_t>(count);
+    for (size_t i = 0; i < count; ++i)
+        data[i] = i * 7919;
+    int firstRegion = pager.AddRegions(data, count * sizeof(uint32_t), regionBytes);
+    EXPECT_LE(pager.ResidentBytes(), pager.Budget());
+
+    // Touch the region holding each element before reading it
+    int nMismatches = 0;
+    RNG rng;
+    for (int i = 0; i < 10000; ++i) {
+        size_t index = rng.Uniform<uint32_t>(count);
+        pager.Touch(firstRegion + index * sizeof(uint32_t) / regionBytes);
+        if (data[index] != uint32_t(index * 7919))
+            ++nMismatches;
+    }
+    EXPECT_EQ(0, nMismatches);
+    EXPECT_LE(pager.ResidentBytes(), pager.Budget());
+    EXPECT_GT(pager.ResidentBytes(), 0);
+}
+#endif  // PBRT_HAVE_MMAP
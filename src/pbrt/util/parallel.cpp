@@ -5,17 +5,31 @@
 #include <pbrt/util/parallel.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/string.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/util.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
 
 #include <algorithm>
+#include <deque>
 #include <iterator>
 #include <list>
+#include <numeric>
 #include <thread>
 #include <vector>
 
+#ifdef PBRT_IS_LINUX
+#include <sched.h>
+#endif
+#ifdef PBRT_HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace pbrt {
 
 std::string AtomicFloat::ToString() const {
@@ -26,6 +40,10 @@ std::string AtomicDouble::ToString() const {
     return StringPrintf("%f", double(*this));
 }
 
+std::string OrderIndependentSum::ToString() const {
+    return StringPrintf("%f", double(*this));
+}
+
 // Barrier Method Definitions
 bool Barrier::Block() {
     std::unique_lock<std::mutex> lock(mutex);
@@ -43,98 +61,263 @@ bool Barrier::Block() {
 
 ThreadPool *ParallelJob::threadPool;
 
+// ThreadPool::TaskQueue Definition
+// The queue's mutex is only contended when another thread steals from it;
+// _size_ lets thieves skip empty queues without taking their locks.
+struct alignas(64) ThreadPool::TaskQueue {
+    std::mutex mutex;
+    std::deque<ParallelTask> tasks;
+    std::atomic<int> size{0};
+};
+
+// Index of the calling thread's queue in the pool that created it; threads
+// that are not part of the pool share the last queue.
+static thread_local const ThreadPool *queueOwner = nullptr;
+static thread_local int queueIndex;
+static thread_local uint64_t stealSeed;
+static thread_local int numaNode = 0;
+
+#ifdef PBRT_IS_LINUX
+// Returns the CPUs in a Linux CPU list like "0-3,8-11".
+static std::vector<int> ParseCPUList(const std::string &str) {
+    std::vector<int> cpus;
+    for (const std::string &list : SplitStringsFromWhitespace(str))
+        for (const std::string &range : SplitString(list, ',')) {
+            std::vector<int> ends = SplitStringToInts(range, '-');
+            if (ends.size() == 1)
+                cpus.push_back(ends[0]);
+            else if (ends.size() == 2)
+                for (int cpu = ends[0]; cpu <= ends[1]; ++cpu)
+                    cpus.push_back(cpu);
+        }
+    return cpus;
+}
+
+// Returns the CPUs that the process may run on, grouped by NUMA node.
+static std::vector<std::vector<int>> NUMANodeCPUs() {
+    cpu_set_t affinity;
+    if (sched_getaffinity(0, sizeof(affinity), &affinity) != 0) {
+        Warning("sched_getaffinity: %s", ErrorString());
+        return {};
+    }
+    std::string nodeDirectory = "/sys/devices/system/node/";
+    if (!FileExists(nodeDirectory + "online"))
+        return {};
+
+    std::vector<std::vector<int>> nodeCPUs;
+    for (int node : ParseCPUList(ReadFileContents(nodeDirectory + "online"))) {
+        std::string cpuList = nodeDirectory + StringPrintf("node%d/cpulist", node);
+        if (!FileExists(cpuList))
+            continue;
+        std::vector<int> cpus;
+        for (int cpu : ParseCPUList(ReadFileContents(cpuList)))
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &affinity))
+                cpus.push_back(cpu);
+        // Skip nodes with memory but no usable CPUs
+        if (!cpus.empty())
+            nodeCPUs.push_back(std::move(cpus));
+    }
+    return nodeCPUs;
+}
+
+static void PinCurrentThread(int cpu) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+        Warning("Unable to pin thread to CPU %d: %s", cpu, ErrorString());
+}
+#endif  // PBRT_IS_LINUX
+
 // ThreadPool Method Definitions
-ThreadPool::ThreadPool(int nThreads) {
+ThreadPool::ThreadPool(int nThreads, bool numa) {
+    for (int i = 0; i < nThreads + 1; ++i)
+        queues.push_back(std::make_unique<TaskQueue>());
+    queueNUMANodes.assign(nThreads + 1, 0);
+    if (numa) {
+#ifdef PBRT_IS_LINUX
+        // Assign threads to CPUs in turn from each NUMA node so that
+        // smaller thread counts are still spread across all nodes
+        std::vector<std::vector<int>> nodeCPUs = NUMANodeCPUs();
+        if (nodeCPUs.empty())
+            Warning("Unable to determine NUMA topology; not pinning threads.");
+        else {
+            nNUMANodes = std::min<int>(nodeCPUs.size(), nThreads);
+            queueCPUs.resize(nThreads);
+            for (int i = 0; i < nThreads; ++i) {
+                int node = i % nNUMANodes;
+                const std::vector<int> &cpus = nodeCPUs[node];
+                queueCPUs[i] = cpus[(i / nNUMANodes) % cpus.size()];
+                queueNUMANodes[i] = node;
+            }
+            LOG_VERBOSE("Running %d threads on %d NUMA nodes", nThreads, nNUMANodes);
+        }
+#else
+        Warning("NUMA mode is only supported on Linux.");
+#endif  // PBRT_IS_LINUX
+    }
+
+    // The thread that creates the pool uses the first queue
+    queueOwner = this;
+    queueIndex = 0;
+#ifdef PBRT_IS_LINUX
+    if (!queueCPUs.empty())
+        PinCurrentThread(queueCPUs[0]);
+#endif  // PBRT_IS_LINUX
+    numaNode = queueNUMANodes[0];
     for (int i = 0; i < nThreads - 1; ++i)
-        threads.push_back(std::thread(&ThreadPool::Worker, this));
+        threads.push_back(std::thread(&ThreadPool::Worker, this, i + 1));
 }
 
-void ThreadPool::Worker() {
+void ThreadPool::Worker(int index) {
     LOG_VERBOSE("Started execution in worker thread");
 
 #ifdef PBRT_BUILD_GPU_RENDERER
     GPUThreadInit();
 #endif  // PBRT_BUILD_GPU_RENDERER
 
-    std::unique_lock<std::mutex> lock(mutex);
-    while (!shutdownThreads)
-        WorkOrWait(&lock, false);
+    queueOwner = this;
+    queueIndex = index;
+    stealSeed = index;
+#ifdef PBRT_IS_LINUX
+    if (!queueCPUs.empty())
+        PinCurrentThread(queueCPUs[index]);
+#endif  // PBRT_IS_LINUX
+    numaNode = queueNUMANodes[index];
+    while (!shutdownThreads) {
+        // Run a task if the thread pool is enabled and one is available
+        ParallelTask task;
+        if (!disabled && GetTask(index, &task))
+            RunTask(task);
+        else
+            SleepUntil([this]() {
+                return shutdownThreads || (!disabled && nQueuedTasks > 0);
+            });
+    }
 
     LOG_VERBOSE("Exiting worker thread");
 }
 
-std::unique_lock<std::mutex> ThreadPool::AddToJobList(ParallelJob *job) {
-    std::unique_lock<std::mutex> lock(mutex);
-    // Add _job_ to head of _jobList_
-    if (jobList)
-        jobList->prev = job;
-    job->next = jobList;
-    jobList = job;
+int ThreadPool::CurrentQueueIndex() const {
+    // Also check _queueIndex_, in case this pool reuses a deleted pool's address
+    int sharedIndex = queues.size() - 1;
+    return (queueOwner == this && queueIndex < sharedIndex) ? queueIndex : sharedIndex;
+}
 
-    jobListCondition.notify_all();
-    return lock;
+template <typename F>
+void ThreadPool::SleepUntil(F pred) {
+    // Threads that add work or finish a job only take _sleepMutex_ to notify
+    // sleeping threads, which they detect using _nSleeping_.
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    ++nSleeping;
+    sleepCondition.wait(lock, pred);
+    --nSleeping;
 }
 
-void ThreadPool::WorkOrWait(std::unique_lock<std::mutex> *lock, bool isEnqueuingThread) {
-    DCHECK(lock->owns_lock());
-    // Return if this is a worker thread and the thread pool is disabled
-    if (!isEnqueuingThread && disabled) {
-        jobListCondition.wait(*lock);
-        return;
+void ThreadPool::Push(ParallelTask task) {
+    TaskQueue &queue = *queues[CurrentQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+        ++queue.size;
+    }
+    ++nQueuedTasks;
+    // Wake a sleeping thread to run the task; when the pool is disabled, only
+    // threads waiting for jobs may run it
+    if (nSleeping > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        if (disabled)
+            sleepCondition.notify_all();
+        else
+            sleepCondition.notify_one();
     }
+}
 
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (job) {
-        // Execute work for _job_
-        job->activeWorkers++;
-        job->RunStep(lock);
-        // Handle post-job-execution details
-        DCHECK(!lock->owns_lock());
-        lock->lock();
-        job->activeWorkers--;
-        if (job->Finished())
-            jobListCondition.notify_all();
+bool ThreadPool::GetTask(int index, ParallelTask *task) {
+    if (nQueuedTasks == 0)
+        return false;
+    // Take most recently pushed task from this thread's queue
+    int sharedIndex = queues.size() - 1;
+    if (index != sharedIndex && queues[index]->size > 0) {
+        TaskQueue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            *task = queue.tasks.back();
+            queue.tasks.pop_back();
+            --queue.size;
+            --nQueuedTasks;
+            return true;
+        }
+    }
 
-    } else
-        // Wait for new work to arrive or the job to finish
-        jobListCondition.wait(*lock);
+    // Steal oldest task from another queue, starting with a random one
+    // In NUMA mode, queues of threads on the same node are tried first, since
+    // their tasks' data is more likely to be in nearby memory and caches.
+    stealSeed = stealSeed * 6364136223846793005ull + 1442695040888963407ull;
+    int nQueues = queues.size();
+    int start = (stealSeed >> 33) % nQueues;
+    for (int pass = (nNUMANodes > 1) ? 0 : 1; pass < 2; ++pass)
+        for (int i = 0; i < nQueues; ++i) {
+            int victim = (start + i) % nQueues;
+            if ((victim == index && index != sharedIndex) || queues[victim]->size == 0)
+                continue;
+            if (pass == 0 && queueNUMANodes[victim] != queueNUMANodes[index])
+                continue;
+            TaskQueue &queue = *queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                *task = queue.tasks.front();
+                queue.tasks.pop_front();
+                --queue.size;
+                --nQueuedTasks;
+                return true;
+            }
+        }
+    return false;
 }
 
-void ThreadPool::RemoveFromJobList(ParallelJob *job) {
-    DCHECK(!job->removed);
+void ThreadPool::RunTask(ParallelTask task) {
+    ParallelJob *job = task.job;
+    // Split off upper halves of _task_ for other threads until it fits in a chunk
+    while (task.end - task.start > job->chunkSize) {
+        int64_t mid = task.start + (task.end - task.start) / 2;
+        Push(ParallelTask{job, mid, task.end});
+        task.end = mid;
+    }
+
+    job->RunStep(task.start, task.end);
 
-    if (job->prev)
-        job->prev->next = job->next;
-    else {
-        DCHECK(jobList == job);
-        jobList = job->next;
+    // Notify threads waiting for _job_ if this task finished it
+    // _job_ may be destroyed as soon as _nRemaining_ reaches zero, so it is
+    // not accessed afterward.
+    if ((job->nRemaining -= task.end - task.start) == 0 && nSleeping > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_all();
     }
-    if (job->next)
-        job->next->prev = job->prev;
+}
 
-    job->removed = true;
+void ThreadPool::Enqueue(ParallelJob *job, int64_t start, int64_t end) {
+    Push(ParallelTask{job, start, end});
 }
 
-bool ThreadPool::WorkOrReturn() {
-    std::unique_lock<std::mutex> lock(mutex);
+void ThreadPool::RunJob(ParallelJob *job, int64_t start, int64_t end) {
+    // Start running _job_ in the current thread and help until it is finished
+    RunTask(ParallelTask{job, start, end});
+    int index = CurrentQueueIndex();
+    while (!job->Finished()) {
+        ParallelTask task;
+        if (GetTask(index, &task))
+            RunTask(task);
+        else
+            SleepUntil([&]() { return job->Finished() || nQueuedTasks > 0; });
+    }
+}
 
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (!job)
+bool ThreadPool::WorkOrReturn() {
+    ParallelTask task;
+    if (!GetTask(CurrentQueueIndex(), &task))
         return false;
-
-    // Execute work for _job_
-    job->activeWorkers++;
-    job->RunStep(&lock);
-    DCHECK(!lock.owns_lock());
-    lock.lock();
-    job->activeWorkers--;
-    if (job->Finished())
-        jobListCondition.notify_all();
-
+    RunTask(task);
     return true;
 }
 
@@ -151,12 +334,15 @@ void ThreadPool::ForEachThread(std::function<void(void)> func) {
 void ThreadPool::Disable() {
     CHECK(!disabled);
     disabled = true;
-    CHECK(jobList == nullptr);  // Nothing should be running when Disable() is called.
+    // Nothing should be running when Disable() is called.
+    CHECK_EQ(nQueuedTasks.load(), 0);
 }
 
 void ThreadPool::Reenable() {
     CHECK(disabled);
+    std::lock_guard<std::mutex> lock(sleepMutex);
     disabled = false;
+    sleepCondition.notify_all();
 }
 
 ThreadPool::~ThreadPool() {
@@ -164,9 +350,9 @@ ThreadPool::~ThreadPool() {
         return;
 
     {
-        std::lock_guard<std::mutex> lock(mutex);
+        std::lock_guard<std::mutex> lock(sleepMutex);
         shutdownThreads = true;
-        jobListCondition.notify_all();
+        sleepCondition.notify_all();
     }
 
     for (std::thread &thread : threads)
@@ -174,25 +360,20 @@ ThreadPool::~ThreadPool() {
 }
 
 std::string ThreadPool::ToString() const {
-    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s ",
-                                 threads.size(), shutdownThreads);
-    if (mutex.try_lock()) {
-        s += "jobList: [ ";
-        ParallelJob *job = jobList;
-        while (job) {
-            s += job->ToString() + " ";
-            job = job->next;
-        }
-        s += "] ";
-        mutex.unlock();
-    } else
-        s += "(job list mutex locked) ";
-    return s + "]";
+    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s "
+                                 "disabled: %s nQueuedTasks: %d nSleeping: %d "
+                                 "nNUMANodes: %d queueCPUs: %s ",
+                                 threads.size(), shutdownThreads.load(), disabled.load(),
+                                 nQueuedTasks.load(), nSleeping.load(), nNUMANodes,
+                                 queueCPUs);
+    s += "queue sizes: [ ";
+    for (const std::unique_ptr<TaskQueue> &queue : queues)
+        s += StringPrintf("%d ", queue->size.load());
+    return s + "] ]";
 }
 
 bool DoParallelWork() {
     CHECK(ParallelJob::threadPool);
-    // lock should be held when this is called...
     return ParallelJob::threadPool->WorkOrReturn();
 }
 
@@ -202,89 +383,79 @@ class ParallelForLoop1D : public ParallelJob {
     // ParallelForLoop1D Public Methods
     ParallelForLoop1D(int64_t startIndex, int64_t endIndex, int chunkSize,
                       std::function<void(int64_t, int64_t)> func)
-        : func(std::move(func)),
-          nextIndex(startIndex),
-          endIndex(endIndex),
-          chunkSize(chunkSize) {}
-
-    bool HaveWork() const { return nextIndex < endIndex; }
+        : ParallelJob(endIndex - startIndex, chunkSize), func(std::move(func)) {}
 
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunStep(int64_t start, int64_t end) { func(start, end); }
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop1D nextIndex: %d endIndex: %d "
-                            "chunkSize: %d ]",
-                            nextIndex, endIndex, chunkSize);
+        return StringPrintf("[ ParallelForLoop1D %s ]", BaseToString());
     }
 
   private:
     // ParallelForLoop1D Private Members
     std::function<void(int64_t, int64_t)> func;
-    int64_t nextIndex, endIndex;
-    int chunkSize;
 };
 
 class ParallelForLoop2D : public ParallelJob {
   public:
-    ParallelForLoop2D(const Bounds2i &extent, int chunkSize,
-                      std::function<void(Bounds2i)> func)
-        : func(std::move(func)),
-          extent(extent),
-          nextStart(extent.pMin),
-          chunkSize(chunkSize) {}
+    ParallelForLoop2D(std::vector<Bounds2i> tiles, std::function<void(Bounds2i)> func,
+                      std::vector<double> *tileSeconds)
+        : ParallelJob(tiles.size(), 1),
+          func(std::move(func)),
+          tiles(std::move(tiles)),
+          tileSeconds(tileSeconds) {}
 
-    bool HaveWork() const { return nextStart.y < extent.pMax.y; }
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunStep(int64_t start, int64_t end);
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop2D extent: %s nextStart: %s "
-                            "chunkSize: %d ]",
-                            extent, nextStart, chunkSize);
+        return StringPrintf("[ ParallelForLoop2D tiles.size(): %d %s ]", tiles.size(),
+                            BaseToString());
     }
 
   private:
     std::function<void(Bounds2i)> func;
-    const Bounds2i extent;
-    Point2i nextStart;
-    int chunkSize;
+    std::vector<Bounds2i> tiles;
+    std::vector<double> *tileSeconds;
 };
 
-// ParallelForLoop1D Method Definitions
-void ParallelForLoop1D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Determine the range of loop iterations to run in this step
-    int64_t indexStart = nextIndex;
-    int64_t indexEnd = std::min(indexStart + chunkSize, endIndex);
-    nextIndex = indexEnd;
-
-    // Remove job from list if all work has been started
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
-
-    // Release lock and execute loop iterations in _[indexStart, indexEnd)_
-    lock->unlock();
-    func(indexStart, indexEnd);
-}
-
-void ParallelForLoop2D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Compute extent for this step
-    Point2i end = nextStart + Vector2i(chunkSize, chunkSize);
-    Bounds2i b = Intersect(Bounds2i(nextStart, end), extent);
-    CHECK(!b.IsEmpty());
-
-    // Advance to be ready for the next extent.
-    nextStart.x += chunkSize;
-    if (nextStart.x >= extent.pMax.x) {
-        nextStart.x = extent.pMin.x;
-        nextStart.y += chunkSize;
+// ParallelForLoop2D Method Definitions
+void ParallelForLoop2D::RunStep(int64_t start, int64_t end) {
+    for (int64_t tile = start; tile < end; ++tile) {
+        if (!tileSeconds) {
+            func(tiles[tile]);
+            continue;
+        }
+        // Run the loop iteration and record how long it took
+        auto startTime = std::chrono::steady_clock::now();
+        func(tiles[tile]);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - startTime;
+        (*tileSeconds)[tile] = elapsed.count();
     }
+}
 
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
-
-    lock->unlock();
+// Returns the distance along a Hilbert curve that covers an _n_ by _n_ grid,
+// where _n_ is a power of two, to the cell (_x_, _y_).
+static uint64_t HilbertIndex(int n, int x, int y) {
+    uint64_t d = 0;
+    for (int s = n / 2; s > 0; s /= 2) {
+        int rx = (x & s) > 0, ry = (y & s) > 0;
+        d += uint64_t(s) * uint64_t(s) * ((3 * rx) ^ ry);
+        // Rotate quadrant so that the curve is continuous
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
 
-    // Run the loop iteration
-    func(b);
+std::string TileCosts::ToString() const {
+    return StringPrintf("[ TileCosts extent: %s tileSize: %d seconds: %s ]", extent,
+                        tileSize, seconds);
 }
 
 // Parallel Function Definitions
@@ -295,16 +466,17 @@ void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t
     // Compute chunk size for parallel loop
     int64_t chunkSize = std::max<int64_t>(1, (end - start) / (8 * RunningThreads()));
 
-    // Create and enqueue _ParallelForLoop1D_ for this loop
+    // Run _ParallelForLoop1D_ for this loop, helping in the current thread
     ParallelForLoop1D loop(start, end, chunkSize, std::move(func));
-    std::unique_lock<std::mutex> lock = ParallelJob::threadPool->AddToJobList(&loop);
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        ParallelJob::threadPool->WorkOrWait(&lock, true);
+    ParallelJob::threadPool->RunJob(&loop, start, end);
 }
 
 void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
+    ParallelFor2D(extent, nullptr, std::move(func));
+}
+
+void ParallelFor2D(const Bounds2i &extent, TileCosts *costs,
+                   std::function<void(Bounds2i)> func) {
     CHECK(ParallelJob::threadPool);
 
     if (extent.IsEmpty())
@@ -320,13 +492,69 @@ void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
     int tileSize = Clamp(int(std::sqrt(extent.Diagonal().x * extent.Diagonal().y /
                                        (8 * RunningThreads()))),
                          1, 32);
+    Vector2i d = extent.Diagonal();
+    int nTilesX = (d.x + tileSize - 1) / tileSize;
+    int nTiles = nTilesX * ((d.y + tileSize - 1) / tileSize);
+    // Discard _costs_ if they were measured for different tiles
+    if (costs && (costs->extent != extent || costs->tileSize != tileSize ||
+                  int(costs->seconds.size()) != nTiles)) {
+        costs->extent = extent;
+        costs->tileSize = tileSize;
+        costs->seconds.clear();
+    }
 
-    ParallelForLoop2D loop(extent, tileSize, std::move(func));
-    std::unique_lock<std::mutex> lock = ParallelJob::threadPool->AddToJobList(&loop);
+    // Order tiles along a Hilbert curve so that consecutive tiles are nearby
+    // Runs of consecutive tiles are what threads take from each other's
+    // queues, so this also gives each thread a compact region of the image.
+    std::vector<std::pair<uint64_t, int>> tileOrder(nTiles);
+    int n = RoundUpPow2(std::max(nTilesX, nTiles / nTilesX));
+    for (int tile = 0; tile < nTiles; ++tile)
+        tileOrder[tile] = {HilbertIndex(n, tile % nTilesX, tile / nTilesX), tile};
+    std::sort(tileOrder.begin(), tileOrder.end());
+
+    // Split tiles that took much longer than average in the previous loop
+    // Otherwise, a few expensive tiles started near the end of the loop can
+    // leave most threads idle while they finish.
+    double meanSeconds = 0;
+    if (costs && !costs->seconds.empty())
+        meanSeconds =
+            std::accumulate(costs->seconds.begin(), costs->seconds.end(), 0.) / nTiles;
+    std::vector<Bounds2i> tiles;
+    std::vector<int> baseTiles;
+    tiles.reserve(nTiles);
+    for (const std::pair<uint64_t, int> &order : tileOrder) {
+        int tile = order.second;
+        Point2i pMin = extent.pMin + tileSize * Vector2i(tile % nTilesX, tile / nTilesX);
+        Bounds2i b =
+            Intersect(Bounds2i(pMin, pMin + Vector2i(tileSize, tileSize)), extent);
+        CHECK(!b.IsEmpty());
+        // Split tile into enough subtiles to bring their costs near the mean
+        int subtileSize = tileSize;
+        if (meanSeconds > 0 && costs->seconds[tile] > 2 * meanSeconds) {
+            // Each level of splitting quarters the cost of the subtiles
+            double ratio = costs->seconds[tile] / meanSeconds;
+            int levels = std::min(3, int(std::ceil(std::log2(ratio) / 2)));
+            subtileSize = std::max(1, (tileSize + (1 << levels) - 1) >> levels);
+        }
+        for (int y = b.pMin.y; y < b.pMax.y; y += subtileSize)
+            for (int x = b.pMin.x; x < b.pMax.x; x += subtileSize) {
+                Point2i p(x, y);
+                tiles.push_back(
+                    Intersect(Bounds2i(p, p + Vector2i(subtileSize, subtileSize)), b));
+                baseTiles.push_back(tile);
+            }
+    }
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        ParallelJob::threadPool->WorkOrWait(&lock, true);
+    // Run loop over tiles, recording their costs if requested
+    std::vector<double> tileSeconds(costs ? tiles.size() : 0);
+    ParallelForLoop2D loop(std::move(tiles), std::move(func),
+                           costs ? &tileSeconds : nullptr);
+    ParallelJob::threadPool->RunJob(&loop, 0, baseTiles.size());
+    if (costs) {
+        costs->seconds.assign(nTiles, 0.);
+        for (size_t i = 0; i < tileSeconds.size(); ++i)
+            costs->seconds[baseTiles[i]] += tileSeconds[i];
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -339,11 +567,19 @@ int RunningThreads() {
     return ParallelJob::threadPool ? (1 + ParallelJob::threadPool->size()) : 1;
 }
 
-void ParallelInit(int nThreads) {
+int NUMANodeCount() {
+    return ParallelJob::threadPool ? ParallelJob::threadPool->NUMANodeCount() : 1;
+}
+
+int CurrentNUMANode() {
+    return numaNode;
+}
+
+void ParallelInit(int nThreads, bool numa) {
     CHECK(!ParallelJob::threadPool);
     if (nThreads <= 0)
         nThreads = AvailableCores();
-    ParallelJob::threadPool = new ThreadPool(nThreads);
+    ParallelJob::threadPool = new ThreadPool(nThreads, numa);
 }
 
 void ParallelCleanup() {
@@ -356,6 +592,72 @@ void ForEachThread(std::function<void(void)> func) {
         ParallelJob::threadPool->ForEachThread(std::move(func));
 }
 
+void ForEachNUMANode(std::function<void(int)> func) {
+    if (NUMANodeCount() == 1) {
+        func(0);
+        return;
+    }
+    // Run _func_ in the first thread to reach it on each node
+    std::mutex mutex;
+    std::vector<bool> started(NUMANodeCount(), false);
+    ForEachThread([&]() {
+        int node = CurrentNUMANode();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (started[node])
+                return;
+            started[node] = true;
+        }
+        func(node);
+    });
+}
+
+// FirstTouchMemoryResource Definition
+// Allocations get fresh pages from the OS that are first written by the
+// thread pool's threads in parallel, so that they are placed on all of the
+// NUMA nodes rather than the allocating thread's node.
+class FirstTouchMemoryResource : public pstd::pmr::memory_resource {
+  public:
+    void *do_allocate(size_t size, size_t alignment) {
+#ifdef PBRT_HAVE_MMAP
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        if (alignment <= pageSize) {
+            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                LOG_FATAL("mmap of %d bytes failed: %s", size, ErrorString());
+            if (NUMANodeCount() > 1) {
+                int64_t nPages = (size + pageSize - 1) / pageSize;
+                ParallelFor(0, nPages, [&](int64_t start, int64_t end) {
+                    for (int64_t page = start; page < end; ++page)
+                        ((volatile char *)ptr)[page * pageSize] = 0;
+                });
+            }
+            return ptr;
+        }
+#endif  // PBRT_HAVE_MMAP
+        return pstd::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+    void do_deallocate(void *ptr, size_t bytes, size_t alignment) {
+#ifdef PBRT_HAVE_MMAP
+        if (alignment <= size_t(sysconf(_SC_PAGESIZE))) {
+            if (munmap(ptr, bytes) != 0)
+                LOG_ERROR("munmap failed: %s", ErrorString());
+            return;
+        }
+#endif  // PBRT_HAVE_MMAP
+        pstd::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept {
+        return this == &other;
+    }
+};
+
+pstd::pmr::memory_resource *ParallelFirstTouchMemoryResource() {
+    static FirstTouchMemoryResource resource;
+    return &resource;
+}
+
 void DisableThreadPool() {
     CHECK(ParallelJob::threadPool);
     ParallelJob::threadPool->Disable();
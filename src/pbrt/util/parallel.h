@@ -7,7 +7,9 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/util/check.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/pstd.h>
 #include <pbrt/util/vecmath.h>
 
 #include <atomic>
@@ -17,6 +19,7 @@
 #include <functional>
 #include <future>
 #include <initializer_list>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
@@ -27,12 +30,17 @@
 namespace pbrt {
 
 // Parallel Function Declarations
-void ParallelInit(int nThreads = -1);
+void ParallelInit(int nThreads = -1, bool numa = false);
 void ParallelCleanup();
 
 int AvailableCores();
 int RunningThreads();
 
+// In NUMA mode, threads are pinned to CPUs that alternate between NUMA nodes;
+// otherwise all threads are considered to be on node 0.
+int NUMANodeCount();
+int CurrentNUMANode();
+
 // ThreadLocal Definition
 template <typename T>
 class ThreadLocal {
@@ -242,6 +250,140 @@ class AtomicDouble {
 #endif
 };
 
+// OrderIndependentSum Definition
+// Computes sums that do not depend on the order in which values are added, so
+// that concurrent sums are the same regardless of thread scheduling. Each
+// value is converted to an integer multiple of 2^-96 and added to 32-bit
+// fixed-point digits that are stored in 64-bit integers; integer addition is
+// associative, and each digit has room for at least 2^30 additions before
+// it overflows. Any value with magnitude in [2^-96, 2^96) is thus summed
+// exactly; smaller values are rounded to the nearest multiple of 2^-96 and
+// larger ones are treated as infinite.
+class OrderIndependentSum {
+  public:
+    // OrderIndependentSum Public Methods
+    PBRT_CPU_GPU
+    OrderIndependentSum() { Reset(); }
+
+    PBRT_CPU_GPU
+    void Add(double v) {
+        if (v == 0)
+            return;
+        double av = std::abs(v);
+        if (IsNaN(v) || av >= 0x1p96) {
+            // Record NaN or infinite value in _special_
+            AddSpecial(IsNaN(v) ? NaNFlag : (v > 0 ? PosInfFlag : NegInfFlag));
+            return;
+        }
+        // Compute integer _m_ and _shift_ so that $|v| \approx m 2^{shift-96}$
+        int exponent = Exponent(av);
+        if (exponent < MinExponent - 1)
+            return;
+        uint64_t m = Significand(av) | (1ull << 52);
+        int shift = exponent - 52 - MinExponent;
+        if (shift < 0) {
+            // Round _m_ to the nearest multiple of $2^{-96}$
+            m = (m + (1ull << (-shift - 1))) >> -shift;
+            shift = 0;
+        }
+        // Drop _m_'s trailing zero bits so that values with at most 32
+        // significant bits, such as single-precision _Float_s, only overlap
+        // two digits
+        int trailingZeros = Log2Int(m & -m);
+        m >>= trailingZeros;
+        shift += trailingZeros;
+
+        // Add $m 2^{shift}$ to the digits it overlaps
+        int digit = shift / 32, offset = shift % 32;
+        uint64_t lo = (m & 0xffffffff) << offset, hi = (m >> 32) << offset;
+        int64_t sign = v < 0 ? -1 : 1;
+        AddToDigit(digit, sign * int64_t(lo & 0xffffffff));
+        AddToDigit(digit + 1, sign * int64_t((lo >> 32) + (hi & 0xffffffff)));
+        AddToDigit(digit + 2, sign * int64_t(hi >> 32));
+    }
+
+    PBRT_CPU_GPU
+    explicit operator double() const {
+        if (int s = int(special); s != 0)
+            return ((s & NaNFlag) || ((s & PosInfFlag) && (s & NegInfFlag)))
+                       ? std::numeric_limits<double>::quiet_NaN()
+                       : ((s & PosInfFlag) ? Infinity : -Infinity);
+        int64_t raw[NDigits], d[NDigits];
+        for (int i = 0; i < NDigits; ++i)
+            d[i] = raw[i] = int64_t(digits[i]);
+        // Normalize digits to $[0, 2^{32})$; a negative final carry means that
+        // the sum is negative
+        int64_t carry = Normalize(d);
+        double sign = 1;
+        if (carry < 0) {
+            for (int i = 0; i < NDigits; ++i)
+                d[i] = -raw[i];
+            carry = Normalize(d);
+            sign = -1;
+        }
+
+        // Sum the digits, starting with the most significant one
+        double sum = std::ldexp(double(carry), MinExponent + 32 * NDigits);
+        for (int i = NDigits - 1; i >= 0; --i)
+            sum += std::ldexp(double(d[i]), MinExponent + 32 * i);
+        return sign * sum;
+    }
+
+    PBRT_CPU_GPU
+    void Reset() {
+        for (int i = 0; i < NDigits; ++i)
+            digits[i] = 0;
+        special = 0;
+    }
+
+    std::string ToString() const;
+
+  private:
+    // OrderIndependentSum Private Methods
+    PBRT_CPU_GPU
+    static int64_t Normalize(int64_t d[]) {
+        int64_t carry = 0;
+        for (int i = 0; i < NDigits; ++i) {
+            int64_t v = d[i] + carry;
+            d[i] = v & 0xffffffff;
+            carry = (v - d[i]) / (int64_t(1) << 32);
+        }
+        return carry;
+    }
+
+    PBRT_CPU_GPU
+    void AddToDigit(int i, int64_t v) {
+        if (v == 0)
+            return;
+        DCHECK_LT(i, NDigits);
+#ifdef PBRT_IS_GPU_CODE
+        atomicAdd((unsigned long long *)&digits[i], (unsigned long long)v);
+#else
+        digits[i].fetch_add(v, std::memory_order_relaxed);
+#endif
+    }
+
+    PBRT_CPU_GPU
+    void AddSpecial(int flag) {
+#ifdef PBRT_IS_GPU_CODE
+        atomicOr(&special, flag);
+#else
+        special.fetch_or(flag, std::memory_order_relaxed);
+#endif
+    }
+
+    // OrderIndependentSum Private Members
+    static constexpr int MinExponent = -96, NDigits = 6;
+    static constexpr int NaNFlag = 1, PosInfFlag = 2, NegInfFlag = 4;
+#ifdef PBRT_IS_GPU_CODE
+    int64_t digits[NDigits];
+    int special;
+#else
+    std::atomic<int64_t> digits[NDigits];
+    std::atomic<int> special;
+#endif
+};
+
 // Barrier Definition
 class Barrier {
   public:
@@ -260,8 +402,21 @@ class Barrier {
     int numToBlock, numToExit;
 };
 
+// TileCosts Definition
+// Records how long each tile of a _ParallelFor2D()_ loop took, so that later
+// loops over the same extent can split the tiles that were most expensive.
+struct TileCosts {
+    std::string ToString() const;
+
+    Bounds2i extent;
+    int tileSize = 0;
+    std::vector<double> seconds;
+};
+
 void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func);
 void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func);
+void ParallelFor2D(const Bounds2i &extent, TileCosts *costs,
+                   std::function<void(Bounds2i)> func);
 
 // Parallel Inline Functions
 inline void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t)> func) {
@@ -281,15 +436,18 @@ inline void ParallelFor2D(const Bounds2i &extent, std::function<void(Point2i)> f
 class ThreadPool;
 
 // ParallelJob Definition
+// A job is a range of work items that the _ThreadPool_ recursively splits
+// into tasks of at most _chunkSize_ items, which idle threads may steal.
 class ParallelJob {
   public:
     // ParallelJob Public Methods
-    virtual ~ParallelJob() { DCHECK(removed); }
+    ParallelJob(int64_t nWorkItems, int64_t chunkSize)
+        : nRemaining(nWorkItems), chunkSize(chunkSize) {}
+    virtual ~ParallelJob() = default;
 
-    virtual bool HaveWork() const = 0;
-    virtual void RunStep(std::unique_lock<std::mutex> *lock) = 0;
+    virtual void RunStep(int64_t start, int64_t end) = 0;
 
-    bool Finished() const { return !HaveWork() && activeWorkers == 0; }
+    bool Finished() const { return nRemaining == 0; }
 
     virtual std::string ToString() const = 0;
 
@@ -298,31 +456,38 @@ class ParallelJob {
 
   protected:
     std::string BaseToString() const {
-        return StringPrintf("activeWorkers: %d removed: %s", activeWorkers, removed);
+        return StringPrintf("nRemaining: %d chunkSize: %d", nRemaining.load(),
+                            chunkSize);
     }
 
   private:
     // ParallelJob Private Members
     friend class ThreadPool;
-    int activeWorkers = 0;
-    ParallelJob *prev = nullptr, *next = nullptr;
-    bool removed = false;
+    std::atomic<int64_t> nRemaining;
+    int64_t chunkSize;
+};
+
+// ParallelTask Definition
+struct ParallelTask {
+    ParallelJob *job;
+    int64_t start, end;
 };
 
 // ThreadPool Definition
+// Each thread has its own queue of tasks, which it pushes and pops at the
+// back; threads that run out of work steal the oldest, and thus largest,
+// tasks from the front of other threads' queues.
 class ThreadPool {
   public:
     // ThreadPool Public Methods
-    explicit ThreadPool(int nThreads);
+    explicit ThreadPool(int nThreads, bool numa = false);
 
     ~ThreadPool();
 
     size_t size() const { return threads.size(); }
 
-    std::unique_lock<std::mutex> AddToJobList(ParallelJob *job);
-    void RemoveFromJobList(ParallelJob *job);
-
-    void WorkOrWait(std::unique_lock<std::mutex> *lock, bool isEnqueuingThread);
+    void Enqueue(ParallelJob *job, int64_t start, int64_t end);
+    void RunJob(ParallelJob *job, int64_t start, int64_t end);
     bool WorkOrReturn();
 
     void Disable();
@@ -330,19 +495,33 @@ class ThreadPool {
 
     void ForEachThread(std::function<void(void)> func);
 
+    int NUMANodeCount() const { return nNUMANodes; }
+
     std::string ToString() const;
 
   private:
+    struct TaskQueue;
+
     // ThreadPool Private Methods
-    void Worker();
+    void Worker(int queueIndex);
+    int CurrentQueueIndex() const;
+    void Push(ParallelTask task);
+    bool GetTask(int queueIndex, ParallelTask *task);
+    void RunTask(ParallelTask task);
+    template <typename F>
+    void SleepUntil(F pred);
 
     // ThreadPool Private Members
     std::vector<std::thread> threads;
-    mutable std::mutex mutex;
-    bool shutdownThreads = false;
-    bool disabled = false;
-    ParallelJob *jobList = nullptr;
-    std::condition_variable jobListCondition;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    // CPU and NUMA node of each queue's thread in NUMA mode
+    std::vector<int> queueCPUs, queueNUMANodes;
+    int nNUMANodes = 1;
+    std::atomic<int64_t> nQueuedTasks{0};
+    std::atomic<int> nSleeping{0};
+    std::atomic<bool> shutdownThreads{false}, disabled{false};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
 };
 
 bool DoParallelWork();
@@ -352,20 +531,9 @@ template <typename T>
 class AsyncJob : public ParallelJob {
   public:
     // AsyncJob Public Methods
-    AsyncJob(std::function<T(void)> w) : func(std::move(w)) {}
-
-    bool HaveWork() const { return !started; }
+    AsyncJob(std::function<T(void)> w) : ParallelJob(1, 1), func(std::move(w)) {}
 
-    void RunStep(std::unique_lock<std::mutex> *lock) {
-        threadPool->RemoveFromJobList(this);
-        started = true;
-        lock->unlock();
-        // Execute asynchronous work and notify waiting threads of its completion
-        T r = func();
-        std::unique_lock<std::mutex> ul(mutex);
-        result = r;
-        cv.notify_all();
-    }
+    void RunStep(int64_t start, int64_t end) { DoWork(); }
 
     bool IsReady() const {
         std::lock_guard<std::mutex> lock(mutex);
@@ -408,19 +576,46 @@ class AsyncJob : public ParallelJob {
     }
 
     std::string ToString() const {
-        return StringPrintf("[ AsyncJob started: %s ]", started);
+        return StringPrintf("[ AsyncJob ready: %s %s ]", IsReady(), BaseToString());
     }
 
   private:
     // AsyncJob Private Members
     std::function<T(void)> func;
-    bool started = false;
     pstd::optional<T> result;
     mutable std::mutex mutex;
     std::condition_variable cv;
 };
 
 void ForEachThread(std::function<void(void)> func);
+void ForEachNUMANode(std::function<void(int)> func);
+
+// Returns copies of _data_ that are first touched by a thread on each NUMA
+// node, indexed by node, or no copies if there is only one node. The copies
+// should be freed with _FreeNUMAReplicas()_ using the same allocator.
+template <typename T>
+std::vector<T *> NUMAReplicate(const T *data, size_t count, Allocator alloc = {}) {
+    std::vector<T *> replicas;
+    if (NUMANodeCount() == 1)
+        return replicas;
+    replicas.resize(NUMANodeCount());
+    ForEachNUMANode([&](int node) {
+        replicas[node] = alloc.allocate_object<T>(count);
+        std::uninitialized_copy(data, data + count, replicas[node]);
+    });
+    return replicas;
+}
+
+template <typename T>
+void FreeNUMAReplicas(std::vector<T *> &replicas, size_t count, Allocator alloc = {}) {
+    for (T *replica : replicas)
+        alloc.deallocate_object(replica, count);
+    replicas.clear();
+}
+
+// Returns a memory resource whose allocations are first touched in parallel
+// by the thread pool, which spreads them over the NUMA nodes' memory.
+pstd::pmr::memory_resource *ParallelFirstTouchMemoryResource();
 
 void DisableThreadPool();
 void ReenableThreadPool();
@@ -434,11 +629,10 @@ inline auto RunAsync(F func, Args &&...args) {
     AsyncJob<R> *job = new AsyncJob<R>(std::move(fvoid));
 
     // Enqueue _job_ or run it immediately
-    std::unique_lock<std::mutex> lock;
     if (RunningThreads() == 1)
         job->DoWork();
     else
-        lock = ParallelJob::threadPool->AddToJobList(job);
+        ParallelJob::threadPool->Enqueue(job, 0, 1);
 
     return job;
 }
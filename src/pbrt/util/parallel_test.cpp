@@ -5,9 +5,14 @@
 #include <gtest/gtest.h>
 #include <pbrt/pbrt.h>
 #include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <thread>
+#include <vector>
 
 using namespace pbrt;
 
@@ -41,12 +46,114 @@ TEST(Parallel, DoNothing) {
     EXPECT_EQ(0, counter);
 }
 
+TEST(Parallel, TileCosts) {
+    Bounds2i extent{{3, 5}, {203, 157}};
+    std::vector<std::atomic<int>> visits(extent.Area());
+    auto offset = [&](Point2i p) {
+        return (p.y - extent.pMin.y) * extent.Diagonal().x + (p.x - extent.pMin.x);
+    };
+    TileCosts costs;
+    for (int pass = 0; pass < 3; ++pass) {
+        // Make tiles that overlap a small region expensive
+        std::atomic<int> nTiles{0};
+        ParallelFor2D(extent, &costs, [&](Bounds2i b) {
+            ++nTiles;
+            for (Point2i p : b)
+                ++visits[offset(p)];
+            if (Overlaps(b, Bounds2i{{20, 20}, {30, 30}}))
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        });
+        for (Point2i p : extent)
+            EXPECT_EQ(pass + 1, visits[offset(p)]);
+
+        // Expensive tiles should be split after the first pass
+        EXPECT_EQ(costs.extent, extent);
+        ASSERT_FALSE(costs.seconds.empty());
+        int nBaseTiles = costs.seconds.size();
+        if (pass == 0)
+            EXPECT_EQ(nBaseTiles, nTiles);
+        else
+            EXPECT_GT(nTiles, nBaseTiles);
+    }
+}
+
+TEST(Parallel, Nested) {
+    std::atomic<int> counter{0};
+    ParallelFor(0, 100, [&](int64_t) {
+        ParallelFor(0, 100, [&](int64_t) { ++counter; });
+        ParallelFor2D(Bounds2i{{0, 0}, {5, 4}}, [&](Point2i p) { ++counter; });
+    });
+    EXPECT_EQ(100 * (100 + 5 * 4), counter);
+
+    // Wait for asynchronous jobs that run parallel loops from inside a loop
+    counter = 0;
+    ParallelFor(0, 50, [&](int64_t i) {
+        AsyncJob<int64_t> *job = RunAsync([&counter, i]() {
+            ParallelFor(0, 10, [&](int64_t) { ++counter; });
+            return i;
+        });
+        EXPECT_EQ(i, job->GetResult());
+    });
+    EXPECT_EQ(50 * 10, counter);
+}
+
 TEST(Parallel, ForEachThread) {
     std::atomic<int> count{RunningThreads()};
     ForEachThread([&count] { --count; });
     EXPECT_EQ(0, count);
 }
 
+TEST(Parallel, OrderIndependentSums) {
+    // Add the same values to OrderIndependentSums in parallel and in reverse order
+    RNG rng;
+    std::vector<double> values(100000);
+    for (double &v : values)
+        v = std::exp(Lerp(rng.Uniform<Float>(), -40, 40)) *
+            (rng.Uniform<Float>() < .1f ? -1 : 1);
+
+    OrderIndependentSum parallelSum, reverseSum;
+    ParallelFor(0, values.size(), [&](int64_t i) { parallelSum.Add(values[i]); });
+    for (auto iter = values.rbegin(); iter != values.rend(); ++iter)
+        reverseSum.Add(*iter);
+    EXPECT_EQ(double(reverseSum), double(parallelSum));
+
+    // The sum should match one computed with extra precision
+    std::sort(values.begin(), values.end(),
+              [](double a, double b) { return std::abs(a) < std::abs(b); });
+    long double sum = 0;
+    for (double v : values)
+        sum += v;
+    EXPECT_DOUBLE_EQ(double(sum), double(parallelSum));
+
+    parallelSum.Reset();
+    EXPECT_EQ(0., double(parallelSum));
+}
+
+TEST(Parallel, OrderIndependentSumsExact) {
+    // Tiny and large values are neither lost nor rounded
+    OrderIndependentSum sum;
+    for (int i = 0; i < 1000; ++i)
+        sum.Add(1e-20);
+    EXPECT_FLOAT_EQ(1e-17, double(sum));
+
+    sum.Reset();
+    sum.Add(0x1p60);
+    sum.Add(0x1p-80);
+    sum.Add(-0x1p60);
+    EXPECT_EQ(0x1p-80, double(sum));
+
+    sum.Reset();
+    sum.Add(3.25);
+    sum.Add(-7.5);
+    EXPECT_EQ(-4.25, double(sum));
+
+    // Non-finite values
+    sum.Add(Infinity);
+    EXPECT_EQ(Infinity, double(sum));
+    sum.Add(-Infinity);
+    EXPECT_TRUE(IsNaN(double(sum)));
+}
+
 TEST(ThreadLocal, Consistency) {
     ThreadLocal<std::thread::id> tids([]() { return std::this_thread::get_id(); });
 
@@ -0,0 +1,389 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/texturecache.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#ifndef PBRT_IS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // !PBRT_IS_WINDOWS
+
+namespace pbrt {
+
+STAT_COUNTER("Texture cache/Tiles loaded", nTilesLoaded);
+STAT_COUNTER("Texture cache/Tiles evicted", nTilesEvicted);
+STAT_PERCENT("Texture cache/Shared cache lookups that loaded a tile", nTileLoadLookups,
+             nSharedTileLookups);
+STAT_MEMORY_COUNTER("Memory/Texture cache file", textureCacheFileBytes);
+
+// TextureTileCache Utility Functions
+// Caches are registered so that threads can tell whether the cache that
+// holds the tiles in their thread caches still exists.
+static std::mutex liveCachesMutex;
+static std::map<uint64_t, TextureTileCache *> liveCaches;
+static uint64_t nextCacheId = 1;
+
+static MemoryTag *TileMemoryTag() {
+    static MemoryTag *tag = MemoryTag::Get("Scene/Textures/Tile cache");
+    return tag;
+}
+
+// TextureTileCache Method Definitions
+thread_local TextureTileCache::ThreadCache TextureTileCache::threadCaches;
+
+TextureTileCache::TextureTileCache(const std::string &directory, size_t budget)
+    : budget(budget) {
+#ifndef PBRT_IS_WINDOWS
+    // Create the tile file and unlink it so that it is removed at exit
+    std::string filename = directory + "/pbrt-textures-XXXXXX";
+    std::vector<char> name(filename.begin(), filename.end());
+    name.push_back('\0');
+    fd = mkstemp(name.data());
+    if (fd == -1)
+        ErrorExit("%s: unable to create texture cache file: %s", filename,
+                  ErrorString());
+    unlink(name.data());
+#else
+    ErrorExit("The texture cache is not supported on this system.");
+#endif  // !PBRT_IS_WINDOWS
+
+    std::lock_guard<std::mutex> lock(liveCachesMutex);
+    id = nextCacheId++;
+    liveCaches[id] = this;
+}
+
+TextureTileCache::~TextureTileCache() {
+    std::unique_lock<std::mutex> lock(liveCachesMutex);
+    liveCaches.erase(id);
+    lock.unlock();
+
+    for (Shard &shard : shards)
+        for (const std::pair<const uint64_t, Tile *> &tile : shard.tiles) {
+            TileMemoryTag()->Add(-int64_t(tile.second->image.BytesUsed()));
+            delete tile.second;
+        }
+#ifndef PBRT_IS_WINDOWS
+    for (int texture : openFiles)
+        close(textures[texture].fd);
+    close(fd);
+#endif  // !PBRT_IS_WINDOWS
+}
+
+int TextureTileCache::AddTexture(pstd::span<const Image> levels) {
+    CHECK(!levels.empty());
+    CHECK_LE(levels.size(), 64);
+    const Image &base = levels[0];
+    Texture texture;
+    texture.fd = fd;
+    texture.format = base.Format();
+    texture.channelNames = base.ChannelNames();
+    texture.encoding = base.Encoding();
+    texture.tileBytes = TileBytes(texture.format, base.NChannels());
+
+    // Allocate space in the file for the texture's tiles
+    std::unique_lock<std::mutex> lock(fileMutex);
+    int index = textures.size();
+    CHECK_LT(index, 1 << 20);
+    for (const Image &image : levels) {
+        CHECK(image.Format() == texture.format);
+        Point2i resolution = image.Resolution();
+        int nTilesX = (resolution.x + TileSize - 1) / TileSize;
+        int nTilesY = (resolution.y + TileSize - 1) / TileSize;
+        CHECK(nTilesX <= (1 << 19) && nTilesY <= (1 << 19));
+        texture.levels.push_back(Level{resolution, nTilesX, fileBytes});
+        fileBytes += int64_t(nTilesX) * nTilesY * texture.tileBytes;
+        textureCacheFileBytes += int64_t(nTilesX) * nTilesY * texture.tileBytes;
+    }
+    textures.push_back(texture);
+    lock.unlock();
+
+#ifndef PBRT_IS_WINDOWS
+    // Write the tiles to the file
+    std::vector<uint8_t> tileData(texture.tileBytes);
+    for (size_t level = 0; level < levels.size(); ++level) {
+        const Level &l = texture.levels[level];
+        int64_t offset = l.fileOffset;
+        for (int y = 0; y < (l.resolution.y + TileSize - 1) / TileSize; ++y)
+            for (int x = 0; x < l.nTilesX; ++x) {
+                CopyTile(levels[level], {x, y}, pstd::MakeSpan(tileData));
+                if (pwrite(fd, tileData.data(), tileData.size(), offset) !=
+                    ssize_t(tileData.size()))
+                    ErrorExit("Unable to write texture cache file: %s", ErrorString());
+                offset += texture.tileBytes;
+            }
+    }
+#endif  // !PBRT_IS_WINDOWS
+    return index;
+}
+
+int TextureTileCache::AddTextureFile(const std::string &filename, PixelFormat format,
+                                     std::vector<std::string> channelNames,
+                                     ColorEncoding encoding,
+                                     pstd::span<const Level> levels) {
+    CHECK(!levels.empty());
+    CHECK_LE(levels.size(), 64);
+    // The file is opened when its first tile is read
+    Texture texture;
+    texture.filename = filename;
+    texture.format = format;
+    texture.encoding = encoding;
+    texture.tileBytes = TileBytes(format, channelNames.size());
+    texture.channelNames = std::move(channelNames);
+    for (const Level &level : levels) {
+        CHECK_EQ(level.nTilesX, (level.resolution.x + TileSize - 1) / TileSize);
+        CHECK(level.nTilesX <= (1 << 19) && level.resolution.y <= (TileSize << 19));
+        texture.levels.push_back(level);
+    }
+
+    std::lock_guard<std::mutex> lock(fileMutex);
+    int index = textures.size();
+    CHECK_LT(index, 1 << 20);
+    textures.push_back(std::move(texture));
+    return index;
+}
+
+size_t TextureTileCache::TileBytes(PixelFormat format, int nChannels) {
+    if (IsBlockCompressed(format))
+        return BlockBytes(format) * (TileSize / 4) * (TileSize / 4);
+    return TexelBytes(format) * nChannels * TileSize * TileSize;
+}
+
+void TextureTileCache::CopyTile(const Image &image, Point2i tile,
+                                pstd::span<uint8_t> data) {
+    CHECK_GE(data.size(), TileBytes(image.Format(), image.NChannels()));
+    std::fill(data.begin(), data.end(), 0);
+    // Copy the tile's rows of texels or, for images in block-compressed
+    // formats, its rows of blocks
+    bool blocks = IsBlockCompressed(image.Format());
+    int blockSize = blocks ? 4 : 1;
+    size_t elementBytes = blocks ? BlockBytes(image.Format())
+                                 : TexelBytes(image.Format()) * image.NChannels();
+    Point2i resolution = image.Resolution();
+    int x0 = tile.x * TileSize, y0 = tile.y * TileSize;
+    int width = (std::min(TileSize, resolution.x - x0) + blockSize - 1) / blockSize;
+    int height = (std::min(TileSize, resolution.y - y0) + blockSize - 1) / blockSize;
+    size_t rowBytes = elementBytes * (TileSize / blockSize);
+    for (int y = 0; y < height; ++y)
+        std::memcpy(&data[y * rowBytes], image.RawPointer({x0, y0 + y * blockSize}),
+                    width * elementBytes);
+}
+
+void TextureTileCache::setThreadCache(ThreadCache &threadCache) {
+    // Release the thread's tiles from the cache it was last used with if
+    // that cache still exists.
+    std::lock_guard<std::mutex> lock(liveCachesMutex);
+    bool live = liveCaches.find(threadCache.cacheId) != liveCaches.end();
+    for (ThreadCache::Entry &entry : threadCache.entries) {
+        if (live && entry.tile)
+            entry.tile->refCount.fetch_sub(1, std::memory_order_release);
+        entry.tile = nullptr;
+    }
+    threadCache.cacheId = id;
+}
+
+const Image &TextureTileCache::lookup(ThreadCache::Entry &entry, uint64_t key,
+                                      int texture, int level, Point2i tileIndex) {
+    // Release the tile that is being replaced in the thread's cache
+    if (entry.tile) {
+        entry.tile->refCount.fetch_sub(1, std::memory_order_release);
+        entry.tile = nullptr;
+    }
+
+    // Find the tile in the shared cache or load it
+    ++nSharedTileLookups;
+    Shard &shard = shards[(MixBits(key) >> 32) % NumShards];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Tile *tile = nullptr;
+    bool added = false;
+    if (auto iter = shard.tiles.find(key); iter != shard.tiles.end())
+        tile = iter->second;
+    else {
+        lock.unlock();
+        Tile *newTile = loadTile(key, texture, level, tileIndex);
+        lock.lock();
+        // Handle the case of another thread loading the tile first
+        if (auto iter = shard.tiles.find(key); iter != shard.tiles.end()) {
+            tile = iter->second;
+            delete newTile;
+        } else {
+            tile = newTile;
+            shard.tiles[key] = tile;
+            added = true;
+        }
+    }
+    tile->refCount.fetch_add(1, std::memory_order_relaxed);
+    tile->referenced.store(true, std::memory_order_relaxed);
+    lock.unlock();
+
+    if (added) {
+        // Add the new tile to the clock and evict others if over budget
+        ++nTileLoadLookups;
+        size_t bytes = tile->image.BytesUsed();
+        TileMemoryTag()->Add(bytes);
+        std::lock_guard<std::mutex> clockLock(clockMutex);
+        clock.push_back(tile);
+        if (residentBytes.fetch_add(bytes) + bytes > budget)
+            evict();
+    }
+
+    entry.key = key;
+    entry.tile = tile;
+    return tile->image;
+}
+
+TextureTileCache::Tile *TextureTileCache::loadTile(uint64_t key, int texture, int level,
+                                                   Point2i tileIndex) {
+    // Get the tile's location in the file
+    std::unique_lock<std::mutex> lock(fileMutex);
+    CHECK_LT(texture, textures.size());
+    Texture &tex = textures[texture];
+    CHECK_LT(level, tex.levels.size());
+    Tile *tile = new Tile;
+    tile->key = key;
+    tile->image =
+        Image(tex.format, Point2i(TileSize, TileSize), tex.channelNames, tex.encoding);
+    size_t tileBytes = tex.tileBytes;
+    const Level &l = tex.levels[level];
+    int64_t offset =
+        l.fileOffset + (int64_t(tileIndex.y) * l.nTilesX + tileIndex.x) * tileBytes;
+    bool ownFile = !tex.filename.empty();
+    if (ownFile) {
+        // Make sure the texture's file stays open while the tile is read
+        if (tex.fd == -1)
+            openTextureFile(texture);
+        ++tex.fdUsers;
+        tex.lastFileUse = ++fileUseCounter;
+    }
+    int texFd = tex.fd;
+    bool checkBC7 = ownFile && tex.format == PixelFormat::BC7;
+    std::string filename = checkBC7 ? tex.filename : std::string();
+    lock.unlock();
+
+#ifndef PBRT_IS_WINDOWS
+    void *ptr = tile->image.RawPointer({0, 0});
+    if (pread(texFd, ptr, tileBytes, offset) != ssize_t(tileBytes))
+        ErrorExit("Unable to read texture tile: %s", ErrorString());
+    // Only BC7 mode 6 blocks can be decoded, so reject files with others
+    if (checkBC7)
+        for (size_t b = 0; b < tileBytes; b += 16)
+            if (!IsBC7Mode6Block((const uint8_t *)ptr + b))
+                ErrorExit("%s: BC7 blocks in modes other than mode 6 are not "
+                          "supported.",
+                          filename);
+#endif  // !PBRT_IS_WINDOWS
+    if (ownFile) {
+        lock.lock();
+        --textures[texture].fdUsers;
+    }
+    ++nTilesLoaded;
+    return tile;
+}
+
+void TextureTileCache::openTextureFile(int texture) {
+    // Close the least recently used file that isn't being read if there are
+    // too many open
+    if (openFiles.size() >= MaxOpenFiles) {
+        auto lru = openFiles.end();
+        for (auto iter = openFiles.begin(); iter != openFiles.end(); ++iter)
+            if (textures[*iter].fdUsers == 0 &&
+                (lru == openFiles.end() ||
+                 textures[*iter].lastFileUse < textures[*lru].lastFileUse))
+                lru = iter;
+        if (lru != openFiles.end()) {
+#ifndef PBRT_IS_WINDOWS
+            close(textures[*lru].fd);
+#endif  // !PBRT_IS_WINDOWS
+            textures[*lru].fd = -1;
+            *lru = openFiles.back();
+            openFiles.pop_back();
+        }
+    }
+
+    Texture &tex = textures[texture];
+#ifndef PBRT_IS_WINDOWS
+    tex.fd = open(tex.filename.c_str(), O_RDONLY);
+    if (tex.fd == -1)
+        ErrorExit("%s: %s", tex.filename, ErrorString());
+#endif  // !PBRT_IS_WINDOWS
+    openFiles.push_back(texture);
+}
+
+void TextureTileCache::evict() {
+    // Sweep the clock hand over the tiles, evicting the ones that haven't been
+    // accessed since it last passed them and that aren't in a thread cache.
+    // Two sweeps suffice to clear all of the referenced flags.
+    for (size_t i = 0, n = 2 * clock.size(); i < n && residentBytes > budget; ++i) {
+        if (clock.empty())
+            break;
+        clockHand %= clock.size();
+        Tile *tile = clock[clockHand];
+        if (tile->referenced.exchange(false, std::memory_order_relaxed) ||
+            tile->refCount.load(std::memory_order_acquire) > 0) {
+            ++clockHand;
+            continue;
+        }
+
+        // The reference count can only be incremented with the shard's mutex
+        // held, so check it again before removing the tile from the shard.
+        Shard &shard = shards[(MixBits(tile->key) >> 32) % NumShards];
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        if (tile->refCount.load(std::memory_order_acquire) > 0) {
+            ++clockHand;
+            continue;
+        }
+        shard.tiles.erase(tile->key);
+        lock.unlock();
+
+        size_t bytes = tile->image.BytesUsed();
+        residentBytes -= bytes;
+        TileMemoryTag()->Add(-int64_t(bytes));
+        ++nTilesEvicted;
+        delete tile;
+        // Move the last tile into the evicted tile's slot; the hand stays in
+        // place so that it is visited next.
+        clock[clockHand] = clock.back();
+        clock.pop_back();
+    }
+}
+
+std::string TextureTileCache::ToString() const {
+    return StringPrintf("[ TextureTileCache budget: %d residentBytes: %d "
+                        "textures: %d fileBytes: %d ]",
+                        budget, residentBytes.load(), textures.size(), fileBytes);
+}
+
+// Texture Cache Function Definitions
+static TextureTileCache *textureCache;
+
+void EnableTextureCache(std::string directory, size_t budget) {
+#ifndef PBRT_IS_WINDOWS
+    if (directory.empty()) {
+        const char *tmp = getenv("TMPDIR");
+        directory = tmp ? tmp : "/tmp";
+    }
+    // Leak this so that textures remain valid until exit
+    textureCache = new TextureTileCache(directory, budget);
+    LOG_VERBOSE("Caching texture tiles in %s with a %d MB budget", directory,
+                budget / (1024 * 1024));
+#else
+    Warning("The texture cache is not supported on this system.");
+#endif  // !PBRT_IS_WINDOWS
+}
+
+TextureTileCache *TextureCache() {
+    return textureCache;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,180 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_TEXTURECACHE_H
+#define PBRT_UTIL_TEXTURECACHE_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/hash.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pbrt {
+
+// TextureTileCache Definition
+// Stores the levels of MIP maps as fixed-size tiles in a file on disk and
+// reads the tiles into memory when they are first accessed. When the total
+// size of the tiles in memory exceeds the budget, tiles that haven't been
+// accessed recently are evicted using the CLOCK algorithm. Each thread keeps
+// a small cache of the tiles it has accessed most recently; those tiles are
+// pinned in memory so that they can be accessed without locking.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    TextureTileCache(const std::string &directory, size_t budget);
+    ~TextureTileCache();
+
+    TextureTileCache(const TextureTileCache &) = delete;
+    TextureTileCache &operator=(const TextureTileCache &) = delete;
+
+    // TextureTileCache::Level Definition
+    // Location of a MIP map level's tiles in a file; they are stored in
+    // scanline order, each one taking _TileSize_ x _TileSize_ texels.
+    struct Level {
+        Point2i resolution;
+        int nTilesX;
+        int64_t fileOffset;
+    };
+
+    // Writes the tiles of the given MIP map levels to the cache's file and
+    // returns an index that identifies the texture in calls to _GetTile()_.
+    int AddTexture(pstd::span<const Image> levels);
+    // Adds a texture whose tiles are already stored in the given file; they
+    // are read from it directly. At most _MaxOpenFiles_ such files are kept
+    // open, closing the least recently used one when another is needed.
+    int AddTextureFile(const std::string &filename, PixelFormat format,
+                       std::vector<std::string> channelNames, ColorEncoding encoding,
+                       pstd::span<const Level> levels);
+
+    // Returns the tile with the given tile coordinates; its pixel (0, 0) is
+    // the level's pixel (TileSize * tile.x, TileSize * tile.y). It remains
+    // valid until the calling thread's next call to _GetTile()_.
+    const Image &GetTile(int texture, int level, Point2i tile) {
+        uint64_t key = TileKey(texture, level, tile);
+        ThreadCache &threadCache = threadCaches;
+        if (threadCache.cacheId != id)
+            setThreadCache(threadCache);
+        ThreadCache::Entry &entry = threadCache.entries[MixBits(key) % ThreadCacheSize];
+        if (entry.tile && entry.key == key) {
+            // Only write the referenced flag if it is clear so that the
+            // cache lines of frequently-used tiles stay shared across threads.
+            if (!entry.tile->referenced.load(std::memory_order_relaxed))
+                entry.tile->referenced.store(true, std::memory_order_relaxed);
+            return entry.tile->image;
+        }
+        return lookup(entry, key, texture, level, tile);
+    }
+
+    size_t Budget() const { return budget; }
+    size_t ResidentBytes() const { return residentBytes.load(); }
+
+    std::string ToString() const;
+
+    static constexpr int TileSize = 64;
+    static constexpr int MaxOpenFiles = 64;
+
+    // Returns the size of a tile; tiles of images in block-compressed
+    // formats store the tile's blocks in scanline order.
+    static size_t TileBytes(PixelFormat format, int nChannels);
+    // Copies the given tile of the image to _data_, which must be large
+    // enough to store a full tile. Tiles at the image's edges are padded with
+    // zeros.
+    static void CopyTile(const Image &image, Point2i tile, pstd::span<uint8_t> data);
+
+  private:
+    // TextureTileCache Private Members
+    struct Tile {
+        uint64_t key;
+        Image image;
+        // Number of thread caches that hold the tile; it is only incremented
+        // with the tile's shard's mutex held.
+        std::atomic<int> refCount{0};
+        std::atomic<bool> referenced{true};
+    };
+
+    struct Texture {
+        // File that holds the texture's tiles; _filename_ is empty if they
+        // are in the cache's file. Otherwise, _fd_ is -1 if the file isn't
+        // open and _fdUsers_ counts the tile reads that are using it.
+        std::string filename;
+        int fd = -1;
+        int fdUsers = 0;
+        uint64_t lastFileUse = 0;
+        PixelFormat format;
+        std::vector<std::string> channelNames;
+        ColorEncoding encoding;
+        size_t tileBytes;
+        std::vector<Level> levels;
+    };
+
+    static constexpr int ThreadCacheSize = 32;
+    struct ThreadCache {
+        uint64_t cacheId = 0;
+        struct Entry {
+            uint64_t key;
+            Tile *tile = nullptr;
+        } entries[ThreadCacheSize];
+    };
+
+    static constexpr int NumShards = 64;
+    struct alignas(PBRT_L1_CACHE_LINE_SIZE) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Tile *> tiles;
+    };
+
+    // TextureTileCache Private Methods
+    static uint64_t TileKey(int texture, int level, Point2i tile) {
+        // 20 bits for the texture, 6 for the level, and 19 for each tile
+        // coordinate.
+        return (uint64_t(texture) << 44) | (uint64_t(level) << 38) |
+               (uint64_t(tile.y) << 19) | uint64_t(tile.x);
+    }
+
+    void setThreadCache(ThreadCache &threadCache);
+    const Image &lookup(ThreadCache::Entry &entry, uint64_t key, int texture, int level,
+                        Point2i tile);
+    Tile *loadTile(uint64_t key, int texture, int level, Point2i tile);
+    void openTextureFile(int texture);
+    void evict();
+
+    uint64_t id;
+    size_t budget;
+    std::atomic<size_t> residentBytes{0};
+    Shard shards[NumShards];
+
+    // The cache's file and its textures are protected by _fileMutex_.
+    std::mutex fileMutex;
+    int fd = -1;
+    int64_t fileBytes = 0;
+    std::vector<Texture> textures;
+    // Indices of the textures whose files are open
+    std::vector<int> openFiles;
+    uint64_t fileUseCounter = 0;
+
+    // Resident tiles in the order that they are visited by the clock hand,
+    // protected by _clockMutex_
+    std::mutex clockMutex;
+    std::vector<Tile *> clock;
+    size_t clockHand = 0;
+
+    static thread_local ThreadCache threadCaches;
+};
+
+// Texture Cache Function Declarations
+void EnableTextureCache(std::string directory, size_t budget);
+// Returns nullptr if the texture cache hasn't been enabled.
+TextureTileCache *TextureCache();
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_TEXTURECACHE_H
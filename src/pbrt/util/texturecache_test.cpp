@@ -0,0 +1,122 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/texturecache.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#ifdef PBRT_IS_LINUX
+#include <dirent.h>
+#endif  // PBRT_IS_LINUX
+
+using namespace pbrt;
+
+#ifndef PBRT_IS_WINDOWS
+TEST(TextureTileCache, Budget) {
+    constexpr int TileSize = TextureTileCache::TileSize;
+    constexpr size_t tileBytes = TileSize * TileSize * sizeof(float);
+    TextureTileCache cache(".", 48 * tileBytes);
+
+    // Create a texture whose resolution isn't a multiple of the tile size
+    // along with a smaller level.
+    std::vector<Image> levels;
+    for (Point2i res : {Point2i(1000, 700), Point2i(500, 350)}) {
+        Image image(PixelFormat::Float, res, {"Y"});
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                image.SetChannel({x, y}, 0, x + 1000 * y + res.x);
+        levels.push_back(std::move(image));
+    }
+    int texture = cache.AddTexture(levels);
+
+    auto check = [&](int level, Point2i p) {
+        const Image &tile =
+            cache.GetTile(texture, level, {p.x / TileSize, p.y / TileSize});
+        return tile.GetChannel({p.x % TileSize, p.y % TileSize}, 0) ==
+               levels[level].GetChannel(p, 0);
+    };
+
+    // Access all of the texels, which requires evicting tiles.
+    for (int level = 0; level < 2; ++level) {
+        Point2i res = levels[level].Resolution();
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                EXPECT_TRUE(check(level, {x, y}));
+    }
+    EXPECT_LE(cache.ResidentBytes(), cache.Budget());
+
+    // Access texels from multiple threads and make sure that tiles are
+    // intact after they have been evicted and loaded again.
+    std::atomic<int> nMismatches{0};
+    ParallelFor(0, 100000, [&](int64_t i) {
+        RNG rng(i);
+        int level = rng.Uniform<int>(2);
+        Point2i res = levels[level].Resolution();
+        Point2i p(rng.Uniform<int>(res.x), rng.Uniform<int>(res.y));
+        if (!check(level, p))
+            ++nMismatches;
+    });
+    EXPECT_EQ(0, nMismatches.load());
+}
+
+#ifdef PBRT_IS_LINUX
+static int CountOpenFiles() {
+    DIR *dir = opendir("/proc/self/fd");
+    int count = 0;
+    while (readdir(dir))
+        ++count;
+    closedir(dir);
+    return count;
+}
+#endif  // PBRT_IS_LINUX
+
+TEST(TextureTileCache, ManyFiles) {
+    // Create more single-tile texture files than can be open at once
+    constexpr int TileSize = TextureTileCache::TileSize;
+    constexpr int nFiles = TextureTileCache::MaxOpenFiles + 8;
+    TextureTileCache cache(".", 16 * TileSize * TileSize * sizeof(float));
+    std::vector<std::string> filenames;
+    std::vector<int> textures;
+    for (int i = 0; i < nFiles; ++i) {
+        Image image(PixelFormat::Float, {TileSize, TileSize}, {"Y"});
+        for (int y = 0; y < TileSize; ++y)
+            for (int x = 0; x < TileSize; ++x)
+                image.SetChannel({x, y}, 0, x + TileSize * y + i);
+        std::string data(TextureTileCache::TileBytes(image.Format(), 1), '\0');
+        TextureTileCache::CopyTile(
+            image, {0, 0}, pstd::span<uint8_t>((uint8_t *)data.data(), data.size()));
+        filenames.push_back("tiles" + std::to_string(i) + ".bin");
+        ASSERT_TRUE(WriteFileContents(filenames.back(), data));
+
+        TextureTileCache::Level level{{TileSize, TileSize}, 1, 0};
+        textures.push_back(cache.AddTextureFile(filenames.back(), PixelFormat::Float,
+                                                {"Y"}, ColorEncoding::Linear, {level}));
+    }
+
+#ifdef PBRT_IS_LINUX
+    int nOpen = CountOpenFiles();
+#endif  // PBRT_IS_LINUX
+    // Read a texel from each texture repeatedly; the small budget means that
+    // tiles are evicted and their files have to be opened again.
+    for (int pass = 0; pass < 3; ++pass)
+        for (int i = 0; i < nFiles; ++i) {
+            const Image &tile = cache.GetTile(textures[i], 0, {0, 0});
+            EXPECT_EQ(5 + TileSize * 7 + i, tile.GetChannel({5, 7}, 0));
+        }
+#ifdef PBRT_IS_LINUX
+    EXPECT_LE(CountOpenFiles(), nOpen + TextureTileCache::MaxOpenFiles);
+#endif  // PBRT_IS_LINUX
+
+    for (const std::string &filename : filenames)
+        EXPECT_TRUE(RemoveFile(filename));
+}
+#endif  // !PBRT_IS_WINDOWS